@@ -114,10 +114,24 @@ Usage: nc = netcdf_open (file, mode [; qualifiers]);
   "w" (read-write existing),
   "c" (create)
 Qualifiers:
- noclobber, share, lock
+ noclobber, share, lock, async_writes=N, async_bytes=B
 Methods:
   .get                 Read a netCDF variable
   .put                 Write to a netCDF variable
+  .get_into            Read a netCDF variable into an existing array
+  .get_many            Read several hyperslabs of a netCDF variable
+  .get_points          Read the values at a list of points
+  .put_points          Write values at a list of points
+  .get_vars            Read the same hyperslab of several variables
+  .records             Iterate over the records of a variable
+  .blocks              Iterate over the chunk-aligned blocks of a variable
+  .reduce              Reduce a variable over some of its dimensions
+  .sel                 Read the values at the given coordinate values
+  .var                 Get an indexable proxy for a netCDF variable
+  .get_async           Start reading a netCDF variable in the background
+  .append              Append records to a netCDF variable
+  .append_record       Append a record to several netCDF variables
+  .flush               Write the buffered records and queued puts
   .get_slices          Read slices from a netCDF variable
   .put_slices          Write slices to a netCDF variable
   .def_dim             Define a netCDF dimension
@@ -129,6 +143,7 @@ Methods:
   .group               Open a netCDF group
   .subgrps             Get the subgroups of the current group
   .inq_var_storage     Get cache, compression, and chunking info
+  .refresh             Discard cached variable shapes
   .info                Print some information about the object
   .close               Close the underlying netCDF file
 #v-
@@ -22,6 +22,20 @@
   .def_compound     Define a netCDF compound
   .put              Write data to a netCDF variable
   .get              Read data from a netCDF variable
+  .get_into         Read data into an existing array
+  .get_many         Read several hyperslabs of a variable
+  .get_points       Read the values at a list of points
+  .put_points       Write values at a list of points
+  .get_vars         Read the same hyperslab of several variables
+  .records          Iterate over the records of a variable
+  .blocks           Iterate over the chunk-aligned blocks of a variable
+  .reduce           Reduce a variable over some of its dimensions
+  .sel              Read the values at the given coordinate values
+  .var              Get an indexable proxy for a netCDF variable
+  .get_async        Start reading a variable in the background
+  .append           Append records to a variable
+  .append_record    Append a record to several variables
+  .flush            Write the buffered records and queued puts
   .get_slices       Read slices from a netCDF variable
   .put_slices       Write slices to a netCDF variable
   .put_att          Write a netCDF attribute
@@ -30,6 +44,7 @@
   .def_grp          Define a netCDF group
   .subgrps          Get the subgroups of the current group\n\
   .inq_var_storage  Get cache, compression, and chunking info
+  .refresh          Discard cached variable shapes
   .info             Print some information about the netCDF object
   .close            Close a netCDF file
 #v-
@@ -38,6 +53,20 @@
 \qualifiers
 \qualifier{noclobber}{When creating a new file, do not overwrite an existing one}
 \qualifier{share}{Open the file with \netcdf \var{NC_SHARE} semantics}
+\qualifier{async_writes=N}{Queue up to N puts for a writer thread}
+\qualifier{async_bytes=B}{Limit the queued puts to B bytes}
+\notes
+  If the \exmp{async_writes} qualifier is given, the \exmp{.put}
+  method copies the values of a numeric array into a queue and returns
+  without waiting for them to be written.  A thread owned by the module
+  writes the queued values in order.  A put blocks while the queue holds
+  \exmp{N} puts, or while adding the values would exceed the memory
+  limit given by the \exmp{async_bytes} qualifier, which defaults to
+  16 MiB.  Any other operation on the file, including the
+  \exmp{.flush} and \exmp{.close} methods, first waits until the queue
+  has been written.  An error from a queued write is thrown by the next
+  put or operation on the file, and the puts that were queued after the
+  failed one are discarded.
 \example
   This is a simple example that creates a \netcdf file and writes a 6x4
   array with dimension names \exmp{x} and \exmp{y} to a \netcdf variable called
@@ -58,6 +87,29 @@
 \done
 
 
+\function{netcdf_lock_stats}
+\synopsis{Get the counters of the lock that serializes netCDF calls}
+\usage{s = netcdf_lock_stats ([; reset])}
+\description
+  Since the netCDF library is not thread-safe, the module serializes
+  its calls to the library by a single lock.  This matters when the
+  worker threads of the record readers, the asynchronous writes, and
+  the \exmp{.get_async} method are in use.  This function returns a
+  structure with the following fields that describe the use of the
+  lock:
+#v+
+   calls           the number of calls made while holding the lock
+   contended       the number of calls that had to wait for the lock
+   wait_time       the total time in seconds spent waiting
+   hold_time       the total time in seconds the lock was held
+   max_hold_time   the longest time in seconds the lock was held
+#v-
+\qualifiers
+\qualifier{reset}{Zero the counters after reading them}
+\seealso{netcdf_open, netcdf.get_async, netcdf.records}
+\done
+
+
 \function{netcdf.def_var}
 \synopsis{Define a new netCDF variable}
 \usage{nc.def_var (varname, type, dim_names)}
@@ -263,13 +315,24 @@
 
 \function{netcdf.put}
 \synopsis{Write to a netCDF variable}
-\usage{nc.put (varname, datavalues [,start [,count [,stride]]])}
+\usage{nc.put (varname, datavalues [,start [,count [,stride]]] [; pack])}
 \description
   The \exmp{.put} method may be used to write one or more data values
   to the netCDF variable whose name is given by \exmp{varname}.  The
   optional parameters (\exmp{start}, \exmp{count}, and \exmp{stride})
   may be used to specify where the data values are to be written.
+\qualifiers
+\qualifier{pack}{Pack the values using the CF packing attributes}
 \notes
+  If the \exmp{pack} qualifier is given, each value \exmp{x} is
+  written as \exmp{(x-add_offset)/scale_factor}, where
+  \exmp{scale_factor} and \exmp{add_offset} are attributes of the
+  variable that default to 1 and 0, respectively.  For an integer
+  variable, the packed value is rounded to the nearest integer and
+  clamped to the range of the type.  NaN values are written as the
+  fill value of the variable.  If the variable has neither attribute,
+  the values are written unchanged.
+
   The \exmp{.put_slices} method may be easier to use when writing data
   to one or more subarrays of a netCDF array.
 \seealso{netcdf.get, netcdf.put_slices, netcdf.def_var, netcdf.put_att}
@@ -278,17 +341,529 @@
 
 \function{netcdf.get}
 \synopsis{Read values from a netCDF variable}
-\usage{vals = nc.get (varname [,start [,count [,stride]]])}
+\usage{vals = nc.get (varname [,start [,count [,stride]]] [; qualifiers])}
 \description
   The \exmp{.get} method may be use to read one or more values from
   the netCDF variable whose name is given by \exmp{varname}.  The
   optional paramters (\exmp{start}, \exmp{count}, and \exmp{stride})
   may be used to specify that the data values are to be read from
-  the specified subset of the netCDF variable.
+  the specified subset of the netCDF variable.  Negative values of
+  \exmp{start} are taken relative to the end of the corresponding
+  dimension.  If \exmp{count} is not given, the values from
+  \exmp{start} to the end of each dimension are read.  A negative
+  \exmp{stride} reads the corresponding dimension in reverse order,
+  from \exmp{start} towards its beginning, e.g., to flip a latitude
+  axis that is stored from south to north.  Any of these parameters
+  may be given as \exmp{NULL} to obtain the default.
+\qualifiers
+\qualifier{unpack[=type]}{Unpack the values using the CF packing attributes}
+\qualifier{mask[=type]}{Replace missing values by NaN}
+\qualifier{order=dims}{Permute the dimensions of the result}
 \notes
+  If the \exmp{unpack} qualifier is given, each value \exmp{x} is
+  converted to \exmp{x*scale_factor+add_offset}, where
+  \exmp{scale_factor} and \exmp{add_offset} are attributes of the
+  variable.  A missing attribute defaults to 1 or 0, respectively.  The
+  values are returned as a \dtype{Float_Type} or \dtype{Double_Type}
+  array according to the type of the attributes, unless the type is
+  specified as the value of the qualifier, e.g., \exmp{unpack=Double_Type}.
+  If the variable has neither attribute and no type is given, the values
+  are returned as stored.  The conversion is performed as the values are
+  read, without creating temporary arrays.
+
+  If the \exmp{mask} qualifier is given, values that equal the
+  \exmp{_FillValue} attribute (or the default fill value of the type
+  if there is no such attribute), or any value of the
+  \exmp{missing_value} attribute, or that lie outside the range given
+  by the \exmp{valid_range} or \exmp{valid_min} and \exmp{valid_max}
+  attributes, are replaced by NaN.  These comparisons are made with the
+  stored values, i.e., before unpacking.  Since NaN is a floating point
+  value, the values of an integer variable are promoted to
+  \dtype{Float_Type}, or to \dtype{Double_Type} for types wider than
+  16 bits, unless a type is given as the value of either qualifier.
+
+  The \exmp{order} qualifier specifies the dimensions of the variable,
+  by name or by index, in the order in which they are to appear in the
+  result.  For example, a variable stored as \exmp{[time,lat,lon]} may
+  be read as \exmp{[lat,lon,time]} via
+#v+
+    x = nc.get ("temp"; order=["lat", "lon", "time"]);
+#v-
+  The values are written directly to their transposed positions as
+  they are read, without creating a temporary copy of the array.  This
+  qualifier may not be combined with \exmp{unpack} or \exmp{mask}.
+
   The \exmp{.get_slices} method may be easier to use when reading data
   from one or more subarrays of a netCDF array.
-\seealso{netcdf.put, netcdf.get_slices, netcdf.def_var, netcdf.get_att}
+\seealso{netcdf.put, netcdf.get_slices, netcdf.get_into, netcdf.def_var, netcdf.get_att}
+\done
+
+
+\function{netcdf.get_into}
+\synopsis{Read values from a netCDF variable into an existing array}
+\usage{nc.get_into (varname, array [,start [,count [,stride]]])}
+\description
+  The \exmp{.get_into} method works like the \exmp{.get} method except
+  that the values are written into the existing \exmp{array} instead
+  of a newly allocated one.  This allows the same array to be reused
+  when the same sized block of values is read repeatedly, e.g., one
+  record at a time.
+
+  The type of the array must be the one that \exmp{.get} would return
+  for the variable, and the number of its elements must equal the
+  number of values to be read.  If \exmp{count} is not given, the
+  dimensions of the array are assumed to correspond to the fastest
+  varying dimensions of the variable, as in the \exmp{.put} method.
+\example
+#v+
+   x = Float_Type[nlat, nlon];
+   _for rec (0, nrecs-1, 1)
+     {
+        nc.get_into ("temperature", x, [rec, 0, 0]);
+        process_record (x);
+     }
+#v-
+\seealso{netcdf.get, netcdf.get_slices}
+\done
+
+
+\function{netcdf.get_many}
+\synopsis{Read several hyperslabs of a netCDF variable}
+\usage{arrays = nc.get_many (varname, starts, counts [,strides])}
+\description
+  The \exmp{.get_many} method reads a number of hyperslabs (boxes) from
+  the netCDF variable whose name is given by \exmp{varname}.  The
+  \exmp{starts}, \exmp{counts}, and optional \exmp{strides} parameters
+  are 2-d arrays of shape \exmp{[nboxes, ndims]}, where \exmp{ndims} is
+  the number of dimensions of the variable.  Row \exmp{i} of these
+  arrays specifies the \exmp{start}, \exmp{count}, and \exmp{stride}
+  parameters of box \exmp{i} as for the \exmp{.get} method.  Negative
+  start values are taken relative to the end of the dimension.
+
+  An array of \exmp{nboxes} arrays is returned, where the \exmp{i}th
+  element holds the values of the \exmp{i}th box.
+\example
+#v+
+   % Read 3x3 neighborhoods about the points (i0,j0) and (i1,j1)
+   starts = _reshape ([i0-1, j0-1, i1-1, j1-1], [2, 2]);
+   counts = _reshape ([3, 3, 3, 3], [2, 2]);
+   boxes = nc.get_many ("t2m", starts, counts);
+   t0 = boxes[0]; t1 = boxes[1];
+#v-
+\notes
+  All of the boxes are checked before any data are read.  The boxes
+  are then read in the order that they are stored in the file, i.e.,
+  sorted by the chunk containing the first element of the box.  For a
+  compressed variable, consecutive reads from the same chunk are then
+  satisfied by the chunk cache instead of decompressing the chunk
+  again.
+\seealso{netcdf.get, netcdf.get_slices}
+\done
+
+
+\function{netcdf.get_points}
+\synopsis{Read the values of a netCDF variable at a list of points}
+\usage{values = nc.get_points (varname, indices [; max_bytes=value])}
+\description
+  The \exmp{.get_points} method reads the values of the netCDF
+  variable whose name is given by \exmp{varname} at the points given by
+  the \exmp{indices} array.  This array has the shape
+  \exmp{[npoints, ndims]}, where \exmp{ndims} is the number of
+  dimensions of the variable, and row \exmp{i} holds the indices of
+  point \exmp{i}.  A 1-d array may be used for a 1-d variable.  Negative
+  indices are taken relative to the end of the dimension.
+
+  The values are returned as a 1-d array of \exmp{npoints} elements in
+  the order of the points.
+\qualifiers
+\qualifier{max_bytes=value}{Memory budget of the read buffer (default 16MB)}
+\example
+#v+
+   % Get the model values at the observation locations, where the
+   % itime, ilat, and ilon arrays hold the grid indices of n points.
+   indices = transpose (_reshape ([itime, ilat, ilon], [3, n]));
+   values = nc.get_points ("t2m", indices);
+#v-
+\notes
+  The points are grouped by the chunk that contains them, and the
+  smallest hyperslab enclosing the points in a chunk is read once.  For
+  a variable that is not chunked, or if a chunk exceeds the memory
+  budget, blocks of at most \exmp{max_bytes} bytes are used instead.
+  If the points within a chunk are very sparse, they are read one at a
+  time.
+  Compound types are not supported.
+\seealso{netcdf.get, netcdf.get_many, netcdf.put_points}
+\done
+
+
+\function{netcdf.put_points}
+\synopsis{Write values of a netCDF variable at a list of points}
+\usage{nc.put_points (varname, indices, values [; max_bytes=value])}
+\description
+  The \exmp{.put_points} method writes values to the netCDF variable
+  whose name is given by \exmp{varname} at the points given by the
+  \exmp{indices} array.  As for the \exmp{.get_points} method, this is
+  an array of shape \exmp{[npoints, ndims]} whose rows hold the indices
+  of the points.  The \exmp{values} parameter is either an array of
+  \exmp{npoints} values, or a single value that is written to each of
+  the points.  If a point occurs more than once, the value that
+  appears last is written.
+\qualifiers
+\qualifier{max_bytes=value}{Memory budget of the write buffer (default 16MB)}
+\example
+#v+
+   % Apply corrections at the grid points given by the rows of ij
+   values = nc.get_points ("sst", ij);
+   nc.put_points ("sst", ij, values + corrections);
+#v-
+\notes
+  The points are grouped by chunk as for the \exmp{.get_points}
+  method.  The smallest hyperslab enclosing the points of a chunk is
+  read, updated, and written back, so that the number of writes is
+  the number of chunks touched rather than the number of points.  The
+  hyperslab is not read if every one of its elements is written.
+  Compound types are not supported.
+\seealso{netcdf.get_points, netcdf.put, netcdf.put_slices}
+\done
+
+
+\function{netcdf.get_vars}
+\synopsis{Read the same hyperslab from several netCDF variables}
+\usage{s = nc.get_vars (varnames [,start [,count]] [; dims=dimnames])}
+\description
+  The \exmp{.get_vars} method reads a hyperslab from each of the
+  variables whose names are given by the \exmp{varnames} array, and
+  returns a structure whose field names are the variable names and
+  whose values are the corresponding arrays.
+
+  Without the \exmp{dims} qualifier, the \exmp{start} and \exmp{count}
+  parameters have the same meaning as for the \exmp{.get} method, and
+  all of the variables must have the same number of dimensions.  If
+  the \exmp{dims} qualifier is given, its value is an array of dimension
+  names to which the \exmp{start} and \exmp{count} values refer.  Each
+  variable must have all of these dimensions, and its other dimensions
+  are read in their entirety.
+\qualifiers
+\qualifier{dims=dimnames}{Names of the dimensions of the start and count values}
+\example
+  Read the \exmp{n}th record of several variables that have the
+  unlimited \exmp{time} dimension:
+#v+
+   s = nc.get_vars (["t", "p", "q"], [n], [1]; dims="time");
+   t = s.t; p = s.p; q = s.q;
+#v-
+\notes
+  The hyperslabs of all of the variables are checked before any data
+  are read.  The variables are read in the order of their netCDF
+  variable ids, which for the classic file formats corresponds to the
+  order in which they are stored in the file.
+\seealso{netcdf.get, netcdf.get_many}
+\done
+
+
+\function{netcdf.records}
+\synopsis{Iterate over the records of a netCDF variable}
+\usage{r = nc.records (varname [; batch=N, prefetch=K])}
+\description
+  The \exmp{.records} method returns an object that may be used to
+  read the variable whose name is given by \exmp{varname} in batches of
+  records along its unlimited dimension.  The object has the following
+  methods and fields:
+#v+
+   r.next()     Return the next batch of records, or NULL at the end
+   r.close()    Stop reading; subsequent calls to r.next return NULL
+   r.first      The index of the first record of the last batch
+#v-
+  Each batch is an array with the shape of the variable, except that
+  the unlimited dimension has a length of at most \exmp{N}, the batch
+  size.  The number of records is determined when the object is
+  created.
+\qualifiers
+\qualifier{batch=N}{Number of records per batch (default 1)}
+\qualifier{prefetch=K}{Number of batches to read ahead (default 2)}
+\example
+#v+
+   r = nc.records ("temperature"; batch=100);
+   forever
+     {
+        variable t = r.next ();
+        if (t == NULL) break;
+        process_records (r.first, t);
+     }
+#v-
+\notes
+  If \exmp{K} is non-zero, a background thread reads the next \exmp{K}
+  batches while the current one is being processed.  The netCDF
+  library is not thread-safe, so all calls to it by the module are
+  serialized by a single lock.  Closing the file stops the background
+  thread, after which calling \exmp{r.next} is an error.
+
+  Only numeric types are supported.
+\seealso{netcdf.get, netcdf.get_vars}
+\done
+
+
+\function{netcdf.blocks}
+\synopsis{Iterate over the chunk-aligned blocks of a netCDF variable}
+\usage{b = nc.blocks (varname [; max_bytes=value])}
+\description
+  The \exmp{.blocks} method returns an object that may be used to read
+  the entire variable whose name is given by \exmp{varname} one block at
+  a time.  The object has the following methods and fields:
+#v+
+   b.next()     Return the next block, or NULL when there are no more
+   b.start      The start indices of the last block returned
+   b.count      The shape of the last block returned
+#v-
+  The blocks are returned in row-major order, and together they cover
+  the variable exactly once.  The shape of the variable is determined
+  when the object is created.
+\qualifiers
+\qualifier{max_bytes=value}{Memory budget of a block (default 16MB)}
+\example
+  Compute the sum of a large variable:
+#v+
+   b = nc.blocks ("precip"; max_bytes=64*1024*1024);
+   total = 0.0;
+   forever
+     {
+        variable x = b.next ();
+        if (x == NULL) break;
+        total += sum (x);
+     }
+#v-
+\notes
+  For a chunked variable, the blocks consist of whole chunks, so that
+  each chunk is read, and if compressed, decompressed only once.
+  Chunks are merged along the fastest varying dimensions up to the
+  memory budget.  A variable that is not chunked is read in blocks of
+  complete rows where possible.
+\seealso{netcdf.get, netcdf.records, netcdf.inq_var_storage}
+\done
+
+
+\function{netcdf.reduce}
+\synopsis{Compute a reduction of a netCDF variable over some of its dimensions}
+\usage{y = nc.reduce (varname, op [; dims=dims, max_bytes=value])}
+\description
+  The \exmp{.reduce} method reduces the variable whose name is given by
+  \exmp{varname} over the dimensions specified by the \exmp{dims}
+  qualifier, or over all of its dimensions if the qualifier is not
+  given.  The operation \exmp{op} is one of the following strings:
+#v+
+   "count"   The number of valid values
+   "sum"     The sum of the valid values
+   "mean"    The mean of the valid values
+   "min"     The minimum of the valid values
+   "max"     The maximum of the valid values
+   "var"     The unbiased sample variance of the valid values
+#v-
+  The result is a \dtype{Double_Type} array whose dimensions are those
+  of the variable that were not reduced, or a scalar if all of the
+  dimensions were reduced.  Values equal to the \exmp{_FillValue}
+  attribute of the variable, or to the default fill value of its type
+  if the attribute does not exist, are not valid, and neither are NaNs.
+  The mean, minimum, and maximum of no values, and the variance of
+  fewer than two values, are NaN.
+\qualifiers
+\qualifier{dims=dims}{The dimensions to reduce over, given by index or name}
+\qualifier{max_bytes=value}{Memory budget of a block (default 16MB)}
+\example
+  Compute the time-mean of a variable with dimensions (time,lat,lon):
+#v+
+   tmean = nc.reduce ("temp", "mean"; dims="time");
+#v-
+  Here \exmp{tmean} is a 2-d array with dimensions (lat,lon).
+\notes
+  The variable is read in the same chunk-aligned blocks as the
+  \exmp{.blocks} method uses, and only one block is held in memory at a
+  time in addition to the result.  Sums are computed using compensated
+  summation, and variances using Welford's algorithm.
+\seealso{netcdf.blocks, netcdf.get}
+\done
+
+\function{netcdf.sel}
+\synopsis{Read a netCDF variable by coordinate value}
+\usage{vals = nc.sel (varname ; dimname=[a,b] | value, ...)}
+\description
+  The \exmp{.sel} method reads the hyperslab of the variable whose name
+  is given by \exmp{varname} that corresponds to the specified values
+  of the coordinate variables of its dimensions.  Each dimension to be
+  selected is given as a qualifier whose name is that of the dimension.
+  The value of the qualifier may be a range \exmp{[a,b]}, which selects
+  the coordinate values in the closed interval, or a single value,
+  which selects the nearest coordinate value.  Dimensions that are not
+  given are read in full.  The coordinate variable of a dimension is
+  the 1-d variable with the same name, e.g., as created by
+  \exmp{.def_dim} when given the grid points of the dimension.
+\qualifiers
+\qualifier{dimname=[a,b] | value}{Coordinate range or value of a dimension}
+\qualifier{unpack, mask, order}{As for \exmp{.get}}
+\example
+  Read a time range of a box of a variable with dimensions
+  (time,lat,lon):
+#v+
+   x = nc.sel ("temp"; time=[t0, t1], lat=[-30, 30], lon=[100, 160]);
+#v-
+\notes
+  The coordinate variables are read once and cached by the object.
+  Indices of monotonically increasing or decreasing coordinates are
+  found using a binary search, and the selection is read as a single
+  hyperslab.  The values of a non-monotonic coordinate in the range
+  must be contiguous.
+\seealso{netcdf.get, netcdf.def_dim}
+\done
+
+\function{netcdf.var}
+\synopsis{Get an indexable proxy for a netCDF variable}
+\usage{v = nc.var (varname)}
+\description
+  The \exmp{.var} method returns an object of type
+  \dtype{NetCDF_Var_Proxy_Type} that refers to the variable whose name
+  is given by \exmp{varname}.  Indexing the object reads the
+  corresponding hyperslab of the variable, and assigning to an indexed
+  object writes it:
+#v+
+   v = nc.var ("temp");
+   x = v[0, [10:20], *];      % 2-d array
+   v[1, [10:20], *] = x;
+   v[2, *, *] = 0.0;          % a single value fills the hyperslab
+#v-
+  As with S-Lang arrays, a dimension that is indexed by an integer does
+  not appear in the result, and negative indices are taken relative to
+  the end of the dimension.  Each index must be an integer, a range, or
+  an array of evenly spaced integers, and the index of a dimension may
+  decrease, e.g., \exmp{[-1:0:-1]}.  Indexing a proxy reads or writes
+  the hyperslab directly without the overhead of the \exmp{.get}
+  method.
+\notes
+  Ranges whose end is omitted, such as \exmp{*} or \exmp{[i:]}, extend
+  to the end of the dimension.  Ranges whose start is omitted must have
+  an explicit end, e.g., \exmp{[:n-2]} rather than \exmp{[:-2]}.  Use
+  the \exmp{.get_slices} method for indices that are not evenly spaced.
+\seealso{netcdf.get, netcdf.put, netcdf.get_slices}
+\done
+
+\function{netcdf.get_async}
+\synopsis{Start reading a netCDF variable in the background}
+\usage{h = nc.get_async (varname [,start [,count]])}
+\description
+  The \exmp{.get_async} method queues the read of a hyperslab of the
+  variable whose name is given by \exmp{varname} and returns without
+  waiting for it.  The \exmp{start} and \exmp{count} arguments have
+  the same meaning as for the \exmp{.get} method.  The reads are made
+  in order by an I/O thread of the module.  The returned object has
+  the following methods:
+#v+
+   x = h.wait ();     % Wait for the read and return the values
+   flag = h.ready (); % Return 1 if h.wait would not block
+#v-
+  This permits the next hyperslab to be read while the current one is
+  processed:
+#v+
+   h = nc.get_async ("temp", [0, 0, 0], [1, ny, nx]);
+   _for i (0, nt-1, 1)
+     {
+        x = h.wait ();
+        if (i + 1 < nt)
+          h = nc.get_async ("temp", [i+1, 0, 0], [1, ny, nx]);
+        process (x);
+     }
+#v-
+  The values are read into arrays that are kept in a small pool.  An
+  array that is no longer referenced outside the pool is reused by a
+  later read of the same type and shape, so that a loop like the one
+  above does not allocate new arrays.
+\notes
+  Only numeric variables and unit strides are supported.  A read is
+  made some time before \exmp{h.wait} returns, so it may or may not see
+  the writes to the variable that are made after \exmp{.get_async} is
+  called.  The queued reads of a file are discarded when the file is
+  closed.
+\seealso{netcdf.get, netcdf.records}
+\done
+
+\function{netcdf.append}
+\synopsis{Append records to a netCDF variable}
+\usage{nc.append (varname, record)}
+\description
+  The \exmp{.append} method appends one or more records to the end of
+  the variable whose name is given by \exmp{varname}.  The first
+  dimension of the variable must be unlimited, and \exmp{record} must
+  consist of a whole number of records, i.e., its number of elements
+  must be a multiple of the number of elements in a record:
+#v+
+   nc.def_dim ("time", 0);
+   nc.def_var ("temp", Float_Type, ["time", "y", "x"]);
+     .
+     .
+   forever
+     {
+        x = acquire_frame ();     % a 2-d array
+        nc.append ("temp", x);
+     }
+   nc.close ();
+#v-
+  The records are collected in a buffer that holds a whole number of
+  chunks of the variable along the record dimension, and are written
+  by a single call when the buffer fills.  The \exmp{.flush} and
+  \exmp{.close} methods write any records that remain in the buffer,
+  as does any other method that accesses the file, e.g., \exmp{.get},
+  before it does so.  Likewise, the \exmp{.put} method writes the
+  records buffered for its variable before writing the variable.
+\notes
+  Only variables of numeric types are supported.  The records are
+  appended after the last record of the variable at the time the
+  buffer is started, which includes the records written by other
+  methods.  Calls to other methods between the appends cause partial
+  buffers to be written, so for best performance, the appends should
+  not be interleaved with other operations on the file.
+\seealso{netcdf.append_record, netcdf.flush, netcdf.put, netcdf.close}
+\done
+
+\function{netcdf.append_record}
+\synopsis{Append a record to several netCDF variables}
+\usage{nc.append_record (s)}
+\description
+  The \exmp{.append_record} method appends a record to each of the
+  variables whose names are given by the fields of the structure
+  \exmp{s}.  The value of a field is the record of the corresponding
+  variable, e.g.,
+#v+
+   nc.append_record (struct {time = t, temp = x, pressure = p});
+#v-
+  The variables must share the unlimited first dimension and have the
+  same number of records.  The values are buffered as for the
+  \exmp{.append} method, and the buffers of the variables are flushed
+  together.  Since all of the values are checked before any of them
+  are buffered, an invalid record does not leave the variables with
+  different lengths.
+\notes
+  The variables are written one after the other, and a flush stops at
+  the first error.  The variables written before the failure, which
+  are named by the error message, then have more records than the
+  others.  No further records are accepted for the variables until a
+  later flush, e.g., by the \exmp{.flush} method, has written the
+  remaining ones.
+
+  Using a different set of fields writes the records that have been
+  buffered for the previous set.  A variable that has been written by
+  the \exmp{.append_record} method may not be passed to the
+  \exmp{.append} method until the file is closed.
+\seealso{netcdf.append, netcdf.flush}
+\done
+
+\function{netcdf.flush}
+\synopsis{Write the buffered records and queued puts}
+\usage{nc.flush ()}
+\description
+  The \exmp{.flush} method writes the records of the file that have
+  been buffered by the \exmp{.append} and \exmp{.append_record}
+  methods, making them visible to reads.  If the file was opened with
+  the \exmp{async_writes} qualifier, it also waits until the queued
+  puts have been written, and throws an exception if one of them
+  failed.
+\seealso{netcdf.append, netcdf.append_record, netcdf.close}
 \done
 
 
@@ -314,6 +889,10 @@
 \qualifiers
 \qualifier{dims=[d0,...]}{Specifies the dimensions that correspond to
      the index variables.  The default is [0,1,...]}
+\qualifier{mask[=type]}{Replace missing values by NaN}
+\notes
+  The \exmp{mask} qualifier works as described for the \exmp{.get}
+  method.
 \seealso{netcdf.get, netcdf.put_slices}
 \done
 
@@ -443,6 +1022,21 @@ the index variables}
 \done
 
 
+\function{netcdf.refresh}
+\synopsis{Discard the cached shapes of netCDF variables}
+\usage{nc.refresh ()}
+\description
+  To avoid querying the library on every read, the module caches the
+  shape, type, and element size of each variable.  The cached shapes
+  are updated when the definitions change or when a write through the
+  module extends an unlimited dimension.  If the file may have been
+  extended by another process, e.g., when it was opened with the
+  \exmp{share} qualifier, then this method should be called before
+  reading to discard the cached values.
+\seealso{netcdf.get, netcdf_open}
+\done
+
+
 \function{netcdf.info}
 \synopsis{List variables and attributes of a netCDF object}
 \usage{nc.info()}
@@ -459,7 +1053,10 @@ the index variables}
 \synopsis{Close the underlying netCDF file}
 \usage{nc.close ()}
 \description
- This function may be used to close the underlying netCDF file.
+ This function may be used to close the underlying netCDF file, after
+ writing any records buffered by the \exmp{.append} method.  If these
+ records cannot be written, an exception is thrown and the file is left
+ open with its buffers, so that the close may be retried.
 \notes
  The interpreter will silently close the file when all references to it have
  gone out of scope.  Nevertheless it is always good practice to
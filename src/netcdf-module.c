@@ -23,9 +23,14 @@
 #define ENABLE_SLFUTURE_VOID 1
 #include "config.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include <pthread.h>
 #include <slang.h>
 
 #include <netcdf.h>
@@ -41,14 +46,214 @@ SLANG_MODULE(netcdf);
 
 #include "version.h"
 
+#ifndef NAN
+# define NAN (0.0/0.0)
+#endif
+
+/*{{{ Serialization of netCDF calls */
+
+/* The netCDF library is not thread-safe.  Since the record readers, the
+ * write-behind queues, and the read futures call it from worker threads,
+ * all calls to the library are serialized by NC_Lock.  The macros below
+ * route the calls made in this file through NC_LOCKED, which holds the
+ * lock for the duration of the call.  Only nc_strerror and nc_inq_libvers,
+ * which return constant strings, are called without the lock.
+ *
+ * The use of the lock is counted so that contention between the threads
+ * can be seen.  The counters are updated while the lock is held.
+ */
+static pthread_mutex_t NC_Lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct
+{
+   unsigned long num_calls;
+   unsigned long num_contended;	       /* calls that had to wait for the lock */
+   double wait_time;		       /* seconds spent waiting for the lock */
+   double hold_time;		       /* seconds the lock was held */
+   double max_hold_time;
+}
+NC_Lock_Stats_Type;
+
+static NC_Lock_Stats_Type NC_Lock_Stats;
+static double NC_Lock_Time;	       /* when the lock was acquired */
+
+static double get_lock_clock (void)
+{
+   struct timespec ts;
+
+   (void) clock_gettime (CLOCK_MONOTONIC, &ts);
+   return (double) ts.tv_sec + 1e-9 * (double) ts.tv_nsec;
+}
+
+static void lock_nc (void)
+{
+   double t;
+
+   if (0 == pthread_mutex_trylock (&NC_Lock))
+     NC_Lock_Time = get_lock_clock ();
+   else
+     {
+	t = get_lock_clock ();
+	(void) pthread_mutex_lock (&NC_Lock);
+	NC_Lock_Time = get_lock_clock ();
+	NC_Lock_Stats.num_contended++;
+	NC_Lock_Stats.wait_time += NC_Lock_Time - t;
+     }
+   NC_Lock_Stats.num_calls++;
+}
+
+static int unlock_nc (int status)
+{
+   double dt = get_lock_clock () - NC_Lock_Time;
+
+   NC_Lock_Stats.hold_time += dt;
+   if (dt > NC_Lock_Stats.max_hold_time)
+     NC_Lock_Stats.max_hold_time = dt;
+   (void) pthread_mutex_unlock (&NC_Lock);
+   return status;
+}
+
+#define NC_LOCKED(call) (lock_nc (), unlock_nc (call))
+
+#define nc_close(...)                 NC_LOCKED(nc_close(__VA_ARGS__))
+#define nc_create(...)                NC_LOCKED(nc_create(__VA_ARGS__))
+#define nc_def_compound(...)          NC_LOCKED(nc_def_compound(__VA_ARGS__))
+#define nc_def_dim(...)               NC_LOCKED(nc_def_dim(__VA_ARGS__))
+#define nc_def_grp(...)               NC_LOCKED(nc_def_grp(__VA_ARGS__))
+#define nc_def_var(...)               NC_LOCKED(nc_def_var(__VA_ARGS__))
+#define nc_def_var_chunking(...)      NC_LOCKED(nc_def_var_chunking(__VA_ARGS__))
+#define nc_def_var_deflate(...)       NC_LOCKED(nc_def_var_deflate(__VA_ARGS__))
+#define nc_def_var_fill(...)          NC_LOCKED(nc_def_var_fill(__VA_ARGS__))
+#define nc_enddef(...)                NC_LOCKED(nc_enddef(__VA_ARGS__))
+#define nc_get_att(...)               NC_LOCKED(nc_get_att(__VA_ARGS__))
+#define nc_get_att_double(...)        NC_LOCKED(nc_get_att_double(__VA_ARGS__))
+#define nc_get_att_text(...)          NC_LOCKED(nc_get_att_text(__VA_ARGS__))
+#define nc_get_var_chunk_cache(...)   NC_LOCKED(nc_get_var_chunk_cache(__VA_ARGS__))
+#define nc_get_vara(...)              NC_LOCKED(nc_get_vara(__VA_ARGS__))
+#define nc_get_varm_double(...)       NC_LOCKED(nc_get_varm_double(__VA_ARGS__))
+#define nc_get_varm_float(...)        NC_LOCKED(nc_get_varm_float(__VA_ARGS__))
+#define nc_get_varm_int(...)          NC_LOCKED(nc_get_varm_int(__VA_ARGS__))
+#define nc_get_varm_longlong(...)     NC_LOCKED(nc_get_varm_longlong(__VA_ARGS__))
+#define nc_get_varm_schar(...)        NC_LOCKED(nc_get_varm_schar(__VA_ARGS__))
+#define nc_get_varm_short(...)        NC_LOCKED(nc_get_varm_short(__VA_ARGS__))
+#define nc_get_varm_uchar(...)        NC_LOCKED(nc_get_varm_uchar(__VA_ARGS__))
+#define nc_get_varm_uint(...)         NC_LOCKED(nc_get_varm_uint(__VA_ARGS__))
+#define nc_get_varm_ulonglong(...)    NC_LOCKED(nc_get_varm_ulonglong(__VA_ARGS__))
+#define nc_get_varm_ushort(...)       NC_LOCKED(nc_get_varm_ushort(__VA_ARGS__))
+#define nc_get_vars(...)              NC_LOCKED(nc_get_vars(__VA_ARGS__))
+#define nc_get_vars_double(...)       NC_LOCKED(nc_get_vars_double(__VA_ARGS__))
+#define nc_get_vars_float(...)        NC_LOCKED(nc_get_vars_float(__VA_ARGS__))
+#define nc_get_vars_int(...)          NC_LOCKED(nc_get_vars_int(__VA_ARGS__))
+#define nc_get_vars_longlong(...)     NC_LOCKED(nc_get_vars_longlong(__VA_ARGS__))
+#define nc_get_vars_schar(...)        NC_LOCKED(nc_get_vars_schar(__VA_ARGS__))
+#define nc_get_vars_short(...)        NC_LOCKED(nc_get_vars_short(__VA_ARGS__))
+#define nc_get_vars_uchar(...)        NC_LOCKED(nc_get_vars_uchar(__VA_ARGS__))
+#define nc_get_vars_uint(...)         NC_LOCKED(nc_get_vars_uint(__VA_ARGS__))
+#define nc_get_vars_ulonglong(...)    NC_LOCKED(nc_get_vars_ulonglong(__VA_ARGS__))
+#define nc_get_vars_ushort(...)       NC_LOCKED(nc_get_vars_ushort(__VA_ARGS__))
+#define nc_inq(...)                   NC_LOCKED(nc_inq(__VA_ARGS__))
+#define nc_inq_att(...)               NC_LOCKED(nc_inq_att(__VA_ARGS__))
+#define nc_inq_attname(...)           NC_LOCKED(nc_inq_attname(__VA_ARGS__))
+#define nc_inq_compound(...)          NC_LOCKED(nc_inq_compound(__VA_ARGS__))
+#define nc_inq_compound_field(...)    NC_LOCKED(nc_inq_compound_field(__VA_ARGS__))
+#define nc_inq_dim(...)               NC_LOCKED(nc_inq_dim(__VA_ARGS__))
+#define nc_inq_dimid(...)             NC_LOCKED(nc_inq_dimid(__VA_ARGS__))
+#define nc_inq_dimids(...)            NC_LOCKED(nc_inq_dimids(__VA_ARGS__))
+#define nc_inq_dimlen(...)            NC_LOCKED(nc_inq_dimlen(__VA_ARGS__))
+#define nc_inq_grp_full_ncid(...)     NC_LOCKED(nc_inq_grp_full_ncid(__VA_ARGS__))
+#define nc_inq_grp_ncid(...)          NC_LOCKED(nc_inq_grp_ncid(__VA_ARGS__))
+#define nc_inq_grp_parent(...)        NC_LOCKED(nc_inq_grp_parent(__VA_ARGS__))
+#define nc_inq_grpname(...)           NC_LOCKED(nc_inq_grpname(__VA_ARGS__))
+#define nc_inq_grps(...)              NC_LOCKED(nc_inq_grps(__VA_ARGS__))
+#define nc_inq_type(...)              NC_LOCKED(nc_inq_type(__VA_ARGS__))
+#define nc_inq_typeids(...)           NC_LOCKED(nc_inq_typeids(__VA_ARGS__))
+#define nc_inq_unlimdims(...)         NC_LOCKED(nc_inq_unlimdims(__VA_ARGS__))
+#define nc_inq_user_type(...)         NC_LOCKED(nc_inq_user_type(__VA_ARGS__))
+#define nc_inq_var(...)               NC_LOCKED(nc_inq_var(__VA_ARGS__))
+#define nc_inq_var_chunking(...)      NC_LOCKED(nc_inq_var_chunking(__VA_ARGS__))
+#define nc_inq_var_deflate(...)       NC_LOCKED(nc_inq_var_deflate(__VA_ARGS__))
+#define nc_inq_var_fill(...)          NC_LOCKED(nc_inq_var_fill(__VA_ARGS__))
+#define nc_inq_varids(...)            NC_LOCKED(nc_inq_varids(__VA_ARGS__))
+#define nc_inq_varname(...)           NC_LOCKED(nc_inq_varname(__VA_ARGS__))
+#define nc_inq_varnatts(...)          NC_LOCKED(nc_inq_varnatts(__VA_ARGS__))
+#define nc_inq_vartype(...)           NC_LOCKED(nc_inq_vartype(__VA_ARGS__))
+#define nc_insert_array_compound(...) NC_LOCKED(nc_insert_array_compound(__VA_ARGS__))
+#define nc_insert_compound(...)       NC_LOCKED(nc_insert_compound(__VA_ARGS__))
+#define nc_open(...)                  NC_LOCKED(nc_open(__VA_ARGS__))
+#define nc_put_att(...)               NC_LOCKED(nc_put_att(__VA_ARGS__))
+#define nc_put_att_text(...)          NC_LOCKED(nc_put_att_text(__VA_ARGS__))
+#define nc_put_vara(...)              NC_LOCKED(nc_put_vara(__VA_ARGS__))
+#define nc_put_vara_double(...)       NC_LOCKED(nc_put_vara_double(__VA_ARGS__))
+#define nc_put_vara_float(...)        NC_LOCKED(nc_put_vara_float(__VA_ARGS__))
+#define nc_put_vara_int(...)          NC_LOCKED(nc_put_vara_int(__VA_ARGS__))
+#define nc_put_vara_longlong(...)     NC_LOCKED(nc_put_vara_longlong(__VA_ARGS__))
+#define nc_put_vara_schar(...)        NC_LOCKED(nc_put_vara_schar(__VA_ARGS__))
+#define nc_put_vara_short(...)        NC_LOCKED(nc_put_vara_short(__VA_ARGS__))
+#define nc_put_vara_uchar(...)        NC_LOCKED(nc_put_vara_uchar(__VA_ARGS__))
+#define nc_put_vara_uint(...)         NC_LOCKED(nc_put_vara_uint(__VA_ARGS__))
+#define nc_put_vara_ulonglong(...)    NC_LOCKED(nc_put_vara_ulonglong(__VA_ARGS__))
+#define nc_put_vara_ushort(...)       NC_LOCKED(nc_put_vara_ushort(__VA_ARGS__))
+#define nc_put_varm_double(...)       NC_LOCKED(nc_put_varm_double(__VA_ARGS__))
+#define nc_put_varm_float(...)        NC_LOCKED(nc_put_varm_float(__VA_ARGS__))
+#define nc_put_varm_int(...)          NC_LOCKED(nc_put_varm_int(__VA_ARGS__))
+#define nc_put_varm_longlong(...)     NC_LOCKED(nc_put_varm_longlong(__VA_ARGS__))
+#define nc_put_varm_schar(...)        NC_LOCKED(nc_put_varm_schar(__VA_ARGS__))
+#define nc_put_varm_short(...)        NC_LOCKED(nc_put_varm_short(__VA_ARGS__))
+#define nc_put_varm_uchar(...)        NC_LOCKED(nc_put_varm_uchar(__VA_ARGS__))
+#define nc_put_varm_uint(...)         NC_LOCKED(nc_put_varm_uint(__VA_ARGS__))
+#define nc_put_varm_ulonglong(...)    NC_LOCKED(nc_put_varm_ulonglong(__VA_ARGS__))
+#define nc_put_varm_ushort(...)       NC_LOCKED(nc_put_varm_ushort(__VA_ARGS__))
+#define nc_put_vars(...)              NC_LOCKED(nc_put_vars(__VA_ARGS__))
+#define nc_put_vars_double(...)       NC_LOCKED(nc_put_vars_double(__VA_ARGS__))
+#define nc_put_vars_float(...)        NC_LOCKED(nc_put_vars_float(__VA_ARGS__))
+#define nc_put_vars_int(...)          NC_LOCKED(nc_put_vars_int(__VA_ARGS__))
+#define nc_put_vars_longlong(...)     NC_LOCKED(nc_put_vars_longlong(__VA_ARGS__))
+#define nc_put_vars_schar(...)        NC_LOCKED(nc_put_vars_schar(__VA_ARGS__))
+#define nc_put_vars_short(...)        NC_LOCKED(nc_put_vars_short(__VA_ARGS__))
+#define nc_put_vars_uchar(...)        NC_LOCKED(nc_put_vars_uchar(__VA_ARGS__))
+#define nc_put_vars_uint(...)         NC_LOCKED(nc_put_vars_uint(__VA_ARGS__))
+#define nc_put_vars_ulonglong(...)    NC_LOCKED(nc_put_vars_ulonglong(__VA_ARGS__))
+#define nc_put_vars_ushort(...)       NC_LOCKED(nc_put_vars_ushort(__VA_ARGS__))
+#define nc_redef(...)                 NC_LOCKED(nc_redef(__VA_ARGS__))
+#define nc_set_var_chunk_cache(...)   NC_LOCKED(nc_set_var_chunk_cache(__VA_ARGS__))
+
+/*}}}*/
+
 static int sl_NC_Error;
+
+/* The error state is per-thread: the status of the last failed call is
+ * kept in thread-specific data.  The _nc_errno variable mirrors it for
+ * the thread that loaded the module.
+ */
 static int NC_Errno;
+static pthread_t NC_Main_Thread;
+static pthread_key_t NC_Errno_Key;
+static pthread_once_t NC_Errno_Once = PTHREAD_ONCE_INIT;
+
+static void create_errno_key (void)
+{
+   (void) pthread_key_create (&NC_Errno_Key, NULL);
+}
+
+static void set_nc_errno (int err)
+{
+   (void) pthread_once (&NC_Errno_Once, create_errno_key);
+   (void) pthread_setspecific (NC_Errno_Key, (void *) (intptr_t) err);
+   if (pthread_equal (pthread_self (), NC_Main_Thread))
+     NC_Errno = err;
+}
+
+static int get_nc_errno (void)
+{
+   (void) pthread_once (&NC_Errno_Once, create_errno_key);
+   return (int) (intptr_t) pthread_getspecific (NC_Errno_Key);
+}
 
 static void throw_nc_error (const char *name, int err)
 {
    if (err == NC_NOERR) return;
 
-   NC_Errno = err;
+   set_nc_errno (err);
    SLang_verror (sl_NC_Error, "%s returned error code %d: %s", name, err, nc_strerror(err));
 }
 
@@ -151,9 +356,37 @@ typedef struct
    nc_type xtype;
    int var_id;
    unsigned int numrefs;
+
+   /* The following metadata are cached to avoid querying the library
+    * on every read or write.  The shape is valid only when
+    * cache_generation equals Metadata_Generation.
+    */
+   unsigned long cache_generation;
+   int cache_ncid;
+   int cache_root_ncid;		       /* root of cache_ncid */
+   size_t *shape;		       /* current lengths of the dimensions */
+   unsigned char *is_unlimited;
+   unsigned int num_unlimited;
+   int have_type_info;
+   size_t xsize;		       /* size of xtype as reported by netcdf */
+   int xclass;			       /* 0 for atomic types */
+   int have_chunk_info;
+   int is_chunked;
+   size_t *chunks;		       /* chunk sizes if is_chunked */
+
+   /* Incremented by every write of the variable via this object, so
+    * that values cached by the interpreter can be checked.
+    */
+   unsigned long num_writes;
 }
 NCid_Var_Type;
 
+/* This gets incremented whenever the cached variable metadata may
+ * have become stale, e.g., by _nc_refdef, _nc_enddef, or a write
+ * that extends an unlimited dimension.
+ */
+static unsigned long Metadata_Generation = 1;
+
 static int NCid_Type_Id = 0;		       /* file or group */
 typedef struct
 {
@@ -414,6 +647,9 @@ static void free_ncid_var_type (NCid_Var_Type *ncvar)
 
    SLang_free_array (ncvar->at_ncdims);
    SLfree ((char *)ncvar->dims);	       /* NULL ok */
+   SLfree ((char *)ncvar->shape);	       /* NULL ok */
+   SLfree ((char *)ncvar->is_unlimited);   /* NULL ok */
+   SLfree ((char *)ncvar->chunks);	       /* NULL ok */
    SLfree ((char *)ncvar);
 }
 
@@ -430,8 +666,12 @@ static NCid_Var_Type *alloc_ncid_var_type (int var_id, nc_type xtype, SLang_Arra
    memset (ncvar, 0, sizeof(NCid_Var_Type));
 
    num_dims = at_ncdims->num_elements;
-   if (NULL == (dims = (size_t *)SLmalloc(num_dims * sizeof(size_t))))
+   if ((NULL == (dims = (size_t *)SLmalloc((num_dims+1) * sizeof(size_t))))
+       || (NULL == (ncvar->shape = (size_t *)SLmalloc((num_dims+1) * sizeof(size_t))))
+       || (NULL == (ncvar->is_unlimited = (unsigned char *)SLmalloc(num_dims+1))))
      {
+	SLfree ((char *)dims);	       /* NULL ok */
+	SLfree ((char *)ncvar->shape);  /* NULL ok */
 	SLfree ((char *)ncvar);
 	return NULL;
      }
@@ -442,6 +682,9 @@ static NCid_Var_Type *alloc_ncid_var_type (int var_id, nc_type xtype, SLang_Arra
      {
 	dims[i] = ncdims[i]->dim_size;
 	num_elements = num_elements * dims[i];
+	ncvar->shape[i] = dims[i];
+	ncvar->is_unlimited[i] = (dims[i] == 0);
+	ncvar->num_unlimited += (dims[i] == 0);
      }
 
    at_ncdims->num_refs++;
@@ -464,10 +707,297 @@ static int push_ncid_var_type (NCid_Var_Type *ncvar)
    return -1;
 }
 
+/*{{{ Lengths of extended dimensions */
+
+/* The lengths of the unlimited dimensions extended by writes of this
+ * module, including queued writes that have not reached the file yet.
+ * A cached shape is never shorter than these, so that a write that
+ * extends a dimension does not invalidate the caches of the other
+ * variables sharing it.  The dimension ids are unique within a file.
+ */
+typedef struct Dim_Length_Type_
+{
+   int root_ncid;
+   int dim_id;
+   size_t len;
+   struct Dim_Length_Type_ *next;
+}
+Dim_Length_Type;
+
+static Dim_Length_Type *Dim_Length_List = NULL;
+
+static Dim_Length_Type *find_dim_length (int root_ncid, int dim_id)
+{
+   Dim_Length_Type *d;
+
+   for (d = Dim_Length_List; d != NULL; d = d->next)
+     {
+	if ((d->root_ncid == root_ncid) && (d->dim_id == dim_id))
+	  return d;
+     }
+   return NULL;
+}
+
+static int note_dim_length (int root_ncid, int dim_id, size_t len)
+{
+   Dim_Length_Type *d;
+
+   if (NULL != (d = find_dim_length (root_ncid, dim_id)))
+     {
+	if (len > d->len)
+	  d->len = len;
+	return 0;
+     }
+
+   if (NULL == (d = (Dim_Length_Type *) SLmalloc (sizeof (Dim_Length_Type))))
+     return -1;
+   d->root_ncid = root_ncid;
+   d->dim_id = dim_id;
+   d->len = len;
+   d->next = Dim_Length_List;
+   Dim_Length_List = d;
+   return 0;
+}
+
+/* Called when the file is closed since its ncid may get reused */
+static void forget_dim_lengths (int root_ncid)
+{
+   Dim_Length_Type *d, *prev, *next;
+
+   prev = NULL;
+   for (d = Dim_Length_List; d != NULL; d = next)
+     {
+	next = d->next;
+	if (d->root_ncid != root_ncid)
+	  {
+	     prev = d;
+	     continue;
+	  }
+	if (prev == NULL)
+	  Dim_Length_List = next;
+	else
+	  prev->next = next;
+	SLfree ((char *) d);
+     }
+}
+
+static void apply_dim_lengths (NCid_Var_Type *ncvar)
+{
+   NCid_Dim_Type **ncdims = (NCid_Dim_Type **)ncvar->at_ncdims->data;
+   Dim_Length_Type *d;
+   unsigned int i;
+
+   for (i = 0; i < ncvar->num_dims; i++)
+     {
+	if (ncvar->is_unlimited[i] == 0)
+	  continue;
+	d = find_dim_length (ncvar->cache_root_ncid, ncdims[i]->dim_id);
+	if ((d != NULL) && (d->len > ncvar->shape[i]))
+	  ncvar->shape[i] = d->len;
+     }
+}
+
+/* You would think that nc_inq_grp_full_ncid(ncid, "/", &root_ncid)
+ * would suffice.  But,....no.
+ */
+static int get_root_of_ncid (int ncid, int *ncidp)
+{
+   while (1)
+     {
+	int status, root;
+	status = nc_inq_grp_parent (ncid, &root);
+	if (status == NC_ENOGRP)
+	  break;
+	if (status != NC_NOERR)
+	  {
+	     throw_nc_error ("nc_inq_grp_parent", status);
+	     return -1;
+	  }
+	if (root == ncid) break;
+	ncid = root;
+     }
+   *ncidp = ncid;
+   return 0;
+}
+
+/*}}}*/
+
+/* Make sure that the cached metadata for the variable are current.
+ * Only the lengths of the unlimited dimensions can change, and only
+ * these require a call to the library.
+ */
+static int update_var_cache (int ncid, NCid_Var_Type *ncvar)
+{
+   unsigned int i;
+   int status;
+
+   if (ncvar->have_type_info == 0)
+     {
+	if (ncvar->xtype <= NC_MAX_ATOMIC_TYPE)
+	  {
+	     status = nc_inq_type (ncid, ncvar->xtype, NULL, &ncvar->xsize);
+	     ncvar->xclass = 0;
+	  }
+	else
+	  status = nc_inq_user_type (ncid, ncvar->xtype, NULL, &ncvar->xsize, NULL, NULL, &ncvar->xclass);
+
+	if (status != NC_NOERR)
+	  {
+	     throw_nc_error ("nc_inq_type", status);
+	     return -1;
+	  }
+	ncvar->have_type_info = 1;
+     }
+
+   if ((ncvar->cache_generation == Metadata_Generation)
+       && (ncvar->cache_ncid == ncid))
+     {
+	if (ncvar->num_unlimited && (Dim_Length_List != NULL))
+	  apply_dim_lengths (ncvar);
+	return 0;
+     }
+
+   if (ncvar->num_unlimited)
+     {
+	NCid_Dim_Type **ncdims = (NCid_Dim_Type **)ncvar->at_ncdims->data;
+
+	if (-1 == get_root_of_ncid (ncid, &ncvar->cache_root_ncid))
+	  {
+	     ncvar->cache_generation = 0;
+	     return -1;
+	  }
+
+	for (i = 0; i < ncvar->num_dims; i++)
+	  {
+	     if (ncvar->is_unlimited[i] == 0)
+	       continue;
+
+	     status = nc_inq_dimlen (ncid, ncdims[i]->dim_id, ncvar->shape + i);
+	     if (status != NC_NOERR)
+	       {
+		  ncvar->cache_generation = 0;
+		  throw_nc_error ("nc_inq_dimlen", status);
+		  return -1;
+	       }
+	  }
+	apply_dim_lengths (ncvar);
+     }
+   ncvar->cache_ncid = ncid;
+   ncvar->cache_generation = Metadata_Generation;
+   return 0;
+}
+
+/* The chunking of a variable can only change via _nc_def_var_chunking,
+ * which resets have_chunk_info.
+ */
+static int update_var_chunk_cache (int ncid, NCid_Var_Type *ncvar)
+{
+   int status, storage;
+
+   if (ncvar->have_chunk_info)
+     return 0;
+
+   ncvar->is_chunked = 0;
+   if (ncvar->num_dims != 0)
+     {
+	if ((ncvar->chunks == NULL)
+	    && (NULL == (ncvar->chunks = (size_t *)SLmalloc (ncvar->num_dims*sizeof(size_t)))))
+	  return -1;
+
+	status = nc_inq_var_chunking (ncid, ncvar->var_id, &storage, ncvar->chunks);
+	if (status != NC_NOERR)
+	  {
+	     throw_nc_error ("nc_inq_var_chunking", status);
+	     return -1;
+	  }
+	ncvar->is_chunked = (storage == NC_CHUNKED);
+     }
+   ncvar->have_chunk_info = 1;
+   return 0;
+}
+
+static void invalidate_var_caches (void)
+{
+   Metadata_Generation++;
+   if (Metadata_Generation == 0)       /* 0 is never valid */
+     Metadata_Generation++;
+}
+
+/* This function is called after a successful (or queued) write of the
+ * hyperslab.  It counts the write and checks whether an unlimited
+ * dimension was extended.  If so, the cache of this variable is updated
+ * and the new length recorded for the other variables sharing the
+ * dimension.
+ */
+static void note_var_write (int ncid, NCid_Var_Type *ncvar,
+			    size_t *start, size_t *count, ptrdiff_t *stride)
+{
+   NCid_Dim_Type **ncdims;
+   unsigned int i;
+   int grew = 0;
+
+   ncvar->num_writes++;
+
+   if ((ncvar->num_unlimited == 0) || (start == NULL) || (count == NULL))
+     return;
+
+   if ((ncvar->cache_generation != Metadata_Generation)
+       || (ncvar->cache_ncid != ncid))
+     {
+	/* The cache is already stale.  The next reader will update it */
+	return;
+     }
+
+   for (i = 0; i < ncvar->num_dims; i++)
+     {
+	size_t len;
+
+	if ((ncvar->is_unlimited[i] == 0) || (count[i] == 0))
+	  continue;
+
+	len = start[i] + 1;
+	if ((stride != NULL) && (stride[i] > 0))
+	  len += (count[i]-1)*stride[i];
+	else if (stride == NULL)
+	  len += count[i]-1;
+
+	if (len > ncvar->shape[i])
+	  {
+	     ncvar->shape[i] = len;
+	     grew = 1;
+	  }
+     }
+   if (grew == 0)
+     return;
+
+   ncdims = (NCid_Dim_Type **)ncvar->at_ncdims->data;
+   for (i = 0; i < ncvar->num_dims; i++)
+     {
+	if (ncvar->is_unlimited[i]
+	    && (-1 == note_dim_length (ncvar->cache_root_ncid, ncdims[i]->dim_id, ncvar->shape[i])))
+	  {
+	     /* Without the record, the other caches must be re-read */
+	     invalidate_var_caches ();
+	     ncvar->cache_generation = Metadata_Generation;
+	     return;
+	  }
+     }
+}
+
 
 /*}}}*/
 
 /*{{{ Functions that open/close files (NCid_Type) */
+static int get_root_ncid (NCid_Type *nc, int *ncidp);
+static void stop_file_readers (int root_ncid);
+static int flush_file_appends (int root_ncid);
+static size_t count_file_appends (int root_ncid);
+static void free_file_appends (int root_ncid);
+static int sync_file_appends (NCid_Type *nc);
+static int sync_file_writes (NCid_Type *nc);
+static int stop_file_writes (int root_ncid);
+static void stop_file_futures (int root_ncid);
+
 static void free_ncid_type (NCid_Type *nc)
 {
    if (nc == NULL) return;
@@ -477,7 +1007,21 @@ static void free_ncid_type (NCid_Type *nc)
 	return;
      }
 
-   if (nc->is_group == 0) (void) nc_close (nc->ncid);
+   if (nc->is_group == 0)
+     {
+	if (nc->is_closed == 0)
+	  {
+	     stop_file_readers (nc->ncid);
+	     stop_file_futures (nc->ncid);
+	     (void) stop_file_writes (nc->ncid);
+	     if (-1 == flush_file_appends (nc->ncid))
+	       SLang_verror (sl_NC_Error, "%lu records buffered by _nc_append were lost when the unclosed file was freed",
+			     (unsigned long) count_file_appends (nc->ncid));
+	     free_file_appends (nc->ncid);
+	     forget_dim_lengths (nc->ncid);
+	  }
+	(void) nc_close (nc->ncid);
+     }
    SLfree ((char *)nc);
 }
 
@@ -496,7 +1040,7 @@ static NCid_Type *alloc_ncid_type (int ncid, int is_group)
    return nc;
 }
 
-static int check_ncid_type (NCid_Type *nc)
+static int check_ncid_is_open (NCid_Type *nc)
 {
    if (nc->is_closed)
      {
@@ -506,6 +1050,18 @@ static int check_ncid_type (NCid_Type *nc)
    return 0;
 }
 
+/* Check the handle before an operation on the file.  Any queued
+ * asynchronous writes are completed first, and the records buffered by
+ * _nc_append are written, so that the operation sees them.
+ */
+static int check_ncid_type (NCid_Type *nc)
+{
+   if ((-1 == check_ncid_is_open (nc))
+       || (-1 == sync_file_writes (nc)))
+     return -1;
+   return sync_file_appends (nc);
+}
+
 static int pop_ncid_type (NCid_Type **ncp)
 {
    if (-1 == SLclass_pop_ptr_obj (NCid_Type_Id, (VOID_STAR *)ncp))
@@ -580,6 +1136,7 @@ static void sl_nc_redef (NCid_Type *nc)
    if (-1 == check_ncid_type (nc))
      return;
 
+   invalidate_var_caches ();
    status = nc_redef (nc->ncid);
    if (status != NC_NOERR)
      throw_nc_error ("nc_redef", status);
@@ -592,23 +1149,55 @@ static void sl_nc_enddef (NCid_Type *nc)
    if (-1 == check_ncid_type (nc))
      return;
 
+   invalidate_var_caches ();
    status = nc_enddef (nc->ncid);
    if (status != NC_NOERR)
      throw_nc_error ("nc_enddef", status);
 }
 
+/* Force the cached variable metadata to be re-read, e.g., after the
+ * file has been modified by another process.
+ */
+static void sl_nc_refresh (NCid_Type *nc)
+{
+   if (-1 == check_ncid_type (nc))
+     return;
+
+   invalidate_var_caches ();
+}
+
 static void sl_nc_close (NCid_Type *nc)
 {
-   int status;
+   int status, write_status, root_ncid;
 
-   if (-1 == check_ncid_type (nc))
+   if ((-1 == check_ncid_is_open (nc))
+       || (-1 == get_root_ncid (nc, &root_ncid)))
      return;
 
-   status = nc_close (nc->ncid);
-   if (status != NC_NOERR)
-     throw_nc_error ("nc_close", status);
+   /* The file is closed even if a queued write failed, which is thrown
+    * by sync_file_writes.  But if the buffered records that follow the
+    * queued writes cannot be written, the file is left open with its
+    * buffers, so that the close may be retried.
+    */
+   write_status = sync_file_writes (nc);
+   if (-1 == flush_file_appends (root_ncid))
+     {
+	SLang_verror (sl_NC_Error, "_nc_close: %lu records buffered by _nc_append could not be written; the file was not closed",
+		      (unsigned long) count_file_appends (root_ncid));
+	return;
+     }
 
+   stop_file_readers (root_ncid);
+   stop_file_futures (root_ncid);
+   (void) stop_file_writes (root_ncid);
+   free_file_appends (root_ncid);
+
+   forget_dim_lengths (root_ncid);
+   status = nc_close (nc->ncid);
    nc->is_closed = 1;
+
+   if ((write_status == 0) && (status != NC_NOERR))
+     throw_nc_error ("nc_close", status);
 }
 
 
@@ -709,7 +1298,13 @@ static void sl_nc_def_var_chunking (NCid_Type *nc, NCid_Var_Type *ncvar, int *st
 	if (-1 == pop_array_of_type_or_null (&at_chunk, _SL_SIZE_T_TYPE))
 	  return;
      }
+   if (-1 == check_ncid_type (nc))
+     {
+	SLang_free_array (at_chunk);   /* NULL ok */
+	return;
+     }
 
+   ncvar->have_chunk_info = 0;
    num_dims = ncvar->num_dims;
    storage = *storagep;
    switch (storage)
@@ -791,6 +1386,9 @@ static void sl_nc_inq_var_chunking (NCid_Type *nc, NCid_Var_Type *ncvar)
    SLindex_Type ndims;
    int status, storage;
 
+   if (-1 == check_ncid_type (nc))
+     return;
+
    chunk = NULL;
    at = NULL;
    ndims = (SLindex_Type) ncvar->num_dims;
@@ -833,6 +1431,8 @@ static void sl_nc_def_var_fill (NCid_Type *nc, NCid_Var_Type *ncvar, int *code)
      {
 	if (SLang_Num_Function_Args == 4)
 	  (void) SLdo_pop ();
+	if (-1 == check_ncid_type (nc))
+	  return;
 
 	status = nc_def_var_fill (nc->ncid, ncvar->var_id, NC_NOFILL, NULL);
 	(void) check_nc_error ("nc_def_var_fill", status);
@@ -848,7 +1448,8 @@ static void sl_nc_def_var_fill (NCid_Type *nc, NCid_Var_Type *ncvar, int *code)
    if (-1 == map_base_xtype_to_sltype (ncvar->xtype, &sltype))
      return;
 
-   if (-1 == SLang_pop_value (sltype, &fillbuf))
+   if ((-1 == SLang_pop_value (sltype, &fillbuf))
+       || (-1 == check_ncid_type (nc)))
      return;
 
    status = nc_def_var_fill (nc->ncid, ncvar->var_id, NC_FILL, &fillbuf);
@@ -866,6 +1467,9 @@ static void sl_nc_inq_var_fill (NCid_Type *nc, NCid_Var_Type *ncvar)
    int status, fill;
    SLtype sltype;
 
+   if (-1 == check_ncid_type (nc))
+     return;
+
    if (ncvar->xtype > NC_MAX_ATOMIC_TYPE)
      {
 	SLang_verror (SL_NotImplemented_Error, "Fill values not implemented for COMPOUND, OPAQUE, VLEN, and ENUM types");
@@ -888,7 +1492,12 @@ static void sl_nc_inq_var_fill (NCid_Type *nc, NCid_Var_Type *ncvar)
 static void sl_nc_set_var_chunk_cache (NCid_Type *nc, NCid_Var_Type *ncvar, size_t *sizep,
 				      size_t *nelems, float *preemp)
 {
-   int status = nc_set_var_chunk_cache (nc->ncid, ncvar->var_id, *sizep, *nelems, *preemp);
+   int status;
+
+   if (-1 == check_ncid_type (nc))
+     return;
+
+   status = nc_set_var_chunk_cache (nc->ncid, ncvar->var_id, *sizep, *nelems, *preemp);
    (void) check_nc_error ("nc_set_var_chunk_cache", status);
 }
 
@@ -898,6 +1507,9 @@ static void sl_nc_get_var_chunk_cache (NCid_Type *nc, NCid_Var_Type *ncvar)
    float preemp;
    int status;
 
+   if (-1 == check_ncid_type (nc))
+     return;
+
    status = nc_get_var_chunk_cache (nc->ncid, ncvar->var_id, &size, &nelems, &preemp);
    if (-1 == check_nc_error ("nc_get_var_chunk_cache", status))
      return;
@@ -909,7 +1521,12 @@ static void sl_nc_get_var_chunk_cache (NCid_Type *nc, NCid_Var_Type *ncvar)
 static void sl_nc_def_var_deflate (NCid_Type *nc, NCid_Var_Type *ncvar,
 				  int *shuffle, int *deflate, int *level)
 {
-   int status = nc_def_var_deflate (nc->ncid, ncvar->var_id, *shuffle, *deflate, *level);
+   int status;
+
+   if (-1 == check_ncid_type (nc))
+     return;
+
+   status = nc_def_var_deflate (nc->ncid, ncvar->var_id, *shuffle, *deflate, *level);
    (void) check_nc_error ("nc_def_var_deflate", status);
 }
 
@@ -917,8 +1534,11 @@ static void sl_nc_inq_var_deflate (NCid_Type *nc, NCid_Var_Type *ncvar)
 {
    int shuffle, deflate, level, status;
 
-   status = nc_inq_var_deflate (nc->ncid, ncvar->var_id, &shuffle, &deflate, &level);
-   if (-1 == check_nc_error ("nc_inq_var_deflate", status))
+   if (-1 == check_ncid_type (nc))
+     return;
+
+   status = nc_inq_var_deflate (nc->ncid, ncvar->var_id, &shuffle, &deflate, &level);
+   if (-1 == check_nc_error ("nc_inq_var_deflate", status))
      return;
 
    (void) SLang_push_int (shuffle);
@@ -926,6 +1546,47 @@ static void sl_nc_inq_var_deflate (NCid_Type *nc, NCid_Var_Type *ncvar)
    (void) SLang_push_int (level);
 }
 
+/* Check that the hyperslab lies within the variable, whose cached
+ * shape is assumed to be current.  The number of elements in the
+ * hyperslab is returned via totalp.
+ */
+static int check_slice (NCid_Var_Type *ncvar, int is_read,
+			size_t *start, size_t *count, ptrdiff_t *stride, size_t *totalp)
+{
+   size_t total = 1;
+   unsigned int i;
+
+   for (i = 0; i < ncvar->num_dims; i++)
+     {
+	ptrdiff_t stride_i;
+	size_t dim_i = ncvar->shape[i];
+	int is_bad;
+
+	/* Writes may extend an unlimited dimension */
+	if (ncvar->is_unlimited[i] && (is_read == 0))
+	  dim_i = 0;
+
+	/* The last index accessed is start + (count-1)*stride */
+	stride_i = stride[i];
+	if (count[i] == 0)
+	  is_bad = (dim_i != 0) && (start[i] > dim_i);
+	else if (stride_i < 0)
+	  is_bad = (start[i] < (size_t)(-stride_i) * (count[i]-1));
+	else
+	  is_bad = (dim_i != 0) && (start[i] + stride_i*(count[i]-1) >= dim_i);
+
+	if (is_bad)
+	  {
+	     SLang_verror (SL_InvalidParm_Error, "The slice parameters for dimension %u are inconsistent with the size of the dimension", i);
+	     return -1;
+	  }
+
+	total = total * count[i];
+     }
+   *totalp = total;
+   return 0;
+}
+
 static int pop_slice_args (NCid_Type *nc, NCid_Var_Type *ncvar, int is_read,
 			   SLang_Array_Type **at_startp, SLang_Array_Type **at_countp,
 			   SLang_Array_Type **at_stridep,
@@ -946,6 +1607,9 @@ static int pop_slice_args (NCid_Type *nc, NCid_Var_Type *ncvar, int is_read,
        || (-1 == SLang_pop_array_of_type (&at_start, _SL_SIZE_T_TYPE)))
      goto free_and_return;
 
+   if (-1 == update_var_cache (nc->ncid, ncvar))
+     goto free_and_return;
+
    num_dims = ncvar->num_dims;
 
    if ((at_start->num_elements != num_dims)
@@ -970,36 +1634,8 @@ static int pop_slice_args (NCid_Type *nc, NCid_Var_Type *ncvar, int is_read,
      }
    else stride = (ptrdiff_t *)at_stride->data;
 
-   total = 1;
-   for (i = 0; i < num_dims; i++)
-     {
-	ptrdiff_t stride_i;
-	size_t dim_i = ncvar->dims[i];
-
-	if ((dim_i == 0) && is_read)
-	  {
-	     NCid_Dim_Type **ncdims = (NCid_Dim_Type **)ncvar->at_ncdims->data;
-
-	     /* Reading an unlimited dimension.  We need to know the actual size */
-	     int status = nc_inq_dimlen (nc->ncid, ncdims[i]->dim_id, &dim_i);
-	     if (status != NC_NOERR)
-	       {
-		  throw_nc_error ("nc_inq_dimlen", status);
-		  goto free_and_return;
-	       }
-	  }
-	stride_i = stride[i];
-	if (((stride_i < 0)
-	     && (start[i] < -stride_i * count[i]))
-	    || ((dim_i != 0)
-		&& (start[i] + stride_i*count[i] > dim_i)))
-	  {
-	     SLang_verror (SL_InvalidParm_Error, "The slice parameters for dimension %u are inconsistent with the size of the dimension", i);
-	     goto free_and_return;
-	  }
-
-	total = total * count[i];
-     }
+   if (-1 == check_slice (ncvar, is_read, start, count, stride, &total))
+     goto free_and_return;
 
    *totalp = total;
    *at_startp = at_start;
@@ -1178,7 +1814,170 @@ static int init_compound_info (int ncid, nc_type xtype, Compound_Info_Type *cinf
 
 /* Forward declaration */
 static int put_compound (int ncid, int varid, nc_type xtype, size_t *start, size_t *count, ptrdiff_t *stride,
-			 SLang_Array_Type *at, const char *attr_name);
+			 SLang_Struct_Type **sp, size_t num_elements, const char *attr_name);
+
+/* Write the hyperslab of an atomic type from the buffer and return the
+ * netCDF status.  If stride is NULL, the nc_put_vara functions will be
+ * used.  If imap is non-NULL, then it specifies the memory layout as for
+ * the nc_put_varm functions, and stride must not be NULL.  Since this does
+ * not call slang, it may be used by the write-behind threads.
+ */
+static int put_atomic_slab (int ncid, int varid,
+			    size_t *start, size_t *count, ptrdiff_t *stride, ptrdiff_t *imap,
+			    nc_type xtype, VOID_STAR data)
+{
+   int status;
+
+   switch (xtype)
+     {
+      case NC_BYTE:
+	if (imap != NULL)
+	  status = nc_put_varm_schar (ncid, varid, start, count, stride, imap, (signed char *)data);
+	else if (stride != NULL)
+	  status = nc_put_vars_schar (ncid, varid, start, count, stride, (signed char *)data);
+	else
+	  status = nc_put_vara_schar (ncid, varid, start, count, (signed char *)data);
+	break;
+      case NC_UBYTE:
+	if (imap != NULL)
+	  status = nc_put_varm_uchar (ncid, varid, start, count, stride, imap, (unsigned char *)data);
+	else if (stride != NULL)
+	  status = nc_put_vars_uchar (ncid, varid, start, count, stride, (unsigned char *)data);
+	else
+	  status = nc_put_vara_uchar (ncid, varid, start, count, (unsigned char *)data);
+	break;
+      case NC_SHORT:
+	if (imap != NULL)
+	  status = nc_put_varm_short (ncid, varid, start, count, stride, imap, (short *)data);
+	else if (stride != NULL)
+	  status = nc_put_vars_short (ncid, varid, start, count, stride, (short *)data);
+	else
+	  status = nc_put_vara_short (ncid, varid, start, count, (short *)data);
+	break;
+      case NC_USHORT:
+	if (imap != NULL)
+	  status = nc_put_varm_ushort (ncid, varid, start, count, stride, imap, (unsigned short *)data);
+	else if (stride != NULL)
+	  status = nc_put_vars_ushort (ncid, varid, start, count, stride, (unsigned short *)data);
+	else
+	  status = nc_put_vara_ushort (ncid, varid, start, count, (unsigned short *)data);
+	break;
+      case NC_INT:
+	if (imap != NULL)
+	  status = nc_put_varm_int (ncid, varid, start, count, stride, imap, (int *)data);
+	else if (stride != NULL)
+	  status = nc_put_vars_int (ncid, varid, start, count, stride, (int *)data);
+	else
+	  status = nc_put_vara_int (ncid, varid, start, count, (int *)data);
+	break;
+      case NC_UINT:
+	if (imap != NULL)
+	  status = nc_put_varm_uint (ncid, varid, start, count, stride, imap, (unsigned int *)data);
+	else if (stride != NULL)
+	  status = nc_put_vars_uint (ncid, varid, start, count, stride, (unsigned int *)data);
+	else
+	  status = nc_put_vara_uint (ncid, varid, start, count, (unsigned int *)data);
+	break;
+      case NC_INT64:
+	if (imap != NULL)
+	  status = nc_put_varm_longlong (ncid, varid, start, count, stride, imap, (long long *)data);
+	else if (stride != NULL)
+	  status = nc_put_vars_longlong (ncid, varid, start, count, stride, (long long *)data);
+	else
+	  status = nc_put_vara_longlong (ncid, varid, start, count, (long long *)data);
+	break;
+      case NC_UINT64:
+	if (imap != NULL)
+	  status = nc_put_varm_ulonglong (ncid, varid, start, count, stride, imap, (unsigned long long *)data);
+	else if (stride != NULL)
+	  status = nc_put_vars_ulonglong (ncid, varid, start, count, stride, (unsigned long long *)data);
+	else
+	  status = nc_put_vara_ulonglong (ncid, varid, start, count, (unsigned long long *)data);
+	break;
+      case NC_FLOAT:
+	if (imap != NULL)
+	  status = nc_put_varm_float (ncid, varid, start, count, stride, imap, (float *)data);
+	else if (stride != NULL)
+	  status = nc_put_vars_float (ncid, varid, start, count, stride, (float *)data);
+	else
+	  status = nc_put_vara_float (ncid, varid, start, count, (float *)data);
+	break;
+      case NC_DOUBLE:
+	if (imap != NULL)
+	  status = nc_put_varm_double (ncid, varid, start, count, stride, imap, (double *)data);
+	else if (stride != NULL)
+	  status = nc_put_vars_double (ncid, varid, start, count, stride, (double *)data);
+	else
+	  status = nc_put_vara_double (ncid, varid, start, count, (double *)data);
+	break;
+
+      default:
+	status = NC_EBADTYPE;
+     }
+   return status;
+}
+
+/* As put_atomic_slab, but the type of the buffer is given by the slang
+ * type, and errors are thrown.
+ */
+static int write_atomic_slab (int ncid, int varid,
+			      size_t *start, size_t *count, ptrdiff_t *stride, ptrdiff_t *imap,
+			      SLtype sltype, VOID_STAR data)
+{
+   nc_type xtype;
+   int status;
+
+   if (-1 == map_base_sltype_to_xtype (sltype, &xtype))
+     return -1;
+
+   status = put_atomic_slab (ncid, varid, start, count, stride, imap, xtype, data);
+   if (status == NC_EBADTYPE)
+     {
+	SLang_verror (SL_NotImplemented_Error, "_nc_put_vars: %s is not yet supported",
+		      SLclass_get_datatype_name (sltype));
+	return -1;
+     }
+   if (status != NC_NOERR)
+     {
+	throw_nc_error ("_nc_put_vars", status);
+	return -1;
+     }
+   return 0;
+}
+
+/* Write the values in the array to the specified hyperslab.  If stride
+ * is NULL, the nc_put_vara functions will be used.
+ */
+static int write_vars_from_array (int ncid, NCid_Var_Type *ncvar,
+				  size_t *start, size_t *count, ptrdiff_t *stride,
+				  SLang_Array_Type *at)
+{
+   int varid = ncvar->var_id;
+
+   if (at->data_type == SLANG_STRUCT_TYPE)
+     {
+	if (-1 == update_var_cache (ncid, ncvar))
+	  return -1;
+
+	if (ncvar->xclass != NC_COMPOUND)
+	  {
+	     SLang_verror (SL_InvalidParm_Error, "Variable is not compound type");
+	     return -1;
+	  }
+
+	if (-1 == put_compound (ncid, varid, ncvar->xtype, start, count, stride,
+				(SLang_Struct_Type **)at->data, at->num_elements, NULL))
+	  return -1;
+	note_var_write (ncid, ncvar, start, count, stride);
+	return 0;
+     }
+
+   if (-1 == write_atomic_slab (ncid, varid, start, count, stride, NULL, at->data_type, at->data))
+     return -1;
+
+   note_var_write (ncid, ncvar, start, count, stride);
+   return 0;
+}
 
 /* Usage: _nc_put_vars (start, count, stride, data, ncid, varid) */
 static void sl_nc_put_vars (NCid_Type *nc, NCid_Var_Type *ncvar)
@@ -1187,8 +1986,6 @@ static void sl_nc_put_vars (NCid_Type *nc, NCid_Var_Type *ncvar)
    SLang_Array_Type *at, *at_start, *at_count, *at_stride;
    size_t *start, *count;
    ptrdiff_t *stride;
-   int ncid, varid, status;
-   nc_type xtype;
 
    if (-1 == check_ncid_type (nc))
      return;
@@ -1238,105 +2035,8 @@ static void sl_nc_put_vars (NCid_Type *nc, NCid_Var_Type *ncvar)
 	goto free_and_return;
      }
 
-   ncid = nc->ncid;
-   varid = ncvar->var_id;
-
-   if (at->data_type == SLANG_STRUCT_TYPE)
-     {
-	int xclass;
-
-	if ((-1 == get_var_type (ncid, varid, &xtype))
-	    || (-1 == get_nc_xclass (ncid, xtype, &xclass)))
-	  goto free_and_return;
-
-	if (xclass != NC_COMPOUND)
-	  {
-	     SLang_verror (SL_InvalidParm_Error, "Variable is not compound type");
-	     goto free_and_return;
-	  }
-
-	(void) put_compound (ncid, varid, xtype, start, count, stride, at, NULL);
-	goto free_and_return;
-     }
-
-
-   if (-1 == map_base_sltype_to_xtype (at->data_type, &xtype))
-     goto free_and_return;
-
-   switch (xtype)
-     {
-      case NC_BYTE:
-	if (stride != NULL)
-	  status = nc_put_vars_schar (ncid, varid, start, count, stride, (signed char *)at->data);
-	else
-	  status = nc_put_vara_schar (ncid, varid, start, count, (signed char *)at->data);
-	break;
-      case NC_UBYTE:
-	if (stride != NULL)
-	  status = nc_put_vars_uchar (ncid, varid, start, count, stride, (unsigned char *)at->data);
-	else
-	  status = nc_put_vara_uchar (ncid, varid, start, count, (unsigned char *)at->data);
-	break;
-      case NC_SHORT:
-	if (stride != NULL)
-	  status = nc_put_vars_short (ncid, varid, start, count, stride, (short *)at->data);
-	else
-	  status = nc_put_vara_short (ncid, varid, start, count, (short *)at->data);
-	break;
-      case NC_USHORT:
-	if (stride != NULL)
-	  status = nc_put_vars_ushort (ncid, varid, start, count, stride, (unsigned short *)at->data);
-	else
-	  status = nc_put_vara_ushort (ncid, varid, start, count, (unsigned short *)at->data);
-	break;
-      case NC_INT:
-	if (stride != NULL)
-	  status = nc_put_vars_int (ncid, varid, start, count, stride, (int *)at->data);
-	else
-	  status = nc_put_vara_int (ncid, varid, start, count, (int *)at->data);
-	break;
-      case NC_UINT:
-	if (stride != NULL)
-	  status = nc_put_vars_uint (ncid, varid, start, count, stride, (unsigned int *)at->data);
-	else
-	  status = nc_put_vara_uint (ncid, varid, start, count, (unsigned int *)at->data);
-	break;
-      case NC_INT64:
-	if (stride != NULL)
-	  status = nc_put_vars_longlong (ncid, varid, start, count, stride, (long long *)at->data);
-	else
-	  status = nc_put_vara_longlong (ncid, varid, start, count, (long long *)at->data);
-	break;
-      case NC_UINT64:
-	if (stride != NULL)
-	  status = nc_put_vars_ulonglong (ncid, varid, start, count, stride, (unsigned long long *)at->data);
-	else
-	  status = nc_put_vara_ulonglong (ncid, varid, start, count, (unsigned long long *)at->data);
-	break;
-      case NC_FLOAT:
-	if (stride != NULL)
-	  status = nc_put_vars_float (ncid, varid, start, count, stride, (float *)at->data);
-	else
-	  status = nc_put_vara_float (ncid, varid, start, count, (float *)at->data);
-	break;
-      case NC_DOUBLE:
-	if (stride != NULL)
-	  status = nc_put_vars_double (ncid, varid, start, count, stride, (double *)at->data);
-	else
-	  status = nc_put_vara_double (ncid, varid, start, count, (double *)at->data);
-	break;
-
-      default:
-	SLang_verror (SL_NotImplemented_Error, "_nc_put_vars: %s is not yet supported",
-		      SLclass_get_datatype_name (at->data_type));
-	goto free_and_return;
-     }
-
-   if (status != NC_NOERR)
-     {
-	throw_nc_error ("_nc_put_vars", status);
-	/* drop */
-     }
+   (void) write_vars_from_array (nc->ncid, ncvar, start, count, stride, at);
+   /* drop */
 
 free_and_return:
    SLang_free_array (at);
@@ -1533,7 +2233,7 @@ static int extract_compounds (int ncid, Compound_Info_Type *cinfo, unsigned char
 
 static int get_compound (int ncid, int varid, nc_type xtype,
 			 size_t *start, size_t *count, ptrdiff_t *stride,
-			 SLang_Array_Type *at, const char *attname)
+			 SLang_Struct_Type **sp, size_t num_elements, const char *attname)
 {
    Compound_Info_Type cinfo;
    unsigned char *data;
@@ -1544,7 +2244,7 @@ static int get_compound (int ncid, int varid, nc_type xtype,
 
    return_status = -1;
 
-   if (NULL == (data = (unsigned char *) SLmalloc (at->num_elements*cinfo.size)))
+   if (NULL == (data = (unsigned char *) SLmalloc (num_elements*cinfo.size)))
      goto free_and_return;
 
    if (attname != NULL)
@@ -1560,7 +2260,7 @@ static int get_compound (int ncid, int varid, nc_type xtype,
 	goto free_and_return;
      }
 
-   return_status = extract_compounds (ncid, &cinfo, data, at->num_elements, (SLang_Struct_Type **)at->data);
+   return_status = extract_compounds (ncid, &cinfo, data, num_elements, sp);
 
    /* drop */
 
@@ -1571,61 +2271,221 @@ free_and_return:
    return return_status;
 }
 
-/* Usage: at = _nc_get_vars (start, count, stride, ncid, varid) */
-static void sl_nc_get_vars (NCid_Type *nc, NCid_Var_Type *ncvar)
+/* Map the type of a netCDF variable to the slang type used to represent it.
+ * Compound types map to SLANG_STRUCT_TYPE.
+ */
+static int get_var_sltype (int ncid, NCid_Var_Type *ncvar, nc_type *xtypep, SLtype *sltypep)
 {
-   size_t total;
-   SLindex_Type at_dims[SLARRAY_MAX_DIMS];
-   SLang_Array_Type *at, *at_start, *at_count, *at_stride;
-   size_t *start, *count;
-   ptrdiff_t *stride;
-   SLuindex_Type i, num_dims;
-   int ncid, varid, status, is_scalar;
    nc_type xtype;
-   SLtype sltype;
-
-   if (-1 == check_ncid_type (nc))
-     return;
+   int xclass;
 
-   ncid = nc->ncid;
-   varid = ncvar->var_id;
+   if (-1 == update_var_cache (ncid, ncvar))
+     return -1;
 
-   if (-1 == get_var_type (ncid, varid, &xtype))
-     return;
+   *xtypep = xtype = ncvar->xtype;
 
    if (xtype <= NC_MAX_ATOMIC_TYPE)
+     return map_base_xtype_to_sltype (xtype, sltypep);
+
+   xclass = ncvar->xclass;
+   switch (xclass)
      {
-	if (-1 == map_base_xtype_to_sltype (xtype, &sltype))
-	  return;
+      case NC_COMPOUND:
+	*sltypep = SLANG_STRUCT_TYPE;
+	return 0;
+
+      case NC_ENUM:
+	SLang_verror (SL_NotImplemented_Error, "ENUM types are not yet implemented");
+	break;
+      case NC_OPAQUE:
+	SLang_verror (SL_NotImplemented_Error, "OPAQUE types are not yet implemented");
+	break;
+      case NC_VLEN:
+	SLang_verror (SL_NotImplemented_Error, "VLEN types are not yet implemented");
+	break;
+      default:
+	SLang_verror (SL_NotImplemented_Error, "Unknown class %d", xclass);
+	break;
      }
-   else
-     {
-	int xclass;
+   return -1;
+}
 
-	if (-1 == get_nc_xclass (ncid, xtype, &xclass))
-	  return;
+/* Read the specified hyperslab of an atomic type into the buffer, which is
+ * assumed to be large enough.  If imap is non-NULL, then it specifies the
+ * memory layout as for the nc_get_varm functions.
+ */
+static int read_atomic_slab (int ncid, int varid,
+			     size_t *start, size_t *count, ptrdiff_t *stride, ptrdiff_t *imap,
+			     SLtype sltype, VOID_STAR data)
+{
+   int status;
 
-	switch (xclass)
-	  {
-	   case NC_COMPOUND:
-	     sltype = SLANG_STRUCT_TYPE;
-	     break;
+   switch (sltype)
+     {
+      case SLANG_CHAR_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_schar (ncid, varid, start, count, stride, (signed char *)data);
+	else
+	  status = nc_get_varm_schar (ncid, varid, start, count, stride, imap, (signed char *)data);
+	break;
+      case SLANG_UCHAR_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_uchar (ncid, varid, start, count, stride, (unsigned char *)data);
+	else
+	  status = nc_get_varm_uchar (ncid, varid, start, count, stride, imap, (unsigned char *)data);
+	break;
+      case SLANG_SHORT_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_short (ncid, varid, start, count, stride, (short *)data);
+	else
+	  status = nc_get_varm_short (ncid, varid, start, count, stride, imap, (short *)data);
+	break;
+      case SLANG_USHORT_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_ushort (ncid, varid, start, count, stride, (unsigned short *)data);
+	else
+	  status = nc_get_varm_ushort (ncid, varid, start, count, stride, imap, (unsigned short *)data);
+	break;
+      case SLANG_INT_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_int (ncid, varid, start, count, stride, (int *)data);
+	else
+	  status = nc_get_varm_int (ncid, varid, start, count, stride, imap, (int *)data);
+	break;
+      case SLANG_UINT_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_uint (ncid, varid, start, count, stride, (unsigned int *)data);
+	else
+	  status = nc_get_varm_uint (ncid, varid, start, count, stride, imap, (unsigned int *)data);
+	break;
+#if (SIZEOF_LONG == 4)
+      case SLANG_LONG_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_int (ncid, varid, start, count, stride, (long *)data);
+	else
+	  status = nc_get_varm_int (ncid, varid, start, count, stride, imap, (long *)data);
+	break;
+      case SLANG_ULONG_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_uint (ncid, varid, start, count, stride, (unsigned long *)data);
+	else
+	  status = nc_get_varm_uint (ncid, varid, start, count, stride, imap, (unsigned long *)data);
+	break;
+#else
+      case SLANG_LONG_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_longlong (ncid, varid, start, count, stride, (long long *)data);
+	else
+	  status = nc_get_varm_longlong (ncid, varid, start, count, stride, imap, (long long *)data);
+	break;
+      case SLANG_ULONG_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_ulonglong (ncid, varid, start, count, stride, (unsigned long long *)data);
+	else
+	  status = nc_get_varm_ulonglong (ncid, varid, start, count, stride, imap, (unsigned long long *)data);
+	break;
+#endif
+      case SLANG_LLONG_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_longlong (ncid, varid, start, count, stride, (long long *)data);
+	else
+	  status = nc_get_varm_longlong (ncid, varid, start, count, stride, imap, (long long *)data);
+	break;
+      case SLANG_ULLONG_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_ulonglong (ncid, varid, start, count, stride, (unsigned long long *)data);
+	else
+	  status = nc_get_varm_ulonglong (ncid, varid, start, count, stride, imap, (unsigned long long *)data);
+	break;
+      case SLANG_FLOAT_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_float (ncid, varid, start, count, stride, (float *)data);
+	else
+	  status = nc_get_varm_float (ncid, varid, start, count, stride, imap, (float *)data);
+	break;
+      case SLANG_DOUBLE_TYPE:
+	if (imap == NULL)
+	  status = nc_get_vars_double (ncid, varid, start, count, stride, (double *)data);
+	else
+	  status = nc_get_varm_double (ncid, varid, start, count, stride, imap, (double *)data);
+	break;
 
-	   case NC_ENUM:
-	     SLang_verror (SL_NotImplemented_Error, "ENUM types are not yet implemented");
-	     return;
-	   case NC_OPAQUE:
-	     SLang_verror (SL_NotImplemented_Error, "OPAQUE types are not yet implemented");
-	     return;
-	   case NC_VLEN:
-	     SLang_verror (SL_NotImplemented_Error, "VLEN types are not yet implemented");
-	     return;
-	   default:
-	     SLang_verror (SL_NotImplemented_Error, "Unknown class %d", xclass);
-	     return;
-	  }
+      default:
+	SLang_verror (SL_NotImplemented_Error, "_nc_get_vars: %s is not yet supported",
+		      SLclass_get_datatype_name (sltype));
+	return -1;
      }
 
+   if (status != NC_NOERR)
+     {
+	throw_nc_error ("_nc_get_vars", status);
+	return -1;
+     }
+   return 0;
+}
+
+#define MAX_SLICE_DIMS NC_MAX_VAR_DIMS
+
+static int read_strided_slab (int ncid, NCid_Var_Type *ncvar,
+			      size_t *start, size_t *count, ptrdiff_t *stride,
+			      SLtype sltype, size_t sizeof_type, VOID_STAR data);
+static int mirror_strides (unsigned int num_dims, size_t *start, size_t *count, ptrdiff_t *stride,
+			   size_t *fstart, ptrdiff_t *fstride);
+static void reverse_axes (unsigned char *data, size_t *count, ptrdiff_t *stride,
+			  unsigned int num_dims, size_t sizeof_type);
+
+/* Read the specified hyperslab into at->data.  The array must have the
+ * slang type that corresponds to xtype and contain the correct number of elements.
+ */
+static int read_vars_into_array (int ncid, NCid_Var_Type *ncvar, nc_type xtype,
+				 size_t *start, size_t *count, ptrdiff_t *stride,
+				 SLang_Array_Type *at)
+{
+   if (at->data_type == SLANG_STRUCT_TYPE)
+     {
+	size_t fstart[MAX_SLICE_DIMS];
+	ptrdiff_t fstride[MAX_SLICE_DIMS];
+
+	if ((stride == NULL)
+	    || (0 == mirror_strides (ncvar->num_dims, start, count, stride, fstart, fstride)))
+	  return get_compound (ncid, ncvar->var_id, xtype, start, count, stride,
+			       (SLang_Struct_Type **)at->data, at->num_elements, NULL);
+
+	if (-1 == get_compound (ncid, ncvar->var_id, xtype, fstart, count, fstride,
+				(SLang_Struct_Type **)at->data, at->num_elements, NULL))
+	  return -1;
+	reverse_axes ((unsigned char *) at->data, count, stride, ncvar->num_dims, at->sizeof_type);
+	return 0;
+     }
+
+   if (stride != NULL)
+     return read_strided_slab (ncid, ncvar, start, count, stride,
+			       at->data_type, at->sizeof_type, at->data);
+
+   return read_atomic_slab (ncid, ncvar->var_id, start, count, stride, NULL, at->data_type, at->data);
+}
+
+/* Usage: at = _nc_get_vars (start, count, stride, ncid, varid) */
+static void sl_nc_get_vars (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   size_t total;
+   SLindex_Type at_dims[SLARRAY_MAX_DIMS];
+   SLang_Array_Type *at, *at_start, *at_count, *at_stride;
+   size_t *start, *count;
+   ptrdiff_t *stride;
+   SLuindex_Type i, num_dims;
+   int ncid, is_scalar;
+   nc_type xtype;
+   SLtype sltype;
+
+   if (-1 == check_ncid_type (nc))
+     return;
+
+   ncid = nc->ncid;
+
+   if (-1 == get_var_sltype (ncid, ncvar, &xtype, &sltype))
+     return;
+
    if (ncvar->num_dims == 0)
      {
 	if (SLang_Num_Function_Args != 2)
@@ -1666,71 +2526,8 @@ static void sl_nc_get_vars (NCid_Type *nc, NCid_Var_Type *ncvar)
    if (NULL == (at = SLang_create_array (sltype, 0, NULL, at_dims, num_dims)))
      goto free_and_return;
 
-   switch (sltype)
-     {
-      case SLANG_CHAR_TYPE:
-	status = nc_get_vars_schar (ncid, varid, start, count, stride, (signed char *)at->data);
-	break;
-      case SLANG_UCHAR_TYPE:
-	status = nc_get_vars_uchar (ncid, varid, start, count, stride, (unsigned char *)at->data);
-	break;
-      case SLANG_SHORT_TYPE:
-	status = nc_get_vars_short (ncid, varid, start, count, stride, (short *)at->data);
-	break;
-      case SLANG_USHORT_TYPE:
-	status = nc_get_vars_ushort (ncid, varid, start, count, stride, (unsigned short *)at->data);
-	break;
-      case SLANG_INT_TYPE:
-	status = nc_get_vars_int (ncid, varid, start, count, stride, (int *)at->data);
-	break;
-      case SLANG_UINT_TYPE:
-	status = nc_get_vars_uint (ncid, varid, start, count, stride, (unsigned int *)at->data);
-	break;
-#if (SIZEOF_LONG == 4)
-      case SLANG_LONG_TYPE:
-	status = nc_get_vars_int (ncid, varid, start, count, stride, (long *)at->data);
-	break;
-      case SLANG_ULONG_TYPE:
-	status = nc_get_vars_uint (ncid, varid, start, count, stride, (unsigned long *)at->data);
-	break;
-#else
-      case SLANG_LONG_TYPE:
-	status = nc_get_vars_longlong (ncid, varid, start, count, stride, (long long *)at->data);
-	break;
-      case SLANG_ULONG_TYPE:
-	status = nc_get_vars_ulonglong (ncid, varid, start, count, stride, (unsigned long long *)at->data);
-	break;
-#endif
-      case SLANG_LLONG_TYPE:
-	status = nc_get_vars_longlong (ncid, varid, start, count, stride, (long long *)at->data);
-	break;
-      case SLANG_ULLONG_TYPE:
-	status = nc_get_vars_ulonglong (ncid, varid, start, count, stride, (unsigned long long *)at->data);
-	break;
-      case SLANG_FLOAT_TYPE:
-	status = nc_get_vars_float (ncid, varid, start, count, stride, (float *)at->data);
-	break;
-      case SLANG_DOUBLE_TYPE:
-	status = nc_get_vars_double (ncid, varid, start, count, stride, (double *)at->data);
-	break;
-
-      case SLANG_STRUCT_TYPE:
-	if (-1 == get_compound (ncid, varid, xtype, start, count, stride, at, NULL))
-	  goto free_and_return;
-	status = NC_NOERR;
-	break;
-
-      default:
-	SLang_verror (SL_NotImplemented_Error, "_nc_get_vars: %s is not yet supported",
-		      SLclass_get_datatype_name (at->data_type));
-	goto free_and_return;
-     }
-
-   if (status != NC_NOERR)
-     {
-	throw_nc_error ("_nc_get_vars", status);
-	/* drop */
-     }
+   if (-1 == read_vars_into_array (ncid, ncvar, xtype, start, count, stride, at))
+     goto free_and_return;
 
    if (is_scalar)
      (void) SLang_push_value (at->data_type, at->data);
@@ -1744,364 +2541,6434 @@ free_and_return:
    SLang_free_array (at_start);
 }
 
-static int embed_compound (int ncid, Compound_Info_Type *cinfo, SLang_Struct_Type **sp, size_t num_elements, unsigned char *data);
+/* Returns 0 if the array at is compatible with the hyperslab given by count.
+ * Dimensions of length 1 are ignored so that, e.g., a [3,4] array may be used
+ * for a [1,3,4] hyperslab.
+ */
+static int check_array_shape (SLang_Array_Type *at, size_t *count, unsigned int num_dims)
+{
+   unsigned int i, j;
 
-/* Pop the item of type field_xtypes from the stack and embed it in the data buffer */
-static int pop_compound_element (int ncid, unsigned char *data, int idx, nc_type field_xtype,
-				 const char *field_name, size_t field_num_elems)
+   i = j = 0;
+   while (1)
+     {
+	while ((i < at->num_dims) && (at->dims[i] == 1)) i++;
+	while ((j < num_dims) && (count[j] == 1)) j++;
+	if ((i == at->num_dims) || (j == num_dims))
+	  break;
+	if ((size_t) at->dims[i] != count[j])
+	  return -1;
+	i++; j++;
+     }
+   if ((i == at->num_dims) && (j == num_dims))
+     return 0;
+   return -1;
+}
+
+/* The _nc_get and _nc_put functions accept NULL for any of the start,
+ * count, and stride parameters and fill in the defaults here, which
+ * avoids constructing these arrays in the interpreter for each call.
+ */
+typedef struct
 {
-   SLang_Array_Type *at;
-   SLtype sltype;
-   int status;
+   unsigned int num_dims;
+   int count_given;		       /* non-zero if count was not NULL */
+   int has_stride;		       /* non-zero if a stride is not 1 */
+   size_t total;
+   size_t start[MAX_SLICE_DIMS];
+   size_t count[MAX_SLICE_DIMS];
+   ptrdiff_t stride[MAX_SLICE_DIMS];
+}
+Slice_Type;
+
+/* Pop the (start, count, stride) parameters, any of which may be NULL.
+ * Negative start values are taken relative to the end of the dimension.
+ * If count is NULL, then for reads the hyperslab extends to the end of
+ * each dimension, or to its beginning for a negative stride.  For writes,
+ * the shape of at_data is used with its dimensions corresponding to the
+ * fastest varying ones of the variable.
+ */
+static int pop_slice (NCid_Type *nc, NCid_Var_Type *ncvar, int is_read,
+		      SLang_Array_Type *at_data, Slice_Type *s)
+{
+   SLang_Array_Type *at_start, *at_count, *at_stride;
+   unsigned int i, num_dims;
+   int status = -1;
 
-   (void) idx;
+   at_start = at_count = at_stride = NULL;
+   if ((-1 == pop_array_of_type_or_null (&at_stride, _SL_PTRDIFF_T_TYPE))
+       || (-1 == pop_array_of_type_or_null (&at_count, _SL_SIZE_T_TYPE))
+       || (-1 == pop_array_of_type_or_null (&at_start, _SL_PTRDIFF_T_TYPE))
+       || (-1 == update_var_cache (nc->ncid, ncvar)))
+     goto free_and_return;
 
-   if (field_xtype > NC_MAX_ATOMIC_TYPE)
+   num_dims = ncvar->num_dims;
+   if (num_dims > MAX_SLICE_DIMS)
      {
-	int xclass;
-	if (-1 == get_nc_xclass (ncid, field_xtype, &xclass))
-	  return -1;
-	if (xclass != NC_COMPOUND)
-	  {
-	     SLang_verror (SL_NotImplemented_Error, "Compound of vlen or opaque types not implemented");
-	     return -1;
-	  }
-	sltype = SLANG_STRUCT_TYPE;
+	SLang_verror (SL_LimitExceeded_Error, "The netcdf variable has too many dimensions");
+	goto free_and_return;
+     }
+   if (((at_start != NULL) && (at_start->num_elements != num_dims))
+       || ((at_count != NULL) && (at_count->num_elements != num_dims))
+       || ((at_stride != NULL) && (at_stride->num_elements != num_dims)))
+     {
+	SLang_verror (SL_InvalidParm_Error, "The number of elements in the start, slice, and stride parameters are inconsistent with the size of the netcdf variable");
+	goto free_and_return;
      }
-   else if (-1 == map_base_xtype_to_sltype (field_xtype, &sltype))
-     return -1;
 
-   if (field_num_elems == 1)
-     at = NULL;
-   else
+   s->num_dims = num_dims;
+   s->has_stride = 0;
+   for (i = 0; i < num_dims; i++)
      {
-	if (-1 == SLang_pop_array_of_type (&at, sltype))
-	  return -1;
-	if (field_num_elems != at->num_elements)
+	ptrdiff_t start_i = 0;
+
+	if (at_start != NULL)
 	  {
-	     SLang_verror (SL_InvalidParm_Error, "Compound field %s requires %lu elements, %lu provided",
-			   field_name, (unsigned long) field_num_elems, (unsigned long) at->num_elements);
-	     SLang_free_array (at);
-	     return -1;
+	     start_i = ((ptrdiff_t *)at_start->data)[i];
+	     if (start_i < 0)
+	       {
+		  start_i += (ptrdiff_t) ncvar->shape[i];
+		  if (start_i < 0)
+		    {
+		       SLang_verror (SL_Index_Error, "Invalid negative index");
+		       goto free_and_return;
+		    }
+	       }
+	  }
+	s->start[i] = (size_t) start_i;
+
+	s->stride[i] = 1;
+	if (at_stride != NULL)
+	  {
+	     s->stride[i] = ((ptrdiff_t *)at_stride->data)[i];
+	     if (s->stride[i] != 1) s->has_stride = 1;
 	  }
      }
 
-   status = 0;
-   switch (sltype)
+   s->count_given = (at_count != NULL);
+   if (at_count != NULL)
+     memcpy (s->count, at_count->data, num_dims*sizeof(size_t));
+   else if (at_data == NULL)
      {
-      case SLANG_STRUCT_TYPE:
+	for (i = 0; i < num_dims; i++)
 	  {
-	     Compound_Info_Type cinfo;
-
-	     if (-1 == init_compound_info (ncid, field_xtype, &cinfo, 1))
-	       {
-		  SLang_free_array (at);   /* NULL ok */
-		  return -1;
-	       }
-	     if (at == NULL)
-	       {
-		  SLang_Struct_Type *s;
-		  if (-1 == SLang_pop_struct (&s))
-		    return -1;
-		  status = embed_compound (ncid, &cinfo, &s, 1, data);
-		  SLang_free_struct (s);
-	       }
+	     if (s->start[i] >= ncvar->shape[i])
+	       s->count[i] = 0;
+	     else if (s->stride[i] < 0)
+	       s->count[i] = s->start[i] / (size_t)(-s->stride[i]) + 1;
 	     else
-	       status = embed_compound (ncid, &cinfo, (SLang_Struct_Type **) at->data, at->num_elements, data);
-	     free_compound_info (&cinfo);
+	       s->count[i] = ncvar->shape[i] - s->start[i];
 	  }
-	break;
+     }
+   else
+     {
+	unsigned int data_ndims = at_data->num_dims, ofs;
 
-      case SLANG_STRING_TYPE:
-	if (at == NULL)
+	if (data_ndims > num_dims)
 	  {
-	     char *str;
-	     if (-1 == SLang_pop_slstring (&str))
-	       return -1;
-	     *(char **) data = str;
+	     SLang_verror (SL_InvalidParm_Error, "The data array has more dimensions than the netcdf variable");
+	     goto free_and_return;
+	  }
+	ofs = num_dims - data_ndims;
+	for (i = 0; i < ofs; i++)
+	  s->count[i] = 1;
+	for (i = 0; i < data_ndims; i++)
+	  s->count[ofs+i] = at_data->dims[i];
+     }
+
+   status = check_slice (ncvar, is_read, s->start, s->count, s->stride, &s->total);
+   /* drop */
+free_and_return:
+   SLang_free_array (at_start);	       /* NULL ok */
+   SLang_free_array (at_count);	       /* NULL ok */
+   SLang_free_array (at_stride);       /* NULL ok */
+   return status;
+}
+
+/* Usage: x = _nc_get ([start, count, stride,] ncid, varid)
+ * Any of start, count, stride may be NULL.  If count is NULL and a single
+ * value is read, a 1-d array of length 1 is returned.
+ */
+static void sl_nc_get (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   Slice_Type slice;
+   SLindex_Type at_dims[SLARRAY_MAX_DIMS];
+   SLang_Array_Type *at;
+   unsigned int i, num_dims;
+   nc_type xtype;
+   SLtype sltype;
+
+   if ((-1 == check_ncid_type (nc))
+       || (-1 == get_var_sltype (nc->ncid, ncvar, &xtype, &sltype)))
+     return;
+
+   if (SLang_Num_Function_Args == 2)
+     {
+	if (ncvar->num_dims != 0)
+	  {
+	     SLang_verror (SL_Usage_Error, "_nc_get: slice arguments are required for a non-scalar variable");
+	     return;
+	  }
+     }
+   else if (-1 == pop_slice (nc, ncvar, 1, NULL, &slice))
+     return;
+
+   if (ncvar->num_dims == 0)
+     {
+	at_dims[0] = 1;
+	if (NULL == (at = SLang_create_array (sltype, 0, NULL, at_dims, 1)))
+	  return;
+	if (0 == read_vars_into_array (nc->ncid, ncvar, xtype, NULL, NULL, NULL, at))
+	  (void) SLang_push_value (at->data_type, at->data);
+	SLang_free_array (at);
+	return;
+     }
+
+   num_dims = slice.num_dims;
+   if ((slice.count_given == 0) && (slice.total == 1))
+     {
+	at_dims[0] = 1;
+	num_dims = 1;
+     }
+   else
+     {
+	if (num_dims > SLARRAY_MAX_DIMS)
+	  {
+	     SLang_verror (SL_LimitExceeded_Error, "slang arrays are currently limited to %d dimensions.  The netcdf variable has %d dimensions",
+			   SLARRAY_MAX_DIMS, num_dims);
+	     return;
+	  }
+	for (i = 0; i < num_dims; i++)
+	  at_dims[i] = slice.count[i];
+     }
+
+   if (NULL == (at = SLang_create_array (sltype, 0, NULL, at_dims, num_dims)))
+     return;
+
+   if (0 == read_vars_into_array (nc->ncid, ncvar, xtype,
+				  slice.start, slice.count, slice.stride, at))
+     (void) SLang_push_array (at, 0);
+   SLang_free_array (at);
+}
+
+/* Usage: _nc_get_vars_into ([start, count, stride,] dest, ncid, varid)
+ * Here, dest is an existing array whose data will be overwritten.  Any of
+ * start, count, stride may be NULL, as for _nc_get.  If count is NULL,
+ * the dimensions of dest correspond to the fastest varying ones of the
+ * variable.
+ */
+static void sl_nc_get_vars_into (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   Slice_Type slice;
+   SLang_Array_Type *at;
+   size_t *start, *count;
+   ptrdiff_t *stride;
+   nc_type xtype;
+   SLtype sltype;
+
+   if (-1 == check_ncid_type (nc))
+     return;
+
+   if (-1 == SLang_pop_array (&at, 0))
+     return;
+
+   if (-1 == get_var_sltype (nc->ncid, ncvar, &xtype, &sltype))
+     goto free_and_return;
+
+   if (SLang_Num_Function_Args == 3)
+     {
+	if (ncvar->num_dims != 0)
+	  {
+	     SLang_verror (SL_Usage_Error, "_nc_get_vars_into: slice arguments are required for a non-scalar variable");
+	     goto free_and_return;
+	  }
+     }
+   else if (-1 == pop_slice (nc, ncvar, 1, at, &slice))
+     goto free_and_return;
+
+   start = count = NULL;
+   stride = NULL;
+   if (ncvar->num_dims == 0)
+     slice.total = 1;
+   else
+     {
+	start = slice.start;
+	count = slice.count;
+	stride = slice.stride;
+     }
+
+   if (at->data_type != sltype)
+     {
+	SLang_verror (SL_TypeMismatch_Error, "_nc_get_vars_into: expected an array of %s, found %s",
+		      SLclass_get_datatype_name (sltype), SLclass_get_datatype_name (at->data_type));
+	goto free_and_return;
+     }
+
+   if (at->flags & (SLARR_DATA_VALUE_IS_READ_ONLY|SLARR_DATA_VALUE_IS_RANGE))
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_get_vars_into: the destination array is not writable");
+	goto free_and_return;
+     }
+
+   if ((slice.total != at->num_elements)
+       || ((count != NULL) && (-1 == check_array_shape (at, count, ncvar->num_dims))))
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_get_vars_into: the shape of the destination array is inconsistent with the slice parameters");
+	goto free_and_return;
+     }
+
+   if (sltype == SLANG_STRUCT_TYPE)
+     {
+	/* The compound reader assumes that the elements are NULL */
+	SLang_Struct_Type **sp = (SLang_Struct_Type **) at->data;
+	SLuindex_Type i;
+
+	for (i = 0; i < at->num_elements; i++)
+	  {
+	     if (sp[i] == NULL) continue;
+	     SLang_free_struct (sp[i]);
+	     sp[i] = NULL;
+	  }
+     }
+
+   (void) read_vars_into_array (nc->ncid, ncvar, xtype, start, count, stride, at);
+   /* drop */
+
+free_and_return:
+   SLang_free_array (at);
+}
+
+/* Usage: _nc_put ([start, count, stride,] data, ncid, varid)
+ * Any of start, count, stride may be NULL.
+ */
+static int queue_async_write (NCid_Type *nc, NCid_Var_Type *ncvar,
+			      size_t *start, size_t *count, ptrdiff_t *stride,
+			      SLang_Array_Type *at);
+static int flush_var_appends (NCid_Type *nc, NCid_Var_Type *ncvar);
+
+static void sl_nc_put (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   Slice_Type slice;
+   SLang_Array_Type *at;
+
+   /* With asynchronous writes, the queue is not waited for.  The lengths
+    * of dimensions extended by queued writes are kept by note_var_write.
+    * The records appended to the variable precede the write.
+    */
+   if ((-1 == check_ncid_is_open (nc))
+       || (-1 == flush_var_appends (nc, ncvar)))
+     return;
+
+   if (-1 == SLang_pop_array (&at, 1))
+     return;
+
+   if (SLang_Num_Function_Args == 3)
+     {
+	if (ncvar->num_dims != 0)
+	  {
+	     SLang_verror (SL_Usage_Error, "_nc_put: slice arguments are required for a non-scalar variable");
+	     goto free_and_return;
+	  }
+     }
+   else if (-1 == pop_slice (nc, ncvar, 0, at, &slice))
+     goto free_and_return;
+
+   if (ncvar->num_dims == 0)
+     {
+	if (at->num_elements != 1)
+	  {
+	     SLang_verror (SL_InvalidParm_Error, "_nc_put: a scalar variable requires a single value");
+	     goto free_and_return;
+	  }
+	if (0 == sync_file_writes (nc))
+	  (void) write_vars_from_array (nc->ncid, ncvar, NULL, NULL, NULL, at);
+	goto free_and_return;
+     }
+
+   if (slice.total != at->num_elements)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_put: the slice parameters are inconsistent with the provided array: %lu values provided, %lu expected",
+		      (unsigned long) at->num_elements, (unsigned long) slice.total);
+	goto free_and_return;
+     }
+
+   /* Arrays that cannot be queued are written after the queue */
+   if ((0 == queue_async_write (nc, ncvar, slice.start, slice.count,
+				(slice.has_stride ? slice.stride : NULL), at))
+       && (0 == sync_file_writes (nc)))
+     (void) write_vars_from_array (nc->ncid, ncvar, slice.start, slice.count,
+				   (slice.has_stride ? slice.stride : NULL), at);
+   /* drop */
+free_and_return:
+   SLang_free_array (at);
+}
+
+/*{{{ Packed data */
+
+/* The CF packing attributes of a variable.  The unpacked value of a packed
+ * value x is x*scale + offset, and its type is that of the attributes.
+ */
+typedef struct
+{
+   int is_packed;		       /* non-zero if either attribute exists */
+   double scale;
+   double offset;
+   nc_type att_xtype;
+}
+Packing_Type;
+
+/* Get the value that marks a missing element of the variable, which is
+ * the value of the _FillValue attribute, or else the default fill value
+ * reported by nc_inq_var_fill.  As recommended by the CF conventions, the
+ * default is not used for the byte types.
+ */
+static void get_var_fill_double (int ncid, NCid_Var_Type *ncvar, int *have_fillp, double *fillp)
+{
+   union
+     {
+	signed char c; unsigned char uc; short s; unsigned short us;
+	int i; unsigned int ui; long long ll; unsigned long long ull;
+	float f; double d;
+     }
+   u;
+   int status, no_fill;
+
+   *have_fillp = 0;
+   status = nc_get_att_double (ncid, ncvar->var_id, "_FillValue", fillp);
+   if (status == NC_NOERR)
+     {
+	*have_fillp = 1;
+	return;
+     }
+   if ((status != NC_ENOTATT)
+       || (ncvar->xtype == NC_BYTE) || (ncvar->xtype == NC_UBYTE)
+       || (ncvar->xtype > NC_UINT64) || (ncvar->xtype == NC_CHAR))
+     return;
+
+   if (NC_NOERR != nc_inq_var_fill (ncid, ncvar->var_id, &no_fill, &u))
+     return;
+
+   *have_fillp = 1;
+   switch (ncvar->xtype)
+     {
+      case NC_SHORT: *fillp = u.s; break;
+      case NC_USHORT: *fillp = u.us; break;
+      case NC_INT: *fillp = u.i; break;
+      case NC_UINT: *fillp = u.ui; break;
+      case NC_INT64: *fillp = (double) u.ll; break;
+      case NC_UINT64: *fillp = (double) u.ull; break;
+      case NC_FLOAT: *fillp = u.f; break;
+      case NC_DOUBLE: *fillp = u.d; break;
+      default:
+	*have_fillp = 0;
+	break;
+     }
+}
+
+/* The default fill value of the library for an atomic type */
+static double get_default_fill_double (nc_type xtype)
+{
+   switch (xtype)
+     {
+      case NC_BYTE: return NC_FILL_BYTE;
+      case NC_UBYTE: return NC_FILL_UBYTE;
+      case NC_SHORT: return NC_FILL_SHORT;
+      case NC_USHORT: return NC_FILL_USHORT;
+      case NC_INT: return NC_FILL_INT;
+      case NC_UINT: return NC_FILL_UINT;
+      case NC_INT64: return (double) NC_FILL_INT64;
+      case NC_UINT64: return (double) NC_FILL_UINT64;
+      case NC_FLOAT: return NC_FILL_FLOAT;
+      default: return NC_FILL_DOUBLE;
+     }
+}
+
+/* Read at most max_len values of a numeric attribute as doubles.  Return
+ * the number of values, or 0 if the attribute does not exist, or -1 if
+ * it could not be read or has more than max_len values.
+ */
+static int get_double_att (int ncid, int varid, const char *name,
+			   double *vals, size_t max_len, nc_type *xtypep)
+{
+   size_t len;
+   int status;
+
+   status = nc_inq_att (ncid, varid, name, xtypep, &len);
+   if (status == NC_ENOTATT)
+     return 0;
+   if (status == NC_NOERR)
+     status = ((len != 0) && (len <= max_len)) ? nc_get_att_double (ncid, varid, name, vals) : NC_EINVAL;
+   if (status != NC_NOERR)
+     {
+	throw_nc_error (name, status);
+	return -1;
+     }
+   return (int) len;
+}
+
+static int get_var_packing (int ncid, int varid, Packing_Type *p)
+{
+   int has_scale, has_offset;
+   nc_type xtype = NC_DOUBLE;
+
+   p->scale = 1.0;
+   p->offset = 0.0;
+   p->att_xtype = NC_DOUBLE;
+   if ((-1 == (has_scale = get_double_att (ncid, varid, "scale_factor", &p->scale, 1, &p->att_xtype)))
+       || (-1 == (has_offset = get_double_att (ncid, varid, "add_offset", &p->offset, 1, &xtype))))
+     return -1;
+
+   if (has_scale == 0)
+     p->att_xtype = xtype;
+   p->is_packed = has_scale || has_offset;
+   return 0;
+}
+
+/* The values that mark a missing element of a variable: the fill value,
+ * the values of the missing_value attribute, and those outside the range
+ * given by the valid_range, or valid_min and valid_max attributes.  Unused
+ * slots of the values array are NaN, which compares unequal to everything.
+ */
+#define MAX_MASK_VALUES 4
+typedef struct
+{
+   double values[MAX_MASK_VALUES];
+   double min, max;
+}
+Mask_Type;
+
+static int get_var_mask (int ncid, NCid_Var_Type *ncvar, Mask_Type *m)
+{
+   double range[2];
+   unsigned int i, n;
+   int status, have_fill;
+   nc_type xtype;
+
+   for (i = 0; i < MAX_MASK_VALUES; i++)
+     m->values[i] = NAN;
+   m->min = -HUGE_VAL;
+   m->max = HUGE_VAL;
+
+   n = 0;
+   get_var_fill_double (ncid, ncvar, &have_fill, m->values);
+   if (have_fill)
+     n++;
+   else
+     m->values[0] = NAN;
+
+   status = get_double_att (ncid, ncvar->var_id, "missing_value", m->values + n,
+			    MAX_MASK_VALUES - n, &xtype);
+   if (status == -1)
+     return -1;
+
+   status = get_double_att (ncid, ncvar->var_id, "valid_range", range, 2, &xtype);
+   if (status == -1)
+     return -1;
+   if (status == 2)
+     {
+	m->min = range[0];
+	m->max = range[1];
+	return 0;
+     }
+   if ((-1 == get_double_att (ncid, ncvar->var_id, "valid_min", &m->min, 1, &xtype))
+       || (-1 == get_double_att (ncid, ncvar->var_id, "valid_max", &m->max, 1, &xtype)))
+     return -1;
+   return 0;
+}
+
+/* Values read as Float_Type are converted by the library before they are
+ * masked.  Round the mask values to float in the same way so that, e.g.,
+ * the default fill value of a double variable still matches.  Values
+ * beyond the range of a float become infinite.
+ */
+static double round_to_float (double x)
+{
+   if (x > FLT_MAX)
+     return HUGE_VAL;
+   if (x < -FLT_MAX)
+     return -HUGE_VAL;
+   if (x != x)
+     return x;
+   return (double) (float) x;
+}
+
+static void round_mask_to_float (Mask_Type *m)
+{
+   unsigned int i;
+
+   for (i = 0; i < MAX_MASK_VALUES; i++)
+     m->values[i] = round_to_float (m->values[i]);
+   m->min = round_to_float (m->min);
+   m->max = round_to_float (m->max);
+}
+
+#define IS_MASKED(d, m0, m1, m2, m3, lo, hi) \
+   (((d) == (m0)) | ((d) == (m1)) | ((d) == (m2)) | ((d) == (m3)) | ((d) < (lo)) | ((d) > (hi)))
+
+typedef void (*Unpack_Fun_Type) (VOID_STAR, VOID_STAR, size_t, double, double, Mask_Type *);
+
+/* The unpack functions convert num packed values to the unpacked type.
+ * The packed values may occupy the last num*sizeof(rtype) bytes of the
+ * output buffer: since an unpacked value is at least as large as a packed
+ * one, the kth output value never overlaps a packed value that has not
+ * yet been converted.  If m is non-NULL, the values that it marks as
+ * missing are replaced by NaN.  The comparisons are made using the packed
+ * values, and are free of branches so that the loop may be vectorized.
+ */
+#define DEFINE_UNPACK_FUN(name, rtype, otype) \
+   static void name (VOID_STAR rawp, VOID_STAR outp, size_t num, double scale, double offset, Mask_Type *m) \
+   { \
+      rtype *raw = (rtype *) rawp; \
+      otype *out = (otype *) outp; \
+      otype s = (otype) scale, o = (otype) offset; \
+      double m0, m1, m2, m3, lo, hi; \
+      size_t k; \
+      if (m == NULL) \
+	{ \
+	   for (k = 0; k < num; k++) \
+	     out[k] = (otype) raw[k] * s + o; \
+	   return; \
+	} \
+      m0 = m->values[0]; m1 = m->values[1]; m2 = m->values[2]; m3 = m->values[3]; \
+      lo = m->min; hi = m->max; \
+      for (k = 0; k < num; k++) \
+	{ \
+	   double d = (double) raw[k]; \
+	   otype v = (otype) raw[k] * s + o; \
+	   out[k] = IS_MASKED(d, m0, m1, m2, m3, lo, hi) ? (otype) NAN : v; \
+	} \
+   }
+
+#define DEFINE_UNPACK_FUNS(suffix, rtype) \
+   DEFINE_UNPACK_FUN(unpack_##suffix##_to_float, rtype, float) \
+   DEFINE_UNPACK_FUN(unpack_##suffix##_to_double, rtype, double)
+
+DEFINE_UNPACK_FUNS(schar, signed char)
+DEFINE_UNPACK_FUNS(uchar, unsigned char)
+DEFINE_UNPACK_FUNS(short, short)
+DEFINE_UNPACK_FUNS(ushort, unsigned short)
+DEFINE_UNPACK_FUNS(int, int)
+DEFINE_UNPACK_FUNS(uint, unsigned int)
+#if (SIZEOF_LONG == 8)
+DEFINE_UNPACK_FUNS(long, long)
+DEFINE_UNPACK_FUNS(ulong, unsigned long)
+#else
+DEFINE_UNPACK_FUNS(llong, long long)
+DEFINE_UNPACK_FUNS(ullong, unsigned long long)
+#endif
+DEFINE_UNPACK_FUNS(float, float)
+DEFINE_UNPACK_FUNS(double, double)
+
+static Unpack_Fun_Type get_unpack_fun (SLtype raw_type, SLtype out_type)
+{
+   int to_float = (out_type == SLANG_FLOAT_TYPE);
+
+   switch (raw_type)
+     {
+      case SLANG_CHAR_TYPE:
+	return to_float ? unpack_schar_to_float : unpack_schar_to_double;
+      case SLANG_UCHAR_TYPE:
+	return to_float ? unpack_uchar_to_float : unpack_uchar_to_double;
+      case SLANG_SHORT_TYPE:
+	return to_float ? unpack_short_to_float : unpack_short_to_double;
+      case SLANG_USHORT_TYPE:
+	return to_float ? unpack_ushort_to_float : unpack_ushort_to_double;
+      case SLANG_INT_TYPE:
+	return to_float ? unpack_int_to_float : unpack_int_to_double;
+      case SLANG_UINT_TYPE:
+	return to_float ? unpack_uint_to_float : unpack_uint_to_double;
+#if (SIZEOF_LONG == 8)
+      case SLANG_LONG_TYPE:
+	return to_float ? unpack_long_to_float : unpack_long_to_double;
+      case SLANG_ULONG_TYPE:
+	return to_float ? unpack_ulong_to_float : unpack_ulong_to_double;
+#else
+      case SLANG_LLONG_TYPE:
+	return to_float ? unpack_llong_to_float : unpack_llong_to_double;
+      case SLANG_ULLONG_TYPE:
+	return to_float ? unpack_ullong_to_float : unpack_ullong_to_double;
+#endif
+      case SLANG_FLOAT_TYPE:
+	return to_float ? unpack_float_to_float : unpack_float_to_double;
+      case SLANG_DOUBLE_TYPE:
+	return to_float ? unpack_double_to_float : unpack_double_to_double;
+     }
+   SLang_verror (SL_NotImplemented_Error, "Unable to unpack values of type %s", SLclass_get_datatype_name (raw_type));
+   return NULL;
+}
+
+typedef void (*Pack_Fun_Type) (VOID_STAR, VOID_STAR, size_t, double, double, double);
+
+/* The pack functions convert num unpacked values to the packed type.  A
+ * NaN is replaced by the fill value.  The packed integer values are
+ * rounded to the nearest integer and clamped to the range of the type.
+ */
+#define DEFINE_PACK_INT_FUN(name, itype, otype, lo, hi) \
+   static void name (VOID_STAR inp, VOID_STAR outp, size_t num, double scale, double offset, double fill) \
+   { \
+      itype *in = (itype *) inp; \
+      otype *out = (otype *) outp; \
+      otype f = (otype) fill; \
+      size_t k; \
+      for (k = 0; k < num; k++) \
+	{ \
+	   double y = ((double) in[k] - offset) / scale; \
+	   if (y != y) \
+	     { \
+		out[k] = f; \
+		continue; \
+	     } \
+	   y = (y < (lo)) ? (lo) : ((y > (hi)) ? (hi) : y); \
+	   out[k] = (otype) (y + ((y >= 0) ? 0.5 : -0.5)); \
+	} \
+   }
+
+#define DEFINE_PACK_FLOAT_FUN(name, itype, otype) \
+   static void name (VOID_STAR inp, VOID_STAR outp, size_t num, double scale, double offset, double fill) \
+   { \
+      itype *in = (itype *) inp; \
+      otype *out = (otype *) outp; \
+      otype f = (otype) fill; \
+      size_t k; \
+      for (k = 0; k < num; k++) \
+	{ \
+	   double y = ((double) in[k] - offset) / scale; \
+	   out[k] = (y != y) ? f : (otype) y; \
+	} \
+   }
+
+#define DEFINE_PACK_FUNS(suffix, otype, lo, hi) \
+   DEFINE_PACK_INT_FUN(pack_float_to_##suffix, float, otype, lo, hi) \
+   DEFINE_PACK_INT_FUN(pack_double_to_##suffix, double, otype, lo, hi)
+
+DEFINE_PACK_FUNS(schar, signed char, -128.0, 127.0)
+DEFINE_PACK_FUNS(uchar, unsigned char, 0.0, 255.0)
+DEFINE_PACK_FUNS(short, short, -32768.0, 32767.0)
+DEFINE_PACK_FUNS(ushort, unsigned short, 0.0, 65535.0)
+DEFINE_PACK_FUNS(int, int, -2147483648.0, 2147483647.0)
+DEFINE_PACK_FUNS(uint, unsigned int, 0.0, 4294967295.0)
+DEFINE_PACK_FLOAT_FUN(pack_float_to_float, float, float)
+DEFINE_PACK_FLOAT_FUN(pack_double_to_float, double, float)
+DEFINE_PACK_FLOAT_FUN(pack_float_to_double, float, double)
+DEFINE_PACK_FLOAT_FUN(pack_double_to_double, double, double)
+
+static Pack_Fun_Type get_pack_fun (SLtype in_type, SLtype packed_type)
+{
+   int from_float = (in_type == SLANG_FLOAT_TYPE);
+
+   switch (packed_type)
+     {
+      case SLANG_CHAR_TYPE:
+	return from_float ? pack_float_to_schar : pack_double_to_schar;
+      case SLANG_UCHAR_TYPE:
+	return from_float ? pack_float_to_uchar : pack_double_to_uchar;
+      case SLANG_SHORT_TYPE:
+	return from_float ? pack_float_to_short : pack_double_to_short;
+      case SLANG_USHORT_TYPE:
+	return from_float ? pack_float_to_ushort : pack_double_to_ushort;
+      case SLANG_INT_TYPE:
+	return from_float ? pack_float_to_int : pack_double_to_int;
+      case SLANG_UINT_TYPE:
+	return from_float ? pack_float_to_uint : pack_double_to_uint;
+      case SLANG_FLOAT_TYPE:
+	return from_float ? pack_float_to_float : pack_double_to_float;
+      case SLANG_DOUBLE_TYPE:
+	return from_float ? pack_float_to_double : pack_double_to_double;
+     }
+   SLang_verror (SL_NotImplemented_Error, "Unable to pack values into type %s", SLclass_get_datatype_name (packed_type));
+   return NULL;
+}
+
+/* Usage: _nc_put_packed (start, count, stride, data, ncid, varid)
+ * This is like _nc_put except that the values are packed using the
+ * scale_factor and add_offset attributes of the variable.  The packed
+ * values are computed in a single pass into a buffer of the type of the
+ * variable, which is then written.  NaNs are written as the fill value.
+ * If the variable has neither attribute, the data are written as is.
+ */
+static void sl_nc_put_packed (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   SLang_Array_Type *at;
+   Slice_Type slice;
+   Packing_Type p;
+   Pack_Fun_Type pack;
+   unsigned char *buf = NULL;
+   size_t *start, *count;
+   ptrdiff_t *stride;
+   SLtype sltype;
+   nc_type xtype;
+   double fill;
+   int ncid, have_fill;
+
+   if ((-1 == check_ncid_type (nc))
+       || (-1 == get_var_sltype (nc->ncid, ncvar, &xtype, &sltype)))
+     return;
+
+   if ((sltype == SLANG_STRUCT_TYPE) || (sltype == SLANG_STRING_TYPE))
+     {
+	SLang_verror (SL_NotImplemented_Error, "_nc_put_packed: only numeric variables may be packed");
+	return;
+     }
+
+   /* Float and double values are packed as is; anything else is converted
+    * to double first.
+    */
+   if (SLang_peek_at_stack1 () == SLANG_FLOAT_TYPE)
+     {
+	if (-1 == SLang_pop_array_of_type (&at, SLANG_FLOAT_TYPE))
+	  return;
+     }
+   else if (-1 == SLang_pop_array_of_type (&at, SLANG_DOUBLE_TYPE))
+     return;
+
+   ncid = nc->ncid;
+   if ((-1 == pop_slice (nc, ncvar, 0, at, &slice))
+       || (-1 == get_var_packing (ncid, ncvar->var_id, &p)))
+     goto free_and_return;
+
+   start = count = NULL;
+   stride = NULL;
+   if (ncvar->num_dims == 0)
+     {
+	if (at->num_elements != 1)
+	  {
+	     SLang_verror (SL_InvalidParm_Error, "_nc_put_packed: a scalar variable requires a single value");
+	     goto free_and_return;
+	  }
+     }
+   else
+     {
+	if (slice.total != at->num_elements)
+	  {
+	     SLang_verror (SL_InvalidParm_Error, "_nc_put_packed: the slice parameters are inconsistent with the provided array: %lu values provided, %lu expected",
+			   (unsigned long) at->num_elements, (unsigned long) slice.total);
+	     goto free_and_return;
+	  }
+	start = slice.start;
+	count = slice.count;
+	stride = slice.has_stride ? slice.stride : NULL;
+     }
+
+   if (p.is_packed == 0)
+     {
+	(void) write_vars_from_array (ncid, ncvar, start, count, stride, at);
+	goto free_and_return;
+     }
+
+   if (NULL == (pack = get_pack_fun (at->data_type, sltype)))
+     goto free_and_return;
+
+   get_var_fill_double (ncid, ncvar, &have_fill, &fill);
+   if (have_fill == 0)
+     fill = get_default_fill_double (xtype);
+
+   if (NULL == (buf = (unsigned char *) SLmalloc (at->num_elements * ncvar->xsize + 1)))
+     goto free_and_return;
+   (*pack) (at->data, buf, at->num_elements, p.scale, p.offset, fill);
+
+   if (0 == write_atomic_slab (ncid, ncvar->var_id, start, count, stride, NULL, sltype, buf))
+     note_var_write (ncid, ncvar, start, count, stride);
+   /* drop */
+free_and_return:
+   SLfree ((char *) buf);	       /* NULL ok */
+   SLang_free_array (at);
+}
+
+/* Replace the num values that the mask marks as missing by NaN */
+#define DEFINE_MASK_FUN(name, type) \
+   static void name (type *x, size_t num, Mask_Type *m) \
+   { \
+      double m0 = m->values[0], m1 = m->values[1], m2 = m->values[2], m3 = m->values[3]; \
+      double lo = m->min, hi = m->max; \
+      size_t k; \
+      for (k = 0; k < num; k++) \
+	{ \
+	   double d = (double) x[k]; \
+	   x[k] = IS_MASKED(d, m0, m1, m2, m3, lo, hi) ? (type) NAN : x[k]; \
+	} \
+   }
+DEFINE_MASK_FUN(mask_float_values, float)
+DEFINE_MASK_FUN(mask_double_values, double)
+
+/* Return the floating point type that an integer type is promoted to when
+ * its missing values are masked.  Float_Type is used when it can represent
+ * all values of the type exactly.
+ */
+static SLtype get_masked_type (SLtype sltype, size_t sizeof_type)
+{
+   if ((sltype == SLANG_FLOAT_TYPE) || (sltype == SLANG_DOUBLE_TYPE))
+     return sltype;
+   return (sizeof_type <= 2) ? SLANG_FLOAT_TYPE : SLANG_DOUBLE_TYPE;
+}
+
+static int pop_float_type_or_null (const char *fun, SLtype *typep)
+{
+   *typep = SLANG_VOID_TYPE;
+   if (SLang_peek_at_stack () == SLANG_NULL_TYPE)
+     return SLdo_pop ();
+   if (-1 == SLang_pop_datatype (typep))
+     return -1;
+   if ((*typep != SLANG_FLOAT_TYPE) && (*typep != SLANG_DOUBLE_TYPE))
+     {
+	SLang_verror (SL_InvalidParm_Error, "%s: the type must be Float_Type or Double_Type", fun);
+	return -1;
+     }
+   return 0;
+}
+
+/* Usage: x = _nc_get_cf (start, count, stride, type, unpack, mask, ncid, varid)
+ * This is like _nc_get except that the CF conventions for packed and
+ * missing values are applied.  If unpack is non-zero, the values are
+ * unpacked using the scale_factor and add_offset attributes of the
+ * variable.  If mask is non-zero, the values that get_var_mask marks as
+ * missing are replaced by NaN.  The type of the result is given by type,
+ * which must be Float_Type or Double_Type.  If type is NULL, the type of
+ * the packing attributes is used for packed values, and integer values
+ * that are masked are promoted to a floating point type.  Otherwise the
+ * values are returned as they are stored.  The stored values are read into
+ * the tail of the result array and converted in place, so that no other
+ * buffer is needed.
+ */
+static void sl_nc_get_cf (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   SLindex_Type at_dims[SLARRAY_MAX_DIMS];
+   SLang_Array_Type *at = NULL;
+   Slice_Type slice;
+   Packing_Type p;
+   Mask_Type mask;
+   Unpack_Fun_Type unpack = NULL;
+   unsigned char *raw, *tmp = NULL;
+   size_t *start, *count;
+   ptrdiff_t *stride;
+   unsigned int i, num_dims;
+   SLtype sltype, out_type;
+   nc_type xtype;
+   int ncid, do_unpack, do_mask;
+
+   if ((-1 == check_ncid_type (nc))
+       || (-1 == get_var_sltype (nc->ncid, ncvar, &xtype, &sltype)))
+     return;
+
+   if ((-1 == SLang_pop_int (&do_mask))
+       || (-1 == SLang_pop_int (&do_unpack))
+       || (-1 == pop_float_type_or_null ("_nc_get_cf", &out_type)))
+     return;
+
+   if ((sltype == SLANG_STRUCT_TYPE) || (sltype == SLANG_STRING_TYPE))
+     {
+	SLang_verror (SL_NotImplemented_Error, "_nc_get_cf: only numeric variables are supported");
+	return;
+     }
+
+   ncid = nc->ncid;
+   if (-1 == pop_slice (nc, ncvar, 1, NULL, &slice))
+     return;
+
+   p.is_packed = 0;
+   p.scale = 1.0;
+   p.offset = 0.0;
+   if ((do_unpack && (-1 == get_var_packing (ncid, ncvar->var_id, &p)))
+       || (do_mask && (-1 == get_var_mask (ncid, ncvar, &mask))))
+     return;
+
+   if (out_type == SLANG_VOID_TYPE)
+     {
+	out_type = sltype;
+	if (p.is_packed)
+	  out_type = (p.att_xtype == NC_FLOAT) ? SLANG_FLOAT_TYPE : SLANG_DOUBLE_TYPE;
+	else if (do_mask)
+	  out_type = get_masked_type (sltype, ncvar->xsize);
+     }
+   if ((out_type != sltype) || p.is_packed || do_mask)
+     {
+	if (NULL == (unpack = get_unpack_fun (sltype, out_type)))
+	  return;
+     }
+
+   num_dims = ncvar->num_dims;
+   start = count = NULL;
+   stride = NULL;
+   if (num_dims == 0)
+     {
+	at_dims[0] = 1;
+	num_dims = 1;
+     }
+   else if ((slice.count_given == 0) && (slice.total == 1))
+     {
+	at_dims[0] = 1;
+	num_dims = 1;
+     }
+   else
+     {
+	if (num_dims > SLARRAY_MAX_DIMS)
+	  {
+	     SLang_verror (SL_LimitExceeded_Error, "slang arrays are currently limited to %d dimensions.  The netcdf variable has %d dimensions",
+			   SLARRAY_MAX_DIMS, num_dims);
+	     return;
+	  }
+	for (i = 0; i < num_dims; i++)
+	  at_dims[i] = slice.count[i];
+     }
+   if (ncvar->num_dims != 0)
+     {
+	start = slice.start;
+	count = slice.count;
+	stride = slice.has_stride ? slice.stride : NULL;
+     }
+
+   if (NULL == (at = SLang_create_array (out_type, 0, NULL, at_dims, num_dims)))
+     return;
+
+   raw = (unsigned char *) at->data;
+   if (unpack != NULL)
+     {
+	if (ncvar->xsize <= at->sizeof_type)
+	  raw += at->num_elements * (at->sizeof_type - ncvar->xsize);
+	else if (NULL == (raw = tmp = (unsigned char *) SLmalloc (at->num_elements * ncvar->xsize + 1)))
+	  goto free_and_return;
+     }
+
+   if ((at->num_elements != 0)
+       && (-1 == ((stride == NULL)
+		  ? read_atomic_slab (ncid, ncvar->var_id, start, count, NULL, NULL, sltype, raw)
+		  : read_strided_slab (ncid, ncvar, start, count, stride, sltype, ncvar->xsize, raw))))
+     goto free_and_return;
+
+   if (unpack != NULL)
+     (*unpack) (raw, at->data, at->num_elements, p.scale, p.offset, (do_mask ? &mask : NULL));
+
+   if (ncvar->num_dims == 0)
+     (void) SLang_push_value (at->data_type, at->data);
+   else
+     (void) SLang_push_array (at, 0);
+   /* drop */
+free_and_return:
+   SLfree ((char *) tmp);	       /* NULL ok */
+   SLang_free_array (at);	       /* NULL ok */
+}
+
+/*}}}*/
+
+/*{{{ get_slices/put_slices support */
+
+/* A run of consecutive indices along a dimension.  The ofs field is the
+ * position of the first element of the run in the array of indices, and
+ * hence in the corresponding dimension of the in-memory array.
+ */
+typedef struct
+{
+   size_t start;
+   size_t len;
+   size_t ofs;
+}
+Index_Run_Type;
+
+typedef struct
+{
+   unsigned int dim;		       /* variable dimension */
+   size_t num_indices;
+   Index_Run_Type *runs;
+   size_t num_runs;
+}
+Slice_Index_Type;
+
+typedef struct
+{
+   unsigned int num_fixed;
+   Slice_Index_Type *fixed;
+}
+Slice_Indices_Type;
+
+static void free_slice_indices (Slice_Indices_Type *si)
+{
+   unsigned int i;
+
+   if (si->fixed == NULL)
+     return;
+
+   for (i = 0; i < si->num_fixed; i++)
+     SLfree ((char *) si->fixed[i].runs);   /* NULL ok */
+   SLfree ((char *) si->fixed);
+   si->fixed = NULL;
+}
+
+/* Split the index array into runs of consecutive indices, e.g.,
+ * [3,4,5,6,9] becomes two runs: 3-6 and 9.
+ */
+static int compute_index_runs (size_t *idx, size_t n, Slice_Index_Type *fixed)
+{
+   Index_Run_Type *runs;
+   size_t i, num_runs;
+
+   fixed->num_indices = n;
+   fixed->num_runs = 0;
+   fixed->runs = NULL;
+   if (n == 0)
+     return 0;
+
+   num_runs = 1;
+   for (i = 1; i < n; i++)
+     {
+	if (idx[i] != idx[i-1] + 1)
+	  num_runs++;
+     }
+
+   if (NULL == (runs = (Index_Run_Type *) SLmalloc (num_runs * sizeof (Index_Run_Type))))
+     return -1;
+
+   runs[0].start = idx[0];
+   runs[0].len = 1;
+   runs[0].ofs = 0;
+   num_runs = 0;
+   for (i = 1; i < n; i++)
+     {
+	if (idx[i] == idx[i-1] + 1)
+	  {
+	     runs[num_runs].len++;
+	     continue;
+	  }
+	num_runs++;
+	runs[num_runs].start = idx[i];
+	runs[num_runs].len = 1;
+	runs[num_runs].ofs = i;
+     }
+   fixed->runs = runs;
+   fixed->num_runs = num_runs + 1;
+   return 0;
+}
+
+/* Pop the num_fixed index arrays and the array of dimensions to which they
+ * correspond.  The stack is expected to contain: (i0, ..., iN, dims).
+ * The indices must be non-negative.  For reads they are checked against
+ * the current shape of the variable.
+ */
+static int pop_slice_indices (NCid_Type *nc, NCid_Var_Type *ncvar, unsigned int num_fixed,
+			      int is_read, Slice_Indices_Type *si)
+{
+   SLang_Array_Type *at_dims, *at_idx;
+   unsigned int i, j;
+   int *dims;
+
+   si->num_fixed = num_fixed;
+   si->fixed = NULL;
+
+   if (-1 == SLang_pop_array_of_type (&at_dims, SLANG_INT_TYPE))
+     return -1;
+
+   if ((at_dims->num_elements != num_fixed)
+       || (num_fixed == 0))
+     {
+	SLang_verror (SL_InvalidParm_Error, "Expected the dims qualifier to have a length equal to the number of slice indices");
+	goto return_error;
+     }
+
+   if (-1 == update_var_cache (nc->ncid, ncvar))
+     goto return_error;
+
+   if (NULL == (si->fixed = (Slice_Index_Type *) SLcalloc (num_fixed, sizeof (Slice_Index_Type))))
+     goto return_error;
+
+   dims = (int *) at_dims->data;
+   for (i = 0; i < num_fixed; i++)
+     {
+	if ((dims[i] < 0) || ((unsigned int) dims[i] >= ncvar->num_dims))
+	  {
+	     SLang_verror (SL_InvalidParm_Error, "Invalid dims qualifier for slice");
+	     goto return_error;
+	  }
+	for (j = 0; j < i; j++)
+	  {
+	     if (dims[j] == dims[i])
+	       {
+		  SLang_verror (SL_InvalidParm_Error, "The dims qualifier contains duplicate dimensions");
+		  goto return_error;
+	       }
+	  }
+	si->fixed[i].dim = (unsigned int) dims[i];
+     }
+
+   /* The last index array is on the top of the stack */
+   i = num_fixed;
+   while (i != 0)
+     {
+	Slice_Index_Type *fixed;
+	size_t k, *idx, dim_len;
+
+	i--;
+	fixed = si->fixed + i;
+	if (-1 == SLang_pop_array_of_type (&at_idx, _SL_SIZE_T_TYPE))
+	  goto return_error;
+
+	idx = (size_t *) at_idx->data;
+	dim_len = ncvar->shape[fixed->dim];
+	if (is_read || (ncvar->is_unlimited[fixed->dim] == 0))
+	  {
+	     for (k = 0; k < at_idx->num_elements; k++)
+	       {
+		  if (idx[k] >= dim_len)
+		    {
+		       SLang_verror (SL_Index_Error, "slice index %lu is out of range for dimension %u",
+				     (unsigned long) idx[k], fixed->dim);
+		       SLang_free_array (at_idx);
+		       goto return_error;
+		    }
+	       }
+	  }
+	if (-1 == compute_index_runs (idx, at_idx->num_elements, fixed))
+	  {
+	     SLang_free_array (at_idx);
+	     goto return_error;
+	  }
+	SLang_free_array (at_idx);
+     }
+
+   SLang_free_array (at_dims);
+   return 0;
+
+return_error:
+   SLang_free_array (at_dims);
+   free_slice_indices (si);
+   return -1;
+}
+
+/* Returns non-zero if a block with the specified count occupies a
+ * contiguous region of a row-major array with the specified dimensions.
+ */
+static int is_contiguous_block (size_t *count, SLindex_Type *dims, unsigned int num_dims)
+{
+   unsigned int i = 0;
+
+   while ((i < num_dims) && (count[i] == 1))
+     i++;
+
+   /* Dimension i may be partial, the remaining ones must be complete */
+   for (i++; i < num_dims; i++)
+     {
+	if (count[i] != (size_t) dims[i])
+	  return 0;
+     }
+   return 1;
+}
+
+/* Copy a dense block of elements to or from a larger row-major array,
+ * whose element strides are given by imap.  If to_array is non-zero, the
+ * block is copied into the array; otherwise the block is filled from it.
+ */
+static void copy_block (unsigned char *array, unsigned char *block, size_t sizeof_type,
+			size_t *count, ptrdiff_t *imap, unsigned int num_dims, int to_array)
+{
+   size_t counter[SLARRAY_MAX_DIMS];
+   size_t row_bytes, num_rows, r;
+   unsigned int i, last;
+
+   if (num_dims == 0)
+     return;
+
+   last = num_dims - 1;
+   row_bytes = count[last] * sizeof_type;   /* imap[last] is 1 */
+   num_rows = 1;
+   for (i = 0; i < last; i++)
+     {
+	num_rows *= count[i];
+	counter[i] = 0;
+     }
+
+   for (r = 0; r < num_rows; r++)
+     {
+	size_t ofs = 0;
+
+	for (i = 0; i < last; i++)
+	  ofs += counter[i] * imap[i];
+
+	if (to_array)
+	  memcpy (array + ofs*sizeof_type, block, row_bytes);
+	else
+	  memcpy (block, array + ofs*sizeof_type, row_bytes);
+	block += row_bytes;
+
+	i = last;
+	while (i != 0)
+	  {
+	     i--;
+	     if (++counter[i] < count[i])
+	       break;
+	     counter[i] = 0;
+	  }
+     }
+}
+
+/* Read the hyperslab into the array at the specified element offset.  The
+ * imap array gives the element strides of the array.  Blocks that are
+ * not contiguous in the array are read in place via the nc_get_varm
+ * functions, except for compounds which are read into a temporary buffer
+ * of struct pointers and moved into place.
+ */
+static int read_block_into_array (int ncid, NCid_Var_Type *ncvar, nc_type xtype,
+				  size_t *start, size_t *count, ptrdiff_t *stride,
+				  ptrdiff_t *imap, SLang_Array_Type *at, size_t ofs)
+{
+   SLang_Struct_Type **sp;
+   unsigned char *data;
+   size_t i, num;
+   int status;
+
+   data = (unsigned char *) at->data + ofs * at->sizeof_type;
+
+   if (is_contiguous_block (count, at->dims, at->num_dims))
+     {
+	if (at->data_type != SLANG_STRUCT_TYPE)
+	  return read_atomic_slab (ncid, ncvar->var_id, start, count, stride, NULL,
+				   at->data_type, data);
+
+	num = 1;
+	for (i = 0; i < at->num_dims; i++)
+	  num *= count[i];
+	return get_compound (ncid, ncvar->var_id, xtype, start, count, stride,
+			     (SLang_Struct_Type **) data, num, NULL);
+     }
+
+   if (at->data_type != SLANG_STRUCT_TYPE)
+     return read_atomic_slab (ncid, ncvar->var_id, start, count, stride, imap,
+			      at->data_type, data);
+
+   num = 1;
+   for (i = 0; i < at->num_dims; i++)
+     num *= count[i];
+   if (NULL == (sp = (SLang_Struct_Type **) SLcalloc (num, sizeof (SLang_Struct_Type *))))
+     return -1;
+
+   status = get_compound (ncid, ncvar->var_id, xtype, start, count, stride, sp, num, NULL);
+   if (status == 0)
+     copy_block (data, (unsigned char *) sp, sizeof (SLang_Struct_Type *),
+		 count, imap, at->num_dims, 1);
+   else
+     {
+	for (i = 0; i < num; i++)
+	  {
+	     if (sp[i] != NULL)
+	       SLang_free_struct (sp[i]);
+	  }
+     }
+   SLfree ((char *) sp);
+   return status;
+}
+
+/* Replace the missing values in the block of the array at the specified
+ * element offset by NaN.  The imap array gives the element strides of the
+ * array, whose type must be Float_Type or Double_Type.
+ */
+static void mask_array_block (SLang_Array_Type *at, size_t ofs, size_t *count,
+			      ptrdiff_t *imap, unsigned int num_dims, Mask_Type *m)
+{
+   size_t index[SLARRAY_MAX_DIMS], o;
+   unsigned int i, last = num_dims - 1;
+
+   for (i = 0; i < num_dims; i++)
+     {
+	if (count[i] == 0)
+	  return;
+	index[i] = 0;
+     }
+
+   while (1)
+     {
+	o = ofs;
+	for (i = 0; i < last; i++)
+	  o += index[i] * imap[i];
+
+	if (at->data_type == SLANG_FLOAT_TYPE)
+	  mask_float_values ((float *) at->data + o, count[last], m);
+	else
+	  mask_double_values ((double *) at->data + o, count[last], m);
+
+	i = last;
+	while (i > 0)
+	  {
+	     i--;
+	     if (++index[i] < count[i])
+	       break;
+	     index[i] = 0;
+	  }
+	if ((i == 0) && (index[0] == 0))
+	  break;
+     }
+}
+
+/* Usage: a = _nc_get_slices (i0, ..., iN, dims, ncid, varid)
+ *        a = _nc_get_masked_slices (i0, ..., iN, dims, type, ncid, varid)
+ * Here, the index array ik is for the dimension dims[k], and all the
+ * indices of the other dimensions are read.  The array has the same number
+ * of dimensions as the variable.  Runs of consecutive indices are read as
+ * a single hyperslab, which is placed directly into the array.
+ *
+ * The second form replaces the missing values by NaN, where type is NULL,
+ * Float_Type, or Double_Type as for _nc_get_cf.  The library converts the
+ * values to the type of the result, and the missing values of each block
+ * are masked just after it has been read.  For Float_Type, the mask values
+ * are converted to float beforehand.
+ */
+static void get_slices (NCid_Type *nc, NCid_Var_Type *ncvar, int do_mask)
+{
+   Slice_Indices_Type si;
+   SLang_Array_Type *at;
+   SLindex_Type at_dims[SLARRAY_MAX_DIMS];
+   size_t start[SLARRAY_MAX_DIMS], count[SLARRAY_MAX_DIMS], run_counter[SLARRAY_MAX_DIMS];
+   ptrdiff_t stride[SLARRAY_MAX_DIMS], imap[SLARRAY_MAX_DIMS];
+   unsigned int i, num_dims, num_fixed;
+   Mask_Type mask;
+   nc_type xtype;
+   SLtype sltype, out_type;
+   int ncid;
+
+   if (SLang_Num_Function_Args < 4 + do_mask)
+     {
+	if (do_mask)
+	  SLang_verror (SL_Usage_Error, "Usage: a = _nc_get_masked_slices (i0, ..., iN, dims, type, ncid, varid)");
+	else
+	  SLang_verror (SL_Usage_Error, "Usage: a = _nc_get_slices (i0, ..., iN, dims, ncid, varid)");
+	return;
+     }
+   num_fixed = SLang_Num_Function_Args - 3 - do_mask;
+
+   if (-1 == check_ncid_type (nc))
+     return;
+
+   ncid = nc->ncid;
+   if (-1 == get_var_sltype (ncid, ncvar, &xtype, &sltype))
+     return;
+
+   out_type = sltype;
+   if (do_mask)
+     {
+	if (-1 == pop_float_type_or_null ("_nc_get_masked_slices", &out_type))
+	  return;
+	if ((sltype == SLANG_STRUCT_TYPE) || (sltype == SLANG_STRING_TYPE))
+	  {
+	     SLang_verror (SL_NotImplemented_Error, "_nc_get_masked_slices: only numeric variables are supported");
+	     return;
+	  }
+	if (out_type == SLANG_VOID_TYPE)
+	  out_type = get_masked_type (sltype, ncvar->xsize);
+	if (-1 == get_var_mask (ncid, ncvar, &mask))
+	  return;
+	if ((out_type == SLANG_FLOAT_TYPE) && (sltype != SLANG_FLOAT_TYPE))
+	  round_mask_to_float (&mask);
+     }
+
+   num_dims = ncvar->num_dims;
+   if (num_dims > SLARRAY_MAX_DIMS)
+     {
+	SLang_verror (SL_LimitExceeded_Error, "slang arrays are currently limited to %d dimensions.  The netcdf variable has %d dimensions",
+		      SLARRAY_MAX_DIMS, num_dims);
+	return;
+     }
+
+   if (-1 == pop_slice_indices (nc, ncvar, num_fixed, 1, &si))
+     return;
+
+   for (i = 0; i < num_dims; i++)
+     {
+	at_dims[i] = ncvar->shape[i];
+	start[i] = 0;
+	count[i] = ncvar->shape[i];
+	stride[i] = 1;
+     }
+   for (i = 0; i < num_fixed; i++)
+     {
+	at_dims[si.fixed[i].dim] = si.fixed[i].num_indices;
+	run_counter[i] = 0;
+     }
+
+   at = SLang_create_array (out_type, 0, NULL, at_dims, num_dims);
+   if (at == NULL)
+     goto free_and_return;
+
+   imap[num_dims-1] = 1;
+   i = num_dims-1;
+   while (i != 0)
+     {
+	i--;
+	imap[i] = imap[i+1] * at_dims[i+1];
+     }
+
+   if (at->num_elements != 0) while (1)
+     {
+	size_t ofs = 0;
+
+	for (i = 0; i < num_fixed; i++)
+	  {
+	     Slice_Index_Type *fixed = si.fixed + i;
+	     Index_Run_Type *run = fixed->runs + run_counter[i];
+
+	     start[fixed->dim] = run->start;
+	     count[fixed->dim] = run->len;
+	     ofs += run->ofs * imap[fixed->dim];
+	  }
+
+	if (-1 == read_block_into_array (ncid, ncvar, xtype, start, count, stride, imap, at, ofs))
+	  goto free_and_return;
+	if (do_mask)
+	  mask_array_block (at, ofs, count, imap, num_dims, &mask);
+
+	/* Move to the next combination of runs */
+	i = num_fixed;
+	while (i != 0)
+	  {
+	     i--;
+	     if (++run_counter[i] < si.fixed[i].num_runs)
+	       break;
+	     run_counter[i] = 0;
+	  }
+	if ((i == 0) && (run_counter[0] == 0))
+	  break;
+     }
+
+   (void) SLang_push_array (at, 0);
+   /* drop */
+free_and_return:
+   SLang_free_array (at);		       /* NULL ok */
+   free_slice_indices (&si);
+}
+
+static void sl_nc_get_slices (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   get_slices (nc, ncvar, 0);
+}
+
+static void sl_nc_get_masked_slices (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   get_slices (nc, ncvar, 1);
+}
+
+/* Write the block from the array at the specified element offset.  The
+ * imap array gives the element strides of the array.  Blocks that are
+ * not contiguous in the array are written via the nc_put_varm functions,
+ * except for compounds whose struct pointers are first gathered into a
+ * temporary buffer.
+ */
+static int write_block_from_array (int ncid, NCid_Var_Type *ncvar,
+				   size_t *start, size_t *count, ptrdiff_t *stride,
+				   ptrdiff_t *imap, SLang_Array_Type *at, SLindex_Type *at_dims,
+				   unsigned int num_dims, size_t ofs)
+{
+   SLang_Struct_Type **sp;
+   unsigned char *data;
+   size_t i, num;
+   int status;
+
+   data = (unsigned char *) at->data + ofs * at->sizeof_type;
+   num = 1;
+   for (i = 0; i < num_dims; i++)
+     num *= count[i];
+
+   if (is_contiguous_block (count, at_dims, num_dims))
+     {
+	if (at->data_type != SLANG_STRUCT_TYPE)
+	  status = write_atomic_slab (ncid, ncvar->var_id, start, count, NULL, NULL,
+				      at->data_type, data);
+	else
+	  status = put_compound (ncid, ncvar->var_id, ncvar->xtype, start, count, NULL,
+				 (SLang_Struct_Type **) data, num, NULL);
+     }
+   else if (at->data_type != SLANG_STRUCT_TYPE)
+     status = write_atomic_slab (ncid, ncvar->var_id, start, count, stride, imap,
+				 at->data_type, data);
+   else
+     {
+	/* Only the pointers are copied-- the buffer does not own the structs */
+	if (NULL == (sp = (SLang_Struct_Type **) SLmalloc (num * sizeof (SLang_Struct_Type *))))
+	  return -1;
+	copy_block (data, (unsigned char *) sp, sizeof (SLang_Struct_Type *),
+		    count, imap, num_dims, 0);
+	status = put_compound (ncid, ncvar->var_id, ncvar->xtype, start, count, NULL,
+			       sp, num, NULL);
+	SLfree ((char *) sp);
+     }
+
+   if (status == -1)
+     return -1;
+
+   note_var_write (ncid, ncvar, start, count, NULL);
+   return 0;
+}
+
+/* Get the number of elements in a chunk of the variable, or 0 if the
+ * variable is not chunked.
+ */
+static int get_var_chunk_num_elements (int ncid, NCid_Var_Type *ncvar, size_t *nump)
+{
+   size_t num;
+   unsigned int i;
+
+   *nump = 0;
+   if (-1 == update_var_chunk_cache (ncid, ncvar))
+     return -1;
+   if (ncvar->is_chunked == 0)
+     return 0;
+
+   num = 1;
+   for (i = 0; i < ncvar->num_dims; i++)
+     num *= ncvar->chunks[i];
+   *nump = num;
+   return 0;
+}
+
+/* A scalar that is written to a block is copied into a buffer of at most
+ * this many bytes, or the size of a chunk if larger, and written one tile
+ * at a time.
+ */
+#define BROADCAST_BUFFER_SIZE 0x100000
+
+/* Write the value in the 1-element array to every element of the block.
+ * The buffer contains num_buf copies of the value.
+ */
+static int write_broadcast_block (int ncid, NCid_Var_Type *ncvar,
+				  size_t *start, size_t *count, unsigned int num_dims,
+				  SLtype sltype, VOID_STAR buf, size_t num_buf)
+{
+   size_t tile[SLARRAY_MAX_DIMS], tile_start[SLARRAY_MAX_DIMS];
+   size_t tile_count[SLARRAY_MAX_DIMS], ofs[SLARRAY_MAX_DIMS];
+   size_t n;
+   unsigned int i;
+
+   /* Use as many complete inner dimensions as fit into the buffer */
+   for (i = 0; i < num_dims; i++)
+     {
+	tile[i] = 1;
+	ofs[i] = 0;
+	if (count[i] == 0)
+	  return 0;
+     }
+   n = 1;
+   i = num_dims;
+   while (i != 0)
+     {
+	i--;
+	if (n * count[i] <= num_buf)
+	  {
+	     tile[i] = count[i];
+	     n *= count[i];
+	     continue;
+	  }
+	tile[i] = num_buf / n;
+	break;
+     }
+
+   while (1)
+     {
+	int status;
+
+	n = 1;
+	for (i = 0; i < num_dims; i++)
+	  {
+	     tile_start[i] = start[i] + ofs[i];
+	     tile_count[i] = count[i] - ofs[i];
+	     if (tile_count[i] > tile[i]) tile_count[i] = tile[i];
+	     n *= tile_count[i];
+	  }
+
+	if (sltype == SLANG_STRUCT_TYPE)
+	  status = put_compound (ncid, ncvar->var_id, ncvar->xtype, tile_start, tile_count, NULL,
+				 (SLang_Struct_Type **) buf, n, NULL);
+	else
+	  status = write_atomic_slab (ncid, ncvar->var_id, tile_start, tile_count, NULL, NULL,
+				      sltype, buf);
+	if (status == -1)
+	  return -1;
+
+	note_var_write (ncid, ncvar, tile_start, tile_count, NULL);
+
+	i = num_dims;
+	while (i != 0)
+	  {
+	     i--;
+	     ofs[i] += tile[i];
+	     if (ofs[i] < count[i])
+	       break;
+	     ofs[i] = 0;
+	  }
+	if ((i == 0) && (ofs[0] == 0))
+	  break;
+     }
+   return 0;
+}
+
+/* Usage: _nc_put_slices (i0, ..., iN, dims, data, ncid, varid)
+ * The index array ik is for the dimension dims[k].  The data array must
+ * have as many elements as the sub-array, which has the same number of
+ * dimensions as the variable.  A scalar will be written to each element
+ * of the sub-array.
+ */
+static void sl_nc_put_slices (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   Slice_Indices_Type si;
+   SLang_Array_Type *at;
+   SLindex_Type at_dims[SLARRAY_MAX_DIMS];
+   size_t start[SLARRAY_MAX_DIMS], count[SLARRAY_MAX_DIMS], run_counter[SLARRAY_MAX_DIMS];
+   ptrdiff_t stride[SLARRAY_MAX_DIMS], imap[SLARRAY_MAX_DIMS];
+   unsigned int i, num_dims, num_fixed;
+   unsigned char *buf = NULL;
+   size_t num_buf = 0, total, k;
+   int ncid, is_scalar;
+
+   if (SLang_Num_Function_Args < 5)
+     {
+	SLang_verror (SL_Usage_Error, "Usage: _nc_put_slices (i0, ..., iN, dims, data, ncid, varid)");
+	return;
+     }
+   num_fixed = SLang_Num_Function_Args - 4;
+
+   if (-1 == check_ncid_type (nc))
+     return;
+   ncid = nc->ncid;
+
+   is_scalar = (SLANG_ARRAY_TYPE != SLang_peek_at_stack ());
+   if (-1 == SLang_pop_array (&at, 1))
+     return;
+
+   si.fixed = NULL;
+   num_dims = ncvar->num_dims;
+   if (num_dims > SLARRAY_MAX_DIMS)
+     {
+	SLang_verror (SL_LimitExceeded_Error, "slang arrays are currently limited to %d dimensions.  The netcdf variable has %d dimensions",
+		      SLARRAY_MAX_DIMS, num_dims);
+	goto free_and_return;
+     }
+
+   if (-1 == pop_slice_indices (nc, ncvar, num_fixed, 0, &si))
+     goto free_and_return;
+
+   if ((at->data_type == SLANG_STRUCT_TYPE) && (ncvar->xclass != NC_COMPOUND))
+     {
+	SLang_verror (SL_InvalidParm_Error, "Variable is not compound type");
+	goto free_and_return;
+     }
+
+   for (i = 0; i < num_dims; i++)
+     {
+	at_dims[i] = ncvar->shape[i];
+	start[i] = 0;
+	count[i] = ncvar->shape[i];
+	stride[i] = 1;
+     }
+   for (i = 0; i < num_fixed; i++)
+     {
+	at_dims[si.fixed[i].dim] = si.fixed[i].num_indices;
+	run_counter[i] = 0;
+     }
+
+   total = 1;
+   for (i = 0; i < num_dims; i++)
+     total *= at_dims[i];
+   if (total == 0)
+     goto free_and_return;
+
+   if ((is_scalar == 0) && (total != at->num_elements))
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_put_slices: the slices are inconsistent with the provided array: %lu values provided, %lu expected",
+		      (unsigned long) at->num_elements, (unsigned long) total);
+	goto free_and_return;
+     }
+
+   if (is_scalar)
+     {
+	if (-1 == get_var_chunk_num_elements (ncid, ncvar, &num_buf))
+	  goto free_and_return;
+	if (num_buf * at->sizeof_type < BROADCAST_BUFFER_SIZE)
+	  num_buf = BROADCAST_BUFFER_SIZE / at->sizeof_type;
+	if (num_buf > total) num_buf = total;
+	if (num_buf == 0) num_buf = 1;
+
+	if (NULL == (buf = (unsigned char *) SLmalloc (num_buf * at->sizeof_type)))
+	  goto free_and_return;
+	for (k = 0; k < num_buf; k++)
+	  memcpy (buf + k*at->sizeof_type, at->data, at->sizeof_type);
+     }
+
+   imap[num_dims-1] = 1;
+   i = num_dims-1;
+   while (i != 0)
+     {
+	i--;
+	imap[i] = imap[i+1] * at_dims[i+1];
+     }
+
+   while (1)
+     {
+	size_t ofs = 0;
+	int status;
+
+	for (i = 0; i < num_fixed; i++)
+	  {
+	     Slice_Index_Type *fixed = si.fixed + i;
+	     Index_Run_Type *run = fixed->runs + run_counter[i];
+
+	     start[fixed->dim] = run->start;
+	     count[fixed->dim] = run->len;
+	     ofs += run->ofs * imap[fixed->dim];
+	  }
+
+	if (is_scalar)
+	  status = write_broadcast_block (ncid, ncvar, start, count, num_dims,
+					  at->data_type, buf, num_buf);
+	else
+	  status = write_block_from_array (ncid, ncvar, start, count, stride, imap,
+					   at, at_dims, num_dims, ofs);
+	if (status == -1)
+	  goto free_and_return;
+
+	i = num_fixed;
+	while (i != 0)
+	  {
+	     i--;
+	     if (++run_counter[i] < si.fixed[i].num_runs)
+	       break;
+	     run_counter[i] = 0;
+	  }
+	if ((i == 0) && (run_counter[0] == 0))
+	  break;
+     }
+
+   /* drop */
+free_and_return:
+   SLfree ((char *) buf);	       /* NULL ok */
+   SLang_free_array (at);
+   free_slice_indices (&si);
+}
+
+/*}}}*/
+
+/*{{{ Batched reads */
+
+/* Pop an array of shape [nrows, num_dims].  For a 1-d variable, a 1-d array
+ * is also accepted.  NULL is permitted if null_ok is non-zero.
+ */
+static int pop_row_matrix (SLang_Array_Type **atp, SLtype type, unsigned int num_dims,
+			   int null_ok, size_t *nrowsp)
+{
+   SLang_Array_Type *at;
+
+   if (null_ok)
+     {
+	if (-1 == pop_array_of_type_or_null (&at, type))
+	  return -1;
+	*atp = at;
+	if (at == NULL)
+	  return 0;
+     }
+   else if (-1 == SLang_pop_array_of_type (&at, type))
+     return -1;
+
+   if ((at->num_dims == 2) && ((unsigned int) at->dims[1] == num_dims))
+     *nrowsp = at->dims[0];
+   else if ((at->num_dims == 1) && (num_dims == 1))
+     *nrowsp = at->num_elements;
+   else
+     {
+	SLang_verror (SL_InvalidParm_Error, "Expected an array of shape [n,%u]", num_dims);
+	SLang_free_array (at);
+	return -1;
+     }
+   *atp = at;
+   return 0;
+}
+
+typedef struct
+{
+   size_t index;
+   size_t *start;
+   size_t *key;			       /* storage-order key */
+   unsigned int num_keys;
+}
+Box_Order_Type;
+
+static int compare_box_order (const void *a, const void *b)
+{
+   const Box_Order_Type *ba = (const Box_Order_Type *)a;
+   const Box_Order_Type *bb = (const Box_Order_Type *)b;
+   unsigned int i;
+
+   for (i = 0; i < ba->num_keys; i++)
+     {
+	if (ba->key[i] != bb->key[i])
+	  return (ba->key[i] < bb->key[i]) ? -1 : 1;
+     }
+   if (ba->index == bb->index) return 0;
+   return (ba->index < bb->index) ? -1 : 1;
+}
+
+/* Usage: arrays = _nc_get_many (starts, counts, strides, ncid, varid)
+ * Here starts, counts, and strides are [nboxes, ndims] arrays.  The
+ * strides may be NULL.  An array of nboxes arrays is returned.  The boxes
+ * are read in the order in which they are stored, i.e., by the index of
+ * the chunk containing the start of the box, and then by the start.
+ * Consecutive reads from the same chunk are then satisfied by the chunk
+ * cache.
+ */
+static void sl_nc_get_many (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   SLang_Array_Type *at_starts, *at_counts, *at_strides, *at_list, *at;
+   Box_Order_Type *order = NULL;
+   SLang_Array_Type **list;
+   size_t *starts = NULL, *keys = NULL, *counts;
+   ptrdiff_t *strides, *ones = NULL;
+   size_t b, nboxes, n;
+   unsigned int i, num_dims;
+   SLindex_Type dims[SLARRAY_MAX_DIMS], num;
+   nc_type xtype;
+   SLtype sltype;
+   int ncid;
+
+   at_starts = at_counts = at_strides = at_list = NULL;
+
+   if ((-1 == check_ncid_type (nc))
+       || (-1 == get_var_sltype (nc->ncid, ncvar, &xtype, &sltype))
+       || (-1 == update_var_chunk_cache (nc->ncid, ncvar)))
+     return;
+
+   ncid = nc->ncid;
+   num_dims = ncvar->num_dims;
+   if ((num_dims == 0) || (num_dims > SLARRAY_MAX_DIMS))
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_get_many: the variable must have between 1 and %d dimensions", SLARRAY_MAX_DIMS);
+	return;
+     }
+
+   if ((-1 == pop_row_matrix (&at_strides, _SL_PTRDIFF_T_TYPE, num_dims, 1, &n))
+       || (-1 == pop_row_matrix (&at_counts, _SL_SIZE_T_TYPE, num_dims, 0, &nboxes))
+       || ((at_strides != NULL) && (n != nboxes))
+       || (-1 == pop_row_matrix (&at_starts, _SL_PTRDIFF_T_TYPE, num_dims, 0, &n))
+       || (n != nboxes))
+     {
+	if (0 == SLang_get_error ())
+	  SLang_verror (SL_InvalidParm_Error, "_nc_get_many: the start, count, and stride arrays must have the same shape");
+	goto free_and_return;
+     }
+
+   counts = (size_t *) at_counts->data;
+   if (NULL == (ones = (ptrdiff_t *) SLmalloc (num_dims * sizeof (ptrdiff_t))))
+     goto free_and_return;
+   for (i = 0; i < num_dims; i++)
+     ones[i] = 1;
+
+   /* Wrap negative starts and validate all boxes before reading */
+   if ((NULL == (starts = (size_t *) SLmalloc ((nboxes*num_dims + 1) * sizeof (size_t))))
+       || (NULL == (keys = (size_t *) SLmalloc ((2*nboxes*num_dims + 1) * sizeof (size_t))))
+       || (NULL == (order = (Box_Order_Type *) SLmalloc ((nboxes + 1) * sizeof (Box_Order_Type)))))
+     goto free_and_return;
+
+   for (b = 0; b < nboxes; b++)
+     {
+	ptrdiff_t *s = (ptrdiff_t *) at_starts->data + b*num_dims;
+	size_t *start = starts + b*num_dims;
+	size_t *key = keys + 2*b*num_dims;
+	size_t total;
+
+	strides = (at_strides == NULL) ? ones : (ptrdiff_t *) at_strides->data + b*num_dims;
+	for (i = 0; i < num_dims; i++)
+	  {
+	     ptrdiff_t s_i = s[i];
+	     if (s_i < 0)
+	       {
+		  s_i += (ptrdiff_t) ncvar->shape[i];
+		  if (s_i < 0)
+		    {
+		       SLang_verror (SL_Index_Error, "Invalid negative index");
+		       goto free_and_return;
+		    }
+	       }
+	     start[i] = (size_t) s_i;
+	     key[i] = ncvar->is_chunked ? start[i]/ncvar->chunks[i] : 0;
+	     key[num_dims + i] = start[i];
+	  }
+	if (-1 == check_slice (ncvar, 1, start, counts + b*num_dims, strides, &total))
+	  goto free_and_return;
+
+	order[b].index = b;
+	order[b].start = start;
+	order[b].key = key;
+	order[b].num_keys = 2*num_dims;
+     }
+
+   qsort (order, nboxes, sizeof (Box_Order_Type), compare_box_order);
+
+   num = (SLindex_Type) nboxes;
+   if (NULL == (at_list = SLang_create_array (SLANG_ARRAY_TYPE, 0, NULL, &num, 1)))
+     goto free_and_return;
+   list = (SLang_Array_Type **) at_list->data;
+
+   for (n = 0; n < nboxes; n++)
+     {
+	size_t *count;
+
+	b = order[n].index;
+	count = counts + b*num_dims;
+	strides = (at_strides == NULL) ? ones : (ptrdiff_t *) at_strides->data + b*num_dims;
+	for (i = 0; i < num_dims; i++)
+	  dims[i] = count[i];
+
+	if (NULL == (at = SLang_create_array (sltype, 0, NULL, dims, num_dims)))
+	  goto free_and_return;
+	list[b] = at;
+
+	if ((at->num_elements != 0)
+	    && (-1 == read_vars_into_array (ncid, ncvar, xtype, order[n].start, count, strides, at)))
+	  goto free_and_return;
+     }
+
+   (void) SLang_push_array (at_list, 0);
+   /* drop */
+free_and_return:
+   SLang_free_array (at_list);	       /* NULL ok */
+   SLang_free_array (at_starts);       /* NULL ok */
+   SLang_free_array (at_counts);       /* NULL ok */
+   SLang_free_array (at_strides);      /* NULL ok */
+   SLfree ((char *) order);	       /* NULL ok */
+   SLfree ((char *) keys);	       /* NULL ok */
+   SLfree ((char *) starts);	       /* NULL ok */
+   SLfree ((char *) ones);	       /* NULL ok */
+}
+
+typedef struct
+{
+   int var_id;
+   size_t index;
+}
+Var_Order_Type;
+
+static int compare_var_order (const void *a, const void *b)
+{
+   const Var_Order_Type *va = (const Var_Order_Type *)a;
+   const Var_Order_Type *vb = (const Var_Order_Type *)b;
+
+   if (va->var_id != vb->var_id)
+     return (va->var_id < vb->var_id) ? -1 : 1;
+   if (va->index == vb->index) return 0;
+   return (va->index < vb->index) ? -1 : 1;
+}
+
+/* Map the dimensions of the variable to the slice dimensions.  If
+ * at_dims is NULL, then the slice dimensions are those of the variable.
+ * Otherwise map[i] is the index of the i-th dimension of the variable in
+ * at_dims, or -1 if it is not a slice dimension.
+ */
+static int map_slice_dims (NCid_Var_Type *ncvar, SLang_Array_Type *at_dims,
+			   unsigned int num_slice_dims, int *map)
+{
+   NCid_Dim_Type **ncdims, **slice_dims;
+   unsigned int i, j, num_found = 0;
+
+   if (at_dims == NULL)
+     {
+	if (ncvar->num_dims != num_slice_dims)
+	  {
+	     SLang_verror (SL_InvalidParm_Error, "_nc_get_multi: the variables must have %u dimensions",
+			   num_slice_dims);
+	     return -1;
+	  }
+	for (i = 0; i < num_slice_dims; i++)
+	  map[i] = (int) i;
+	return 0;
+     }
+
+   ncdims = (NCid_Dim_Type **) ncvar->at_ncdims->data;
+   slice_dims = (NCid_Dim_Type **) at_dims->data;
+   for (i = 0; i < ncvar->num_dims; i++)
+     {
+	map[i] = -1;
+	for (j = 0; j < num_slice_dims; j++)
+	  {
+	     if (ncdims[i]->dim_id == slice_dims[j]->dim_id)
+	       {
+		  map[i] = (int) j;
+		  num_found++;
+		  break;
+	       }
+	  }
+     }
+   if (num_found != num_slice_dims)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_get_multi: a variable does not have all of the specified dimensions");
+	return -1;
+     }
+   return 0;
+}
+
+/* Usage: arrays = _nc_get_multi (start, count, dims, varids, ncid)
+ * Here varids is an array of variables of the group.  The start and count
+ * arrays, either of which may be NULL, specify a hyperslab that is common
+ * to all of the variables.  If dims is NULL, then the start and count
+ * arrays refer to the dimensions of the variables, which must all have the
+ * same number of dimensions.  Otherwise dims is an array of dimensions to
+ * which the start and count values refer, and the other dimensions of the
+ * variables are read in full.  All of the slices are checked before any
+ * data are read, and the variables are read in the order of their ids,
+ * which for the classic formats is the order in which they are stored.
+ * The arrays are returned in the order of the varids array.
+ */
+static void sl_nc_get_multi (NCid_Type *nc)
+{
+   SLang_Array_Type *at_start, *at_count, *at_dims, *at_varids, *at_list, *at;
+   SLang_Array_Type **list;
+   NCid_Var_Type **ncvars;
+   Var_Order_Type *order = NULL;
+   size_t *starts = NULL, *counts = NULL;
+   ptrdiff_t ones[MAX_SLICE_DIMS];
+   int map[MAX_SLICE_DIMS];
+   SLindex_Type dims[SLARRAY_MAX_DIMS], num;
+   size_t v, n, nvars, total;
+   unsigned int i, num_slice_dims, max_dims;
+   nc_type xtype;
+   SLtype sltype;
+   int ncid;
+
+   at_start = at_count = at_dims = at_varids = at_list = NULL;
+
+   if (-1 == check_ncid_type (nc))
+     return;
+   ncid = nc->ncid;
+
+   if ((-1 == SLang_pop_array_of_type (&at_varids, NCid_Var_Type_Id))
+       || (-1 == pop_array_of_type_or_null (&at_dims, NCid_Dim_Type_Id))
+       || (-1 == pop_array_of_type_or_null (&at_count, _SL_SIZE_T_TYPE))
+       || (-1 == pop_array_of_type_or_null (&at_start, _SL_PTRDIFF_T_TYPE)))
+     goto free_and_return;
+
+   ncvars = (NCid_Var_Type **) at_varids->data;
+   nvars = at_varids->num_elements;
+
+   /* Determine the number of slice dimensions */
+   max_dims = 0;
+   for (v = 0; v < nvars; v++)
+     {
+	if (-1 == update_var_cache (ncid, ncvars[v]))
+	  goto free_and_return;
+	if (ncvars[v]->num_dims > max_dims)
+	  max_dims = ncvars[v]->num_dims;
+     }
+   if (at_dims != NULL)
+     num_slice_dims = at_dims->num_elements;
+   else if (at_start != NULL)
+     num_slice_dims = at_start->num_elements;
+   else if (at_count != NULL)
+     num_slice_dims = at_count->num_elements;
+   else
+     num_slice_dims = (nvars != 0) ? ncvars[0]->num_dims : 0;
+
+   if (((at_start != NULL) && (at_start->num_elements != num_slice_dims))
+       || ((at_count != NULL) && (at_count->num_elements != num_slice_dims)))
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_get_multi: the start and count arrays must have %u elements",
+		      num_slice_dims);
+	goto free_and_return;
+     }
+   if ((max_dims > SLARRAY_MAX_DIMS) || (num_slice_dims > MAX_SLICE_DIMS))
+     {
+	SLang_verror (SL_LimitExceeded_Error, "_nc_get_multi: slang arrays are limited to %d dimensions",
+		      SLARRAY_MAX_DIMS);
+	goto free_and_return;
+     }
+   for (i = 0; i < max_dims; i++)
+     ones[i] = 1;
+
+   /* Compute and validate the hyperslab of each variable */
+   if ((NULL == (starts = (size_t *) SLmalloc ((nvars*max_dims + 1) * sizeof (size_t))))
+       || (NULL == (counts = (size_t *) SLmalloc ((nvars*max_dims + 1) * sizeof (size_t))))
+       || (NULL == (order = (Var_Order_Type *) SLmalloc ((nvars + 1) * sizeof (Var_Order_Type)))))
+     goto free_and_return;
+
+   for (v = 0; v < nvars; v++)
+     {
+	NCid_Var_Type *ncvar = ncvars[v];
+	size_t *start = starts + v*max_dims, *count = counts + v*max_dims;
+
+	if (-1 == map_slice_dims (ncvar, at_dims, num_slice_dims, map))
+	  goto free_and_return;
+
+	for (i = 0; i < ncvar->num_dims; i++)
+	  {
+	     size_t len = ncvar->shape[i];
+	     ptrdiff_t start_i = 0;
+	     int k = map[i];
+
+	     if ((k >= 0) && (at_start != NULL))
+	       {
+		  start_i = ((ptrdiff_t *) at_start->data)[k];
+		  if (start_i < 0)
+		    {
+		       start_i += (ptrdiff_t) len;
+		       if (start_i < 0)
+			 {
+			    SLang_verror (SL_Index_Error, "Invalid negative index");
+			    goto free_and_return;
+			 }
+		    }
+	       }
+	     start[i] = (size_t) start_i;
+	     if ((k >= 0) && (at_count != NULL))
+	       count[i] = ((size_t *) at_count->data)[k];
+	     else
+	       count[i] = (start[i] < len) ? len - start[i] : 0;
+	  }
+	if (-1 == check_slice (ncvar, 1, start, count, ones, &total))
+	  goto free_and_return;
+
+	order[v].var_id = ncvar->var_id;
+	order[v].index = v;
+     }
+
+   qsort (order, nvars, sizeof (Var_Order_Type), compare_var_order);
+
+   num = (SLindex_Type) nvars;
+   if (NULL == (at_list = SLang_create_array (SLANG_ARRAY_TYPE, 0, NULL, &num, 1)))
+     goto free_and_return;
+   list = (SLang_Array_Type **) at_list->data;
+
+   for (n = 0; n < nvars; n++)
+     {
+	NCid_Var_Type *ncvar;
+	unsigned int num_dims;
+
+	v = order[n].index;
+	ncvar = ncvars[v];
+	if (-1 == get_var_sltype (ncid, ncvar, &xtype, &sltype))
+	  goto free_and_return;
+
+	num_dims = ncvar->num_dims;
+	for (i = 0; i < num_dims; i++)
+	  dims[i] = counts[v*max_dims + i];
+	if (num_dims == 0)
+	  {
+	     dims[0] = 1;
+	     num_dims = 1;
+	  }
+
+	if (NULL == (at = SLang_create_array (sltype, 0, NULL, dims, num_dims)))
+	  goto free_and_return;
+	list[v] = at;
+
+	if ((at->num_elements != 0)
+	    && (-1 == read_vars_into_array (ncid, ncvar, xtype,
+					    (ncvar->num_dims ? starts + v*max_dims : NULL),
+					    (ncvar->num_dims ? counts + v*max_dims : NULL),
+					    (ncvar->num_dims ? ones : NULL), at)))
+	  goto free_and_return;
+     }
+
+   (void) SLang_push_array (at_list, 0);
+   /* drop */
+free_and_return:
+   SLang_free_array (at_list);	       /* NULL ok */
+   SLang_free_array (at_varids);       /* NULL ok */
+   SLang_free_array (at_dims);	       /* NULL ok */
+   SLang_free_array (at_count);	       /* NULL ok */
+   SLang_free_array (at_start);	       /* NULL ok */
+   SLfree ((char *) order);	       /* NULL ok */
+   SLfree ((char *) counts);	       /* NULL ok */
+   SLfree ((char *) starts);	       /* NULL ok */
+}
+
+/*}}}*/
+
+/*{{{ Block planning */
+
+/* The default memory budget in bytes of the operations that traverse a
+ * variable one block at a time.
+ */
+#define DEFAULT_MAX_BLOCK_BYTES 0x1000000
+
+/* Pop the memory budget of a block operation.  NULL selects the default. */
+static int pop_max_bytes (size_t *max_bytesp)
+{
+   double d;
+
+   if (SLang_peek_at_stack () == SLANG_NULL_TYPE)
+     {
+	*max_bytesp = DEFAULT_MAX_BLOCK_BYTES;
+	return SLdo_pop ();
+     }
+   if (-1 == SLang_pop_double (&d))
+     return -1;
+   if (d < 1.0)
+     {
+	SLang_verror (SL_InvalidParm_Error, "The memory budget must be at least 1 byte");
+	return -1;
+     }
+   *max_bytesp = (d >= (double) SIZE_MAX) ? SIZE_MAX : (size_t) d;
+   return 0;
+}
+
+/* Compute the shape of the blocks that tile the variable such that a block
+ * of elements of size sizeof_type occupies at most max_bytes.  For a
+ * chunked variable, a block is made up of whole chunks, unless a single
+ * chunk exceeds the budget.  In that case the chunk is split along its
+ * slowest varying dimensions.  The blocks are then extended along the
+ * fastest varying dimensions for as long as the budget permits, so that a
+ * block of a contiguous variable consists of complete rows when possible.
+ * If extend_chunks is zero, the blocks of a chunked variable are not
+ * extended beyond a single chunk.
+ */
+static int plan_blocks (int ncid, NCid_Var_Type *ncvar, size_t sizeof_type,
+			size_t max_bytes, int extend_chunks, size_t *block)
+{
+   size_t max_num, num, len, unit, m;
+   unsigned int i, num_dims;
+
+   if ((-1 == update_var_cache (ncid, ncvar))
+       || (-1 == update_var_chunk_cache (ncid, ncvar)))
+     return -1;
+
+   num_dims = ncvar->num_dims;
+   max_num = max_bytes / sizeof_type;
+   if (max_num == 0) max_num = 1;
+
+   num = 1;
+   for (i = 0; i < num_dims; i++)
+     {
+	block[i] = 1;
+	if (ncvar->is_chunked)
+	  {
+	     len = ncvar->shape[i];
+	     if (len == 0) len = 1;
+	     block[i] = (ncvar->chunks[i] < len) ? ncvar->chunks[i] : len;
+	  }
+	num *= block[i];
+     }
+
+   /* Split an oversized chunk */
+   for (i = 0; (i < num_dims) && (num > max_num); i++)
+     {
+	size_t other = num / block[i];
+
+	m = max_num / other;
+	if (m == 0) m = 1;
+	if (m < block[i])
+	  {
+	     block[i] = m;
+	     num = other * m;
+	  }
+     }
+
+   /* Extend the blocks by whole units */
+   i = num_dims;
+   if (ncvar->is_chunked && (extend_chunks == 0))
+     i = 0;
+   while (i > 0)
+     {
+	i--;
+	len = ncvar->shape[i];
+	if (len == 0) len = 1;
+	unit = block[i];
+	m = max_num / num;
+	if (m <= 1)
+	  break;
+	if (m * unit >= len)
+	  {
+	     num = (num / unit) * len;
+	     block[i] = len;
+	     continue;
+	  }
+	num = (num / unit) * (m * unit);
+	block[i] = m * unit;
+	break;
+     }
+   return 0;
+}
+
+/* Usage: block = _nc_plan_blocks (max_bytes, ncid, varid)
+ * Return the shape of the chunk-aligned blocks that tile the variable,
+ * where max_bytes is the memory budget of a block or NULL for the default.
+ */
+static void sl_nc_plan_blocks (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   SLang_Array_Type *at;
+   SLindex_Type num_dims;
+   size_t max_bytes;
+
+   if ((-1 == pop_max_bytes (&max_bytes))
+       || (-1 == check_ncid_type (nc))
+       || (-1 == update_var_cache (nc->ncid, ncvar)))
+     return;
+
+   if (ncvar->num_dims == 0)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_plan_blocks: the variable is a scalar");
+	return;
+     }
+
+   num_dims = ncvar->num_dims;
+   if (NULL == (at = SLang_create_array (_SL_SIZE_T_TYPE, 0, NULL, &num_dims, 1)))
+     return;
+
+   if (0 == plan_blocks (nc->ncid, ncvar, ncvar->xsize, max_bytes, 1, (size_t *) at->data))
+     (void) SLang_push_array (at, 0);
+   SLang_free_array (at);
+}
+
+/*}}}*/
+
+/*{{{ Emulated strided reads */
+
+/* The netCDF library reads a strided hyperslab in many small pieces, which
+ * is much slower than reading a contiguous one.  When the strides are small,
+ * it is faster to read the enclosing contiguous hyperslab in blocks and
+ * subsample it in memory.  Stride_Emulation selects between the two:
+ * -1 always uses the library, 1 always emulates, and 0 decides using the
+ * cost model of use_emulated_stride.  The blocks of an emulated read hold
+ * at most Stride_Block_Bytes.
+ */
+static int Stride_Emulation = 0;
+static size_t Stride_Block_Bytes = DEFAULT_MAX_BLOCK_BYTES;
+
+/* For a contiguous variable, the maximum factor by which the emulated read
+ * may exceed the size of the strided hyperslab.
+ */
+#define MAX_STRIDE_OVERREAD 16.0
+
+/* Plan reading a strided hyperslab via its enclosing hyperslab in blocks of
+ * at most max_bytes.  The dimensions before *splitp are read one index at a
+ * time, *nsplitp strided indices of dimension *splitp are read at a time,
+ * and the enclosing extent of the dimensions after it is read in full.
+ * Return the factor by which the blocks are larger than the values that
+ * they contain.
+ */
+static double plan_strided_blocks (size_t *count, ptrdiff_t *stride, unsigned int num_dims,
+				   size_t sizeof_type, size_t max_bytes,
+				   unsigned int *splitp, size_t *nsplitp)
+{
+   size_t inner = sizeof_type, extent, nsplit, n;
+   double overread = 1.0;
+   unsigned int k = num_dims;
+
+   while (k > 0)
+     {
+	extent = (count[k-1] - 1) * stride[k-1] + 1;
+	if (inner * extent > max_bytes)
+	  break;
+	inner *= extent;
+	k--;
+	overread *= (double) extent / count[k];
+     }
+   if (k == 0)
+     {
+	*splitp = 0;
+	*nsplitp = count[0];
+	return overread;
+     }
+
+   k--;
+   n = max_bytes / inner;	       /* 0 if a single element is too large */
+   nsplit = (n == 0) ? 1 : (n - 1) / stride[k] + 1;
+   if (nsplit > count[k]) nsplit = count[k];
+   *splitp = k;
+   *nsplitp = nsplit;
+   return overread * (double) ((nsplit - 1) * stride[k] + 1) / nsplit;
+}
+
+/* The cost model: returns 1 if the emulated read is expected to be faster,
+ * 0 if not, or -1 upon error.  For a chunked variable, emulation pays off
+ * when no stride exceeds the chunk size along its dimension, since the
+ * same chunks are read either way.  For a contiguous variable, the extra
+ * data read must be bounded.
+ */
+static int use_emulated_stride (int ncid, NCid_Var_Type *ncvar, ptrdiff_t *stride, double overread)
+{
+   unsigned int i;
+
+   if (Stride_Emulation != 0)
+     return (Stride_Emulation > 0);
+
+   if (-1 == update_var_chunk_cache (ncid, ncvar))
+     return -1;
+
+   if (ncvar->is_chunked == 0)
+     return (overread <= MAX_STRIDE_OVERREAD);
+
+   for (i = 0; i < ncvar->num_dims; i++)
+     {
+	if ((size_t) stride[i] > ncvar->chunks[i])
+	  return 0;
+     }
+   return 1;
+}
+
+/* Copy the elements of a num_dims dimensional strided array from src to
+ * the contiguous array dst.  The strides of src are in elements and are
+ * negative for the dimensions that are to be reversed.
+ */
+#define GATHER_ROW(type, d, s) \
+   { \
+      type *d_ = (type *) (d), *s_ = (type *) (s); \
+      for (j = 0; j < len; j++) \
+	d_[j] = s_[(ptrdiff_t) j*step]; \
+   }
+
+static void gather_strided (unsigned char *dst, unsigned char *src, size_t *count,
+			    ptrdiff_t *src_strides, unsigned int num_dims, size_t sizeof_type)
+{
+   size_t index[MAX_SLICE_DIMS], len, j;
+   ptrdiff_t step;
+   unsigned int i, last = num_dims - 1;
+   unsigned char *s;
+
+   for (i = 0; i < num_dims; i++)
+     index[i] = 0;
+   len = count[last];
+   step = src_strides[last];
+
+   while (1)
+     {
+	s = src;
+	for (i = 0; i < last; i++)
+	  s += (ptrdiff_t) index[i] * src_strides[i] * (ptrdiff_t) sizeof_type;
+
+	switch (sizeof_type)
+	  {
+	   case 1: GATHER_ROW(uint8_t, dst, s); break;
+	   case 2: GATHER_ROW(uint16_t, dst, s); break;
+	   case 4: GATHER_ROW(uint32_t, dst, s); break;
+	   case 8: GATHER_ROW(uint64_t, dst, s); break;
+	   default:
+	     for (j = 0; j < len; j++)
+	       memcpy (dst + j*sizeof_type, s + (ptrdiff_t) j*step*(ptrdiff_t) sizeof_type, sizeof_type);
+	     break;
+	  }
+	dst += len * sizeof_type;
+
+	i = last;
+	while (i > 0)
+	  {
+	     i--;
+	     if (++index[i] < count[i])
+	       break;
+	     index[i] = 0;
+	  }
+	if ((i == 0) && (index[0] == 0))
+	  break;
+     }
+}
+
+/* The netCDF library rejects negative strides.  A hyperslab with negative
+ * strides is read as its mirror image, whose start is the last index of
+ * the original along the reversed dimensions, and the reversed dimensions
+ * are flipped in memory.  Set fstart and fstride to the mirrored hyperslab
+ * and return 1 if a stride is negative, or 0 if not.
+ */
+static int mirror_strides (unsigned int num_dims, size_t *start, size_t *count, ptrdiff_t *stride,
+			   size_t *fstart, ptrdiff_t *fstride)
+{
+   unsigned int i;
+   int is_reversed = 0;
+
+   for (i = 0; i < num_dims; i++)
+     {
+	fstart[i] = start[i];
+	fstride[i] = stride[i];
+	if (stride[i] >= 0)
+	  continue;
+	fstride[i] = -stride[i];
+	if (count[i] != 0)
+	  fstart[i] = start[i] - (size_t) fstride[i] * (count[i] - 1);
+	is_reversed = 1;
+     }
+   return is_reversed;
+}
+
+#define SWAP_ROWS(type) \
+   { \
+      type *a_ = (type *) a, *b_ = (type *) b, t_; \
+      if (reverse == 0) \
+	for (j = 0; j < len; j++) \
+	  { t_ = a_[j]; a_[j] = b_[j]; b_[j] = t_; } \
+      else \
+	for (j = 0; j < n; j++) \
+	  { t_ = a_[j]; a_[j] = b_[len-1-j]; b_[len-1-j] = t_; } \
+   }
+
+/* Exchange the rows a and b of len elements, reversing them if reverse is
+ * non-zero.  If a and b are the same row, it is reversed in place.
+ */
+static void swap_rows (unsigned char *a, unsigned char *b, size_t len,
+		       size_t sizeof_type, int reverse)
+{
+   size_t j, k, n;
+   unsigned char t;
+
+   n = (a == b) ? len / 2 : len;
+   switch (sizeof_type)
+     {
+      case 1: SWAP_ROWS(uint8_t); break;
+      case 2: SWAP_ROWS(uint16_t); break;
+      case 4: SWAP_ROWS(uint32_t); break;
+      case 8: SWAP_ROWS(uint64_t); break;
+      default:
+	for (j = 0; j < n; j++)
+	  {
+	     unsigned char *p = a + j*sizeof_type;
+	     unsigned char *q = b + (reverse ? len-1-j : j)*sizeof_type;
+	     for (k = 0; k < sizeof_type; k++)
+	       {
+		  t = p[k]; p[k] = q[k]; q[k] = t;
+	       }
+	  }
+	break;
+     }
+}
+
+/* Reverse, in place, the dimensions of the contiguous array data whose
+ * stride is negative.  Each row, i.e., run along the last dimension, is
+ * exchanged with its mirror image in a single pass over the array.
+ */
+static void reverse_axes (unsigned char *data, size_t *count, ptrdiff_t *stride,
+			  unsigned int num_dims, size_t sizeof_type)
+{
+   size_t index[MAX_SLICE_DIMS], row_strides[MAX_SLICE_DIMS];
+   size_t len, row_bytes, num_rows, r, rr;
+   unsigned int i, last = num_dims - 1;
+   int reverse_rows;
+
+   len = count[last];
+   row_bytes = len * sizeof_type;
+   reverse_rows = (stride[last] < 0);
+
+   num_rows = 1;
+   i = last;
+   while (i > 0)
+     {
+	i--;
+	row_strides[i] = num_rows;
+	num_rows *= count[i];
+	index[i] = 0;
+     }
+   if ((num_rows == 0) || (len == 0))
+     return;
+
+   r = 0;
+   while (1)
+     {
+	rr = 0;
+	for (i = 0; i < last; i++)
+	  rr += ((stride[i] < 0) ? count[i] - 1 - index[i] : index[i]) * row_strides[i];
+
+	if ((rr > r) || ((rr == r) && reverse_rows))
+	  swap_rows (data + r*row_bytes, data + rr*row_bytes, len, sizeof_type, reverse_rows);
+
+	if (++r == num_rows)
+	  break;
+	i = last;
+	while (i > 0)
+	  {
+	     i--;
+	     if (++index[i] < count[i])
+	       break;
+	     index[i] = 0;
+	  }
+     }
+}
+
+/* Read the strided hyperslab into data, which is contiguous and has
+ * elements of the given type and size.  If the cost model favors it, the
+ * hyperslab is read via blocks of its enclosing hyperslab.  Otherwise the
+ * library is used.  Negative strides are supported by reading the mirrored
+ * hyperslab: the emulated read reverses the dimensions while subsampling,
+ * and the result of the library is reversed in place.
+ */
+static int read_strided_slab (int ncid, NCid_Var_Type *ncvar,
+			      size_t *start, size_t *count, ptrdiff_t *stride,
+			      SLtype sltype, size_t sizeof_type, VOID_STAR data)
+{
+   size_t bstart[MAX_SLICE_DIMS], bcount[MAX_SLICE_DIMS], fstart[MAX_SLICE_DIMS];
+   size_t index[MAX_SLICE_DIMS], out_strides[MAX_SLICE_DIMS], ocount[MAX_SLICE_DIMS];
+   ptrdiff_t fstride[MAX_SLICE_DIMS], bstrides[MAX_SLICE_DIMS];
+   size_t nsplit, m, num, ofs, j;
+   unsigned char *buf = NULL, *src;
+   unsigned int i, k, num_dims;
+   int is_strided = 0, is_reversed, status;
+   double overread;
+
+   num_dims = ncvar->num_dims;
+   for (i = 0; i < num_dims; i++)
+     {
+	if ((stride[i] == 0) || (count[i] == 0))
+	  return read_atomic_slab (ncid, ncvar->var_id, start, count, stride, NULL, sltype, data);
+     }
+
+   is_reversed = mirror_strides (num_dims, start, count, stride, fstart, fstride);
+   for (i = 0; i < num_dims; i++)
+     {
+	if (fstride[i] > 1)
+	  is_strided = 1;
+     }
+
+   status = 0;
+   if (is_strided)
+     {
+	overread = plan_strided_blocks (count, fstride, num_dims, sizeof_type,
+					Stride_Block_Bytes, &k, &nsplit);
+	status = use_emulated_stride (ncid, ncvar, fstride, overread);
+	if (status == -1)
+	  return -1;
+     }
+   if (status == 0)
+     {
+	if (-1 == read_atomic_slab (ncid, ncvar->var_id, fstart, count, fstride, NULL, sltype, data))
+	  return -1;
+	if (is_reversed)
+	  reverse_axes ((unsigned char *) data, count, stride, num_dims, sizeof_type);
+	return 0;
+     }
+
+   num = 1;
+   i = num_dims;
+   while (i > 0)
+     {
+	i--;
+	out_strides[i] = num;
+	num *= count[i];
+	index[i] = 0;
+	bstart[i] = fstart[i];
+	bcount[i] = (count[i] - 1) * fstride[i] + 1;
+     }
+   bcount[k] = (nsplit - 1) * fstride[k] + 1;
+   num = 1;
+   for (i = k; i < num_dims; i++)
+     num *= bcount[i];
+   if (NULL == (buf = (unsigned char *) SLmalloc (num * sizeof_type)))
+     return -1;
+
+   while (1)
+     {
+	m = count[k] - index[k];
+	if (m > nsplit) m = nsplit;
+
+	/* A block along a reversed dimension lands at the mirrored position */
+	ofs = 0;
+	for (i = 0; i <= k; i++)
+	  {
+	     bstart[i] = fstart[i] + index[i] * fstride[i];
+	     if (i < k) bcount[i] = 1;
+	     j = index[i];
+	     if (stride[i] < 0)
+	       j = count[i] - 1 - index[i] - ((i == k) ? m - 1 : 0);
+	     ofs += j * out_strides[i];
+	  }
+	bcount[k] = (m - 1) * fstride[k] + 1;
+
+	if (-1 == (status = read_atomic_slab (ncid, ncvar->var_id, bstart, bcount, NULL, NULL, sltype, buf)))
+	  break;
+
+	/* Subsample the block.  The output elements are contiguous since all
+	 * the indices of the dimensions after k are read.  Reversed dimensions
+	 * are traversed backwards from their last element.
+	 */
+	ocount[k] = m;
+	for (i = k + 1; i < num_dims; i++)
+	  ocount[i] = count[i];
+	src = buf;
+	num = 1;
+	i = num_dims;
+	while (i > k)
+	  {
+	     i--;
+	     bstrides[i] = (ptrdiff_t) num * fstride[i];
+	     if (stride[i] < 0)
+	       {
+		  src += (ptrdiff_t) (ocount[i] - 1) * bstrides[i] * (ptrdiff_t) sizeof_type;
+		  bstrides[i] = -bstrides[i];
+	       }
+	     num *= bcount[i];
+	  }
+	gather_strided ((unsigned char *) data + ofs * sizeof_type, src,
+			ocount + k, bstrides + k, num_dims - k, sizeof_type);
+
+	/* Move to the next block */
+	index[k] += m;
+	if (index[k] < count[k])
+	  continue;
+	index[k] = 0;
+	i = k;
+	while (i > 0)
+	  {
+	     i--;
+	     if (++index[i] < count[i])
+	       break;
+	     index[i] = 0;
+	  }
+	if ((i == 0) && (index[0] == 0))
+	  break;
+     }
+
+   SLfree ((char *) buf);
+   return status;
+}
+
+/* Usage: old_mode = _nc_set_stride_emulation (mode [, max_bytes])
+ * Select how strided hyperslabs are read: mode is -1 to always use the
+ * netCDF library, 1 to always read and subsample the enclosing hyperslab,
+ * or 0 to decide using a cost model (the default).  The optional max_bytes
+ * sets the size of the blocks of an emulated read, NULL restoring the
+ * default.  A small value makes a read span several blocks.
+ */
+static void sl_nc_set_stride_emulation (void)
+{
+   size_t max_bytes = Stride_Block_Bytes;
+   int mode, old_mode = Stride_Emulation;
+
+   if (SLang_Num_Function_Args == 2)
+     {
+	if (-1 == pop_max_bytes (&max_bytes))
+	  return;
+     }
+   else if (SLang_Num_Function_Args != 1)
+     {
+	SLang_verror (SL_Usage_Error, "Usage: old_mode = _nc_set_stride_emulation (mode [, max_bytes])");
+	return;
+     }
+   if (-1 == SLang_pop_int (&mode))
+     return;
+
+   Stride_Emulation = (mode > 0) ? 1 : ((mode < 0) ? -1 : 0);
+   Stride_Block_Bytes = max_bytes;
+   (void) SLang_push_int (old_mode);
+}
+
+/*}}}*/
+
+/*{{{ Transposed reads */
+
+/* Hyperslabs of at most this many bytes are permuted by the library via
+ * the imap argument of nc_get_varm.  The library then copies the values
+ * one at a time, which is slow for larger hyperslabs.
+ */
+#define MAX_VARM_TRANSPOSE_BYTES 0x10000
+
+/* The side of the square tiles of the transpose kernel */
+#define TRANSPOSE_TILE 32
+
+#define TRANSPOSE_TILE_COPY(type) \
+   { \
+      type *d_ = (type *) d, *s_ = (type *) s; \
+      for (i0 = 0; i0 < nq; i0 += TRANSPOSE_TILE) \
+	{ \
+	   i1 = (i0 + TRANSPOSE_TILE < nq) ? i0 + TRANSPOSE_TILE : nq; \
+	   for (j0 = 0; j0 < np; j0 += TRANSPOSE_TILE) \
+	     { \
+		j1 = (j0 + TRANSPOSE_TILE < np) ? j0 + TRANSPOSE_TILE : np; \
+		for (i = i0; i < i1; i++) \
+		  for (j = j0; j < j1; j++) \
+		    d_[i + j*dp] = s_[i*sq + j]; \
+	     } \
+	} \
+   }
+
+/* Copy the contiguous block src with dimensions count into dst, where
+ * dst_strides[i] is the offset in dst of a unit step along dimension i.
+ * The values are contiguous in src along the last dimension p, and in dst
+ * along dimension q.  If p and q differ, the plane that they span is
+ * copied in square tiles so that both the reads and the writes of a tile
+ * remain in the cache.
+ */
+static void scatter_transposed (unsigned char *dst, unsigned char *src, size_t *count,
+				size_t *dst_strides, unsigned int num_dims, unsigned int q,
+				size_t sizeof_type)
+{
+   size_t index[MAX_SLICE_DIMS], src_strides[MAX_SLICE_DIMS], ocount[MAX_SLICE_DIMS];
+   size_t np, nq, sq, dp, num, i, i0, i1, j, j0, j1;
+   unsigned int k, p = num_dims - 1;
+   unsigned char *s, *d;
+
+   num = 1;
+   k = num_dims;
+   while (k > 0)
+     {
+	k--;
+	src_strides[k] = num;
+	num *= count[k];
+	index[k] = 0;
+	ocount[k] = ((k == p) || (k == q)) ? 1 : count[k];
+     }
+   if (num == 0)
+     return;
+
+   np = count[p];
+   nq = count[q];
+   sq = src_strides[q];
+   dp = dst_strides[p];
+
+   while (1)
+     {
+	s = src;
+	d = dst;
+	for (k = 0; k < num_dims; k++)
+	  {
+	     s += index[k] * src_strides[k] * sizeof_type;
+	     d += index[k] * dst_strides[k] * sizeof_type;
+	  }
+
+	if (p == q)
+	  memcpy (d, s, np * sizeof_type);
+	else switch (sizeof_type)
+	  {
+	   case 1: TRANSPOSE_TILE_COPY(uint8_t); break;
+	   case 2: TRANSPOSE_TILE_COPY(uint16_t); break;
+	   case 4: TRANSPOSE_TILE_COPY(uint32_t); break;
+	   case 8: TRANSPOSE_TILE_COPY(uint64_t); break;
+	   default:
+	     for (i = 0; i < nq; i++)
+	       for (j = 0; j < np; j++)
+		 memcpy (d + (i + j*dp)*sizeof_type, s + (i*sq + j)*sizeof_type, sizeof_type);
+	     break;
+	  }
+
+	k = num_dims;
+	while (k > 0)
+	  {
+	     k--;
+	     if (++index[k] < ocount[k])
+	       break;
+	     index[k] = 0;
+	  }
+	if ((k == 0) && (index[0] == 0))
+	  break;
+     }
+}
+
+/* Read the hyperslab into data, where dst_strides[i] is the offset in data
+ * of a unit step along dimension i of the variable, and dimension q is the
+ * one that is contiguous in data.  A small hyperslab is permuted by the
+ * library.  Otherwise the hyperslab is read in blocks of bounded size,
+ * which are transposed into place.
+ */
+static int read_transposed_slab (int ncid, NCid_Var_Type *ncvar, Slice_Type *s,
+				 size_t *dst_strides, unsigned int q,
+				 SLtype sltype, size_t sizeof_type, VOID_STAR data)
+{
+   size_t bstart[MAX_SLICE_DIMS], bcount[MAX_SLICE_DIMS], index[MAX_SLICE_DIMS];
+   ptrdiff_t ones[MAX_SLICE_DIMS], imap[MAX_SLICE_DIMS];
+   size_t nsplit, m, num, ofs;
+   unsigned char *buf;
+   unsigned int i, k, num_dims = s->num_dims;
+   int is_reversed = 0, status;
+
+   for (i = 0; i < num_dims; i++)
+     {
+	ones[i] = 1;
+	imap[i] = (ptrdiff_t) dst_strides[i];
+	if (s->stride[i] < 0) is_reversed = 1;
+     }
+
+   if ((s->total * sizeof_type <= MAX_VARM_TRANSPOSE_BYTES) && (is_reversed == 0))
+     return read_atomic_slab (ncid, ncvar->var_id, s->start, s->count, s->stride, imap, sltype, data);
+
+   (void) plan_strided_blocks (s->count, ones, num_dims, sizeof_type,
+			       DEFAULT_MAX_BLOCK_BYTES, &k, &nsplit);
+   num = nsplit;
+   for (i = 0; i < num_dims; i++)
+     {
+	index[i] = 0;
+	bstart[i] = s->start[i];
+	bcount[i] = s->count[i];
+	if (i < k) bcount[i] = 1;
+	if (i > k) num *= s->count[i];
+     }
+   if (NULL == (buf = (unsigned char *) SLmalloc (num * sizeof_type)))
+     return -1;
+
+   while (1)
+     {
+	m = s->count[k] - index[k];
+	if (m > nsplit) m = nsplit;
+	bcount[k] = m;
+
+	ofs = 0;
+	for (i = 0; i <= k; i++)
+	  {
+	     bstart[i] = (size_t) ((ptrdiff_t) s->start[i] + (ptrdiff_t) index[i] * s->stride[i]);
+	     ofs += index[i] * dst_strides[i];
+	  }
+
+	if (-1 == (status = read_strided_slab (ncid, ncvar, bstart, bcount, s->stride,
+					       sltype, sizeof_type, buf)))
+	  break;
+	scatter_transposed ((unsigned char *) data + ofs * sizeof_type, buf, bcount,
+			    dst_strides, num_dims, q, sizeof_type);
+
+	/* Move to the next block */
+	index[k] += m;
+	if (index[k] < s->count[k])
+	  continue;
+	index[k] = 0;
+	i = k;
+	while (i > 0)
+	  {
+	     i--;
+	     if (++index[i] < s->count[i])
+	       break;
+	     index[i] = 0;
+	  }
+	if ((i == 0) && (index[0] == 0))
+	  break;
+     }
+
+   SLfree ((char *) buf);
+   return status;
+}
+
+/* Usage: x = _nc_get_ordered (start, count, stride, order, ncid, varid)
+ * Read the hyperslab with its dimensions permuted, such that dimension i
+ * of x is dimension order[i] of the variable.  Any of start, count, and
+ * stride may be NULL, as for _nc_get.
+ */
+static void sl_nc_get_ordered (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   Slice_Type slice;
+   SLindex_Type at_dims[SLARRAY_MAX_DIMS];
+   size_t dst_strides[MAX_SLICE_DIMS];
+   unsigned char seen[MAX_SLICE_DIMS];
+   SLang_Array_Type *at_order, *at = NULL;
+   unsigned int i, num_dims, q;
+   size_t num;
+   int *order, is_identity;
+   nc_type xtype;
+   SLtype sltype;
+
+   if (-1 == SLang_pop_array_of_type (&at_order, SLANG_INT_TYPE))
+     return;
+
+   if ((-1 == check_ncid_type (nc))
+       || (-1 == get_var_sltype (nc->ncid, ncvar, &xtype, &sltype)))
+     goto free_and_return;
+
+   if (ncvar->num_dims == 0)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_get_ordered: the variable is a scalar");
+	goto free_and_return;
+     }
+   if (sltype == SLANG_STRUCT_TYPE)
+     {
+	SLang_verror (SL_NotImplemented_Error, "_nc_get_ordered: compound types are not supported");
+	goto free_and_return;
+     }
+   if (-1 == pop_slice (nc, ncvar, 1, NULL, &slice))
+     goto free_and_return;
+
+   num_dims = slice.num_dims;
+   if (num_dims > SLARRAY_MAX_DIMS)
+     {
+	SLang_verror (SL_LimitExceeded_Error, "slang arrays are currently limited to %d dimensions.  The netcdf variable has %d dimensions",
+		      SLARRAY_MAX_DIMS, num_dims);
+	goto free_and_return;
+     }
+
+   /* The order must be a permutation of the dimensions */
+   order = (int *) at_order->data;
+   memset ((char *) seen, 0, num_dims);
+   for (i = 0; i < at_order->num_elements; i++)
+     {
+	if ((at_order->num_elements != num_dims)
+	    || (order[i] < 0) || ((unsigned int) order[i] >= num_dims)
+	    || seen[order[i]])
+	  {
+	     SLang_verror (SL_InvalidParm_Error, "_nc_get_ordered: the order must list each of the %u dimensions of the variable once", num_dims);
+	     goto free_and_return;
+	  }
+	seen[order[i]] = 1;
+     }
+
+   /* Dimension i of the result is dimension order[i] of the hyperslab */
+   num = 1;
+   is_identity = 1;
+   i = num_dims;
+   while (i > 0)
+     {
+	i--;
+	at_dims[i] = slice.count[order[i]];
+	dst_strides[order[i]] = num;
+	num *= slice.count[order[i]];
+	if ((unsigned int) order[i] != i) is_identity = 0;
+     }
+   q = order[num_dims-1];
+
+   if (NULL == (at = SLang_create_array (sltype, 0, NULL, at_dims, num_dims)))
+     goto free_and_return;
+
+   if (slice.total != 0)
+     {
+	if (is_identity)
+	  {
+	     if (-1 == read_vars_into_array (nc->ncid, ncvar, xtype, slice.start, slice.count,
+					     (slice.has_stride ? slice.stride : NULL), at))
+	       goto free_and_return;
+	  }
+	else if (-1 == read_transposed_slab (nc->ncid, ncvar, &slice, dst_strides, q,
+					     sltype, at->sizeof_type, at->data))
+	  goto free_and_return;
+     }
+
+   (void) SLang_push_array (at, 0);
+   /* drop */
+free_and_return:
+   SLang_free_array (at);	       /* NULL ok */
+   SLang_free_array (at_order);
+}
+
+/*}}}*/
+
+/*{{{ Variable proxies */
+
+/* A proxy is returned by the .var method.  It refers to a variable and
+ * its parent file or group, and supports indexing via the array-get and
+ * array-put class hooks, which read or write a single hyperslab.
+ */
+static int NCid_Proxy_Type_Id = 0;
+typedef struct
+{
+   NCid_Type *nc;
+   NCid_Var_Type *ncvar;
+   unsigned int numrefs;
+}
+NCid_Proxy_Type;
+
+static void free_ncid_proxy_type (NCid_Proxy_Type *p)
+{
+   if (p == NULL) return;
+   if (p->numrefs > 1)
+     {
+	p->numrefs--;
+	return;
+     }
+   free_ncid_var_type (p->ncvar);
+   free_ncid_type (p->nc);
+   SLfree ((char *) p);
+}
+
+static int push_ncid_proxy_type (NCid_Proxy_Type *p)
+{
+   p->numrefs++;
+   if (0 == SLclass_push_ptr_obj (NCid_Proxy_Type_Id, (VOID_STAR) p))
+     return 0;
+   p->numrefs--;
+   return -1;
+}
+
+/* Usage: v = _nc_var_proxy (ncid, varid) */
+static void sl_nc_var_proxy (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   NCid_Proxy_Type *p;
+
+   if ((-1 == check_ncid_type (nc))
+       || (-1 == update_var_cache (nc->ncid, ncvar)))
+     return;
+
+   if (ncvar->num_dims == 0)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_var_proxy: the variable is a scalar");
+	return;
+     }
+   if (ncvar->num_dims > SLARRAY_MAX_DIMS)
+     {
+	SLang_verror (SL_LimitExceeded_Error, "slang arrays are currently limited to %d dimensions.  The netcdf variable has %d dimensions",
+		      SLARRAY_MAX_DIMS, ncvar->num_dims);
+	return;
+     }
+
+   if (NULL == (p = (NCid_Proxy_Type *) SLcalloc (1, sizeof (NCid_Proxy_Type))))
+     return;
+   p->numrefs = 1;
+   p->nc = nc;
+   nc->numrefs++;
+   p->ncvar = ncvar;
+   ncvar->numrefs++;
+
+   (void) push_ncid_proxy_type (p);
+   free_ncid_proxy_type (p);
+}
+
+static int get_index_value (SLang_Array_Type *at, SLindex_Type i, SLindex_Type *valp)
+{
+   if ((at->flags & SLARR_DATA_VALUE_IS_RANGE) == 0)
+     {
+	*valp = ((SLindex_Type *) at->data)[i];
+	return 0;
+     }
+   return SLang_get_array_element (at, &i, (VOID_STAR) valp);
+}
+
+/* Pop the index of dimension i of the proxy and map it to the start, count,
+ * and stride of the hyperslab.  The index may be an integer, which does
+ * not contribute a dimension to the result, or a range or an array of
+ * evenly spaced integers.  Negative values are taken relative to the end
+ * of the dimension.  A range with an open end, such as * or [i:], extends
+ * to the end of the dimension.
+ */
+static int pop_proxy_index (NCid_Var_Type *ncvar, unsigned int i, Slice_Type *s, int *is_scalarp)
+{
+   SLang_Array_Type *at;
+   SLindex_Type n, k, first, next, delta, len;
+   SLindex_Type zero = 0, one = 1;
+
+   len = (SLindex_Type) ncvar->shape[i];
+   *is_scalarp = 0;
+
+   if (SLang_peek_at_stack () != SLANG_ARRAY_TYPE)
+     {
+	if (-1 == SLang_pop_array_index (&first))
+	  return -1;
+	if (first < 0) first += len;
+	if (first < 0)
+	  {
+	     SLang_verror (SL_Index_Error, "Invalid negative index");
+	     return -1;
+	  }
+	s->start[i] = (size_t) first;
+	s->count[i] = 1;
+	s->stride[i] = 1;
+	*is_scalarp = 1;
+	return 0;
+     }
+
+   if (-1 == SLang_pop_array_of_type (&at, SLANG_ARRAY_INDEX_TYPE))
+     return -1;
+
+   n = (SLindex_Type) at->num_elements;
+   s->stride[i] = 1;
+   if ((n == 0) && (at->flags & SLARR_DATA_VALUE_IS_RANGE))
+     {
+	/* The elements of an open range are generated from its start */
+	first = *(SLindex_Type *) (*at->index_fun)(at, &zero);
+	delta = *(SLindex_Type *) (*at->index_fun)(at, &one) - first;
+	SLang_free_array (at);
+	if (first < 0) first += len;
+	if ((first < 0) || (delta == 0))
+	  goto return_index_error;
+	s->start[i] = (size_t) first;
+	s->stride[i] = delta;
+	if (delta > 0)
+	  s->count[i] = (first < len) ? (size_t) ((len - 1 - first) / delta + 1) : 0;
+	else
+	  s->count[i] = (first < len) ? (size_t) (first / (-delta) + 1) : 0;
+	return 0;
+     }
+
+   s->start[i] = 0;
+   s->count[i] = (size_t) n;
+   if (n == 0)
+     {
+	SLang_free_array (at);
+	return 0;
+     }
+
+   delta = 1;
+   if ((-1 == get_index_value (at, 0, &first))
+       || ((n > 1) && (-1 == get_index_value (at, 1, &next))))
+     goto return_error;
+   if (first < 0) first += len;
+   if (n > 1)
+     {
+	if (next < 0) next += len;
+	delta = next - first;
+     }
+   if ((first < 0) || (delta == 0))
+     goto return_index_error;
+
+   /* Only evenly spaced indices form a hyperslab */
+   for (k = 2; k < n; k++)
+     {
+	if (-1 == get_index_value (at, k, &next))
+	  goto return_error;
+	if (next < 0) next += len;
+	if (next != first + k*delta)
+	  {
+	     SLang_verror (SL_NotImplemented_Error, "The indices of dimension %u are not evenly spaced; use the .get_slices method", i);
+	     goto return_error;
+	  }
+     }
+   SLang_free_array (at);
+   s->start[i] = (size_t) first;
+   s->stride[i] = delta;
+   return 0;
+
+return_index_error:
+   SLang_verror (SL_Index_Error, "Invalid index for dimension %u", i);
+return_error:
+   SLang_free_array (at);	       /* NULL ok */
+   return -1;
+}
+
+/* Pop the proxy and its num_indices indices, and compute the hyperslab.
+ * The dimensions of the result, which exclude those indexed by integers,
+ * are returned in dims.
+ */
+static int pop_proxy_slice (SLtype type, unsigned int num_indices, int is_read,
+			    NCid_Proxy_Type **pp, Slice_Type *s,
+			    SLindex_Type *dims, unsigned int *num_out_dimsp)
+{
+   NCid_Proxy_Type *p;
+   NCid_Var_Type *ncvar;
+   unsigned int i, j, num_dims;
+   int is_scalar[SLARRAY_MAX_DIMS];
+
+   *pp = NULL;
+   if (-1 == SLclass_pop_ptr_obj (type, (VOID_STAR *) &p))
+     return -1;
+   *pp = p;
+   ncvar = p->ncvar;
+
+   if ((-1 == check_ncid_type (p->nc))
+       || (-1 == update_var_cache (p->nc->ncid, ncvar)))
+     return -1;
+
+   num_dims = ncvar->num_dims;
+   if (num_indices != num_dims)
+     {
+	SLang_verror (SL_InvalidParm_Error, "The netcdf variable requires %u indices", num_dims);
+	return -1;
+     }
+
+   /* The index of the last dimension is on the top of the stack */
+   s->num_dims = num_dims;
+   s->count_given = 1;
+   s->has_stride = 0;
+   i = num_dims;
+   while (i > 0)
+     {
+	i--;
+	if (-1 == pop_proxy_index (ncvar, i, s, is_scalar + i))
+	  return -1;
+	if (s->stride[i] != 1) s->has_stride = 1;
+     }
+
+   if (-1 == check_slice (ncvar, is_read, s->start, s->count, s->stride, &s->total))
+     return -1;
+
+   j = 0;
+   for (i = 0; i < num_dims; i++)
+     {
+	if (is_scalar[i] == 0)
+	  dims[j++] = (SLindex_Type) s->count[i];
+     }
+   *num_out_dimsp = j;
+   return 0;
+}
+
+static int cl_ncid_proxy_aget (SLtype type, unsigned int num_indices)
+{
+   NCid_Proxy_Type *p;
+   Slice_Type slice;
+   SLindex_Type dims[SLARRAY_MAX_DIMS];
+   SLang_Array_Type *at = NULL;
+   unsigned int num_out_dims;
+   nc_type xtype;
+   SLtype sltype;
+   int status = -1;
+
+   if ((-1 == pop_proxy_slice (type, num_indices, 1, &p, &slice, dims, &num_out_dims))
+       || (-1 == get_var_sltype (p->nc->ncid, p->ncvar, &xtype, &sltype)))
+     goto free_and_return;
+
+   if (num_out_dims == 0)
+     {
+	dims[0] = 1;
+	if (NULL == (at = SLang_create_array (sltype, 0, NULL, dims, 1)))
+	  goto free_and_return;
+     }
+   else if (NULL == (at = SLang_create_array (sltype, 0, NULL, dims, num_out_dims)))
+     goto free_and_return;
+
+   if ((slice.total != 0)
+       && (-1 == read_vars_into_array (p->nc->ncid, p->ncvar, xtype, slice.start, slice.count,
+				       (slice.has_stride ? slice.stride : NULL), at)))
+     goto free_and_return;
+
+   if (num_out_dims == 0)
+     status = SLang_push_value (at->data_type, at->data);
+   else
+     status = SLang_push_array (at, 0);
+   /* drop */
+free_and_return:
+   SLang_free_array (at);	       /* NULL ok */
+   free_ncid_proxy_type (p);	       /* NULL ok */
+   return status;
+}
+
+static int cl_ncid_proxy_aput (SLtype type, unsigned int num_indices)
+{
+   NCid_Proxy_Type *p;
+   Slice_Type slice;
+   SLindex_Type dims[SLARRAY_MAX_DIMS];
+   SLang_Array_Type *at = NULL, *bt;
+   size_t fstart[MAX_SLICE_DIMS];
+   ptrdiff_t fstride[MAX_SLICE_DIMS];
+   unsigned int num_out_dims;
+   SLuindex_Type k;
+   int status = -1;
+
+   if ((-1 == pop_proxy_slice (type, num_indices, 0, &p, &slice, dims, &num_out_dims))
+       || (-1 == SLang_pop_array (&at, 1)))
+     goto free_and_return;
+
+   /* A single numeric value is written to each element of the hyperslab */
+   if ((at->num_elements == 1) && (slice.total > 1)
+       && (at->data_type != SLANG_STRUCT_TYPE) && (at->data_type != SLANG_STRING_TYPE))
+     {
+	dims[0] = (SLindex_Type) slice.total;
+	if (NULL == (bt = SLang_create_array (at->data_type, 0, NULL, dims, 1)))
+	  goto free_and_return;
+	for (k = 0; k < bt->num_elements; k++)
+	  memcpy ((char *) bt->data + k*bt->sizeof_type, at->data, bt->sizeof_type);
+	SLang_free_array (at);
+	at = bt;
+     }
+
+   if (slice.total != at->num_elements)
+     {
+	SLang_verror (SL_InvalidParm_Error, "The index is inconsistent with the provided array: %lu values provided, %lu expected",
+		      (unsigned long) at->num_elements, (unsigned long) slice.total);
+	goto free_and_return;
+     }
+   if (slice.total == 0)
+     {
+	status = 0;
+	goto free_and_return;
+     }
+
+   /* The library does not accept negative strides.  The values are
+    * reversed into a copy and written to the mirrored hyperslab.
+    */
+   if (slice.has_stride
+       && mirror_strides (slice.num_dims, slice.start, slice.count, slice.stride, fstart, fstride))
+     {
+	if (NULL == (bt = SLang_duplicate_array (at)))
+	  goto free_and_return;
+	SLang_free_array (at);
+	at = bt;
+	reverse_axes ((unsigned char *) at->data, slice.count, slice.stride, slice.num_dims, at->sizeof_type);
+	status = write_vars_from_array (p->nc->ncid, p->ncvar, fstart, slice.count, fstride, at);
+	goto free_and_return;
+     }
+
+   status = write_vars_from_array (p->nc->ncid, p->ncvar, slice.start, slice.count,
+				   (slice.has_stride ? slice.stride : NULL), at);
+   /* drop */
+free_and_return:
+   SLang_free_array (at);	       /* NULL ok */
+   free_ncid_proxy_type (p);	       /* NULL ok */
+   return status;
+}
+
+/*}}}*/
+
+/*{{{ Point access */
+
+typedef struct
+{
+   size_t block;		       /* linear index of the enclosing block */
+   size_t index;		       /* index of the point */
+}
+Point_Order_Type;
+
+static int compare_point_order (const void *a, const void *b)
+{
+   const Point_Order_Type *pa = (const Point_Order_Type *)a;
+   const Point_Order_Type *pb = (const Point_Order_Type *)b;
+
+   if (pa->block != pb->block)
+     return (pa->block < pb->block) ? -1 : 1;
+   if (pa->index == pb->index) return 0;
+   return (pa->index < pb->index) ? -1 : 1;
+}
+
+/* Convert the [npoints, num_dims] matrix of indices to size_t, wrapping
+ * negative indices, and sort the points by the block containing them.
+ * For reads, all indices must lie within the variable; for writes, the
+ * indices of an unlimited dimension may exceed its current length.
+ */
+static int sort_points_by_block (NCid_Var_Type *ncvar, int is_read,
+				 SLang_Array_Type *at, size_t npoints, size_t *block,
+				 size_t **pointsp, Point_Order_Type **orderp)
+{
+   Point_Order_Type *order = NULL;
+   size_t *points = NULL;
+   ptrdiff_t *idx = (ptrdiff_t *) at->data;
+   size_t extent[MAX_SLICE_DIMS], block_stride[MAX_SLICE_DIMS];
+   size_t p, nblocks;
+   unsigned int i, num_dims = ncvar->num_dims;
+
+   *pointsp = NULL;
+   *orderp = NULL;
+
+   if ((NULL == (points = (size_t *) SLmalloc ((npoints*num_dims + 1) * sizeof (size_t))))
+       || (NULL == (order = (Point_Order_Type *) SLmalloc ((npoints + 1) * sizeof (Point_Order_Type)))))
+     goto return_error;
+
+   for (i = 0; i < num_dims; i++)
+     extent[i] = ncvar->shape[i];
+
+   for (p = 0; p < npoints*num_dims; p += num_dims)
+     {
+	for (i = 0; i < num_dims; i++)
+	  {
+	     ptrdiff_t j = idx[p + i];
+	     size_t len = ncvar->shape[i];
+
+	     if (j < 0)
+	       j += (ptrdiff_t) len;
+	     if ((j < 0)
+		 || ((j >= (ptrdiff_t) len)
+		     && (is_read || (0 == ncvar->is_unlimited[i]))))
+	       {
+		  SLang_verror (SL_Index_Error, "Point index %ld is out of range for dimension %u",
+				(long) idx[p + i], i);
+		  goto return_error;
+	       }
+	     points[p + i] = (size_t) j;
+	     if ((size_t) j >= extent[i])
+	       extent[i] = j + 1;
+	  }
+     }
+
+   nblocks = 1;
+   i = num_dims;
+   while (i > 0)
+     {
+	i--;
+	block_stride[i] = nblocks;
+	nblocks *= (extent[i] + block[i] - 1) / block[i];
+     }
+
+   for (p = 0; p < npoints; p++)
+     {
+	size_t *point = points + p*num_dims;
+	size_t b = 0;
+
+	for (i = 0; i < num_dims; i++)
+	  b += (point[i] / block[i]) * block_stride[i];
+	order[p].block = b;
+	order[p].index = p;
+     }
+   qsort (order, npoints, sizeof (Point_Order_Type), compare_point_order);
+
+   *pointsp = points;
+   *orderp = order;
+   return 0;
+
+return_error:
+   SLfree ((char *) points);	       /* NULL ok */
+   SLfree ((char *) order);	       /* NULL ok */
+   return -1;
+}
+
+/* Compute the bounding box of the points order[p..] that lie in the same
+ * block.  The index one past the last such point is returned.
+ */
+static size_t get_block_bounding_box (Point_Order_Type *order, size_t p, size_t npoints,
+				      size_t *points, unsigned int num_dims,
+				      size_t *start, size_t *count)
+{
+   size_t *point, q;
+   unsigned int i;
+
+   point = points + order[p].index*num_dims;
+   for (i = 0; i < num_dims; i++)
+     {
+	start[i] = point[i];
+	count[i] = point[i];	       /* last index for now */
+     }
+
+   for (q = p + 1; (q < npoints) && (order[q].block == order[p].block); q++)
+     {
+	point = points + order[q].index*num_dims;
+	for (i = 0; i < num_dims; i++)
+	  {
+	     if (point[i] < start[i]) start[i] = point[i];
+	     if (point[i] > count[i]) count[i] = point[i];
+	  }
+     }
+
+   for (i = 0; i < num_dims; i++)
+     count[i] = count[i] - start[i] + 1;
+   return q;
+}
+
+/* If the bounding box of a group of points has more than this many
+ * elements per point, the points are accessed one at a time instead.
+ */
+#define MAX_BOX_ELEMENTS_PER_POINT 512
+
+static int is_sparse_box (size_t num_points, size_t *count, unsigned int num_dims)
+{
+   size_t num = 1;
+   unsigned int i;
+
+   for (i = 0; i < num_dims; i++)
+     num *= count[i];
+   return (num / MAX_BOX_ELEMENTS_PER_POINT > num_points);
+}
+
+/* Get the offset of the point within the row-major box */
+static size_t get_point_box_offset (size_t *point, size_t *start, size_t *count,
+				    unsigned int num_dims)
+{
+   size_t ofs = 0;
+   unsigned int i;
+
+   for (i = 0; i < num_dims; i++)
+     ofs = ofs * count[i] + (point[i] - start[i]);
+   return ofs;
+}
+
+/* Usage: values = _nc_get_points (indices, max_bytes, ncid, varid)
+ * Here indices is an [npoints, ndims] array, and max_bytes is the memory
+ * budget of the read buffer, or NULL for the default.  The points are
+ * grouped by the block that contains them, where the blocks are aligned
+ * with the chunks of the variable (see plan_blocks).  The bounding box of
+ * the points in each block is read in a single call, unless it is sparse,
+ * and the values are scattered into a 1-d array in the original order of
+ * the points.
+ */
+static void sl_nc_get_points (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   SLang_Array_Type *at_indices = NULL, *at = NULL;
+   Point_Order_Type *order = NULL;
+   size_t *points = NULL;
+   unsigned char *buf = NULL, *data;
+   size_t block[MAX_SLICE_DIMS], start[MAX_SLICE_DIMS], count[MAX_SLICE_DIMS];
+   ptrdiff_t ones[MAX_SLICE_DIMS];
+   size_t max_bytes, npoints, sizeof_type, num, p, q;
+   unsigned int i, num_dims;
+   SLindex_Type dims;
+   nc_type xtype;
+   SLtype sltype;
+   int ncid;
+
+   if ((-1 == check_ncid_type (nc))
+       || (-1 == get_var_sltype (nc->ncid, ncvar, &xtype, &sltype)))
+     return;
+
+   ncid = nc->ncid;
+   num_dims = ncvar->num_dims;
+   if (num_dims == 0)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_get_points: the variable is a scalar");
+	return;
+     }
+   if (sltype == SLANG_STRUCT_TYPE)
+     {
+	SLang_verror (SL_NotImplemented_Error, "_nc_get_points: compound types are not supported");
+	return;
+     }
+
+   if ((-1 == pop_max_bytes (&max_bytes))
+       || (-1 == pop_row_matrix (&at_indices, _SL_PTRDIFF_T_TYPE, num_dims, 0, &npoints)))
+     return;
+
+   dims = (SLindex_Type) npoints;
+   if (NULL == (at = SLang_create_array (sltype, 0, NULL, &dims, 1)))
+     goto free_and_return;
+   sizeof_type = at->sizeof_type;
+
+   if ((-1 == plan_blocks (ncid, ncvar, sizeof_type, max_bytes, 0, block))
+       || (-1 == sort_points_by_block (ncvar, 1, at_indices, npoints, block, &points, &order)))
+     goto free_and_return;
+
+   num = 1;
+   for (i = 0; i < num_dims; i++)
+     {
+	num *= block[i];
+	ones[i] = 1;
+     }
+   if ((npoints != 0)
+       && (NULL == (buf = (unsigned char *) SLmalloc (num * sizeof_type))))
+     goto free_and_return;
+
+   data = (unsigned char *) at->data;
+   p = 0;
+   while (p < npoints)
+     {
+	q = get_block_bounding_box (order, p, npoints, points, num_dims, start, count);
+	if (is_sparse_box (q - p, count, num_dims))
+	  {
+	     for (i = 0; i < num_dims; i++)
+	       count[i] = 1;
+	     while (p < q)
+	       {
+		  size_t k = order[p].index;
+		  if (-1 == read_atomic_slab (ncid, ncvar->var_id, points + k*num_dims, count, ones,
+					      NULL, sltype, data + k*sizeof_type))
+		    goto free_and_return;
+		  p++;
+	       }
+	     continue;
+	  }
+	if (-1 == read_atomic_slab (ncid, ncvar->var_id, start, count, ones, NULL, sltype, buf))
+	  goto free_and_return;
+
+	while (p < q)
+	  {
+	     size_t k = order[p].index;
+	     size_t ofs = get_point_box_offset (points + k*num_dims, start, count, num_dims);
+	     memcpy (data + k*sizeof_type, buf + ofs*sizeof_type, sizeof_type);
+	     p++;
+	  }
+     }
+
+   (void) SLang_push_array (at, 0);
+   /* drop */
+free_and_return:
+   SLang_free_array (at);	       /* NULL ok */
+   SLang_free_array (at_indices);      /* NULL ok */
+   SLfree ((char *) buf);	       /* NULL ok */
+   SLfree ((char *) points);	       /* NULL ok */
+   SLfree ((char *) order);	       /* NULL ok */
+}
+
+/* Return 1 if the points order[p..q-1] cover every element of the box.
+ * The flags buffer must have room for one byte per element of the box.
+ */
+static int points_cover_box (Point_Order_Type *order, size_t p, size_t q, size_t *points,
+			     unsigned int num_dims, size_t *start, size_t *count,
+			     unsigned char *flags)
+{
+   size_t num, num_set;
+   unsigned int i;
+
+   num = 1;
+   for (i = 0; i < num_dims; i++)
+     num *= count[i];
+   if (q - p < num)
+     return 0;
+
+   memset (flags, 0, num);
+   num_set = 0;
+   while (p < q)
+     {
+	size_t ofs = get_point_box_offset (points + order[p].index*num_dims, start, count, num_dims);
+	if (flags[ofs] == 0)
+	  {
+	     flags[ofs] = 1;
+	     num_set++;
+	  }
+	p++;
+     }
+   return (num_set == num);
+}
+
+/* Usage: _nc_put_points (indices, values, max_bytes, ncid, varid)
+ * Here indices is an [npoints, ndims] array, and values is an array of
+ * npoints values or a single value to be written to every point.  The
+ * points are grouped as for _nc_get_points, and the bounding box of the
+ * points in a block is updated by reading it, setting the values of the
+ * points, and writing it back.  The read is omitted when the points cover
+ * the entire box.  If a point occurs more than once, the last value is
+ * written.  The points of sparse boxes, and of boxes that extend past the
+ * end of an unlimited dimension and so cannot be read, are written one at
+ * a time.
+ */
+static void sl_nc_put_points (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   SLang_Array_Type *at_indices = NULL, *at = NULL;
+   Point_Order_Type *order = NULL;
+   size_t *points = NULL;
+   unsigned char *buf = NULL, *flags = NULL, *data;
+   size_t block[MAX_SLICE_DIMS], start[MAX_SLICE_DIMS], count[MAX_SLICE_DIMS];
+   size_t max_bytes, npoints, sizeof_type, num, p, q, k, ofs;
+   unsigned int i, num_dims;
+   nc_type xtype;
+   SLtype sltype;
+   int ncid, is_scalar;
+
+   if ((-1 == check_ncid_type (nc))
+       || (-1 == get_var_sltype (nc->ncid, ncvar, &xtype, &sltype)))
+     return;
+
+   ncid = nc->ncid;
+   num_dims = ncvar->num_dims;
+   if (num_dims == 0)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_put_points: the variable is a scalar");
+	return;
+     }
+   if (sltype == SLANG_STRUCT_TYPE)
+     {
+	SLang_verror (SL_NotImplemented_Error, "_nc_put_points: compound types are not supported");
+	return;
+     }
+
+   if (-1 == pop_max_bytes (&max_bytes))
+     return;
+   is_scalar = (SLang_peek_at_stack () != SLANG_ARRAY_TYPE);
+   if (-1 == SLang_pop_array_of_type (&at, sltype))
+     return;
+   if (-1 == pop_row_matrix (&at_indices, _SL_PTRDIFF_T_TYPE, num_dims, 0, &npoints))
+     goto free_and_return;
+
+   if ((is_scalar == 0) && (at->num_elements != npoints))
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_put_points: expected %lu values, found %lu",
+		      (unsigned long) npoints, (unsigned long) at->num_elements);
+	goto free_and_return;
+     }
+   sizeof_type = at->sizeof_type;
+
+   if ((-1 == plan_blocks (ncid, ncvar, sizeof_type, max_bytes, 0, block))
+       || (-1 == sort_points_by_block (ncvar, 0, at_indices, npoints, block, &points, &order)))
+     goto free_and_return;
+
+   num = 1;
+   for (i = 0; i < num_dims; i++)
+     num *= block[i];
+   if ((npoints != 0)
+       && ((NULL == (buf = (unsigned char *) SLmalloc (num * sizeof_type)))
+	   || (NULL == (flags = (unsigned char *) SLmalloc (num)))))
+     goto free_and_return;
+
+   data = (unsigned char *) at->data;
+   p = 0;
+   while (p < npoints)
+     {
+	int in_range = 1;
+
+	q = get_block_bounding_box (order, p, npoints, points, num_dims, start, count);
+	for (i = 0; i < num_dims; i++)
+	  {
+	     if (start[i] + count[i] > ncvar->shape[i])
+	       in_range = 0;
+	  }
+
+	if (0 == points_cover_box (order, p, q, points, num_dims, start, count, flags))
+	  {
+	     if ((in_range == 0) || is_sparse_box (q - p, count, num_dims))
+	       {
+		  /* Write the points of the block individually */
+		  for (i = 0; i < num_dims; i++)
+		    count[i] = 1;
+		  while (p < q)
+		    {
+		       k = order[p].index;
+		       if (-1 == write_atomic_slab (ncid, ncvar->var_id, points + k*num_dims, count,
+						    NULL, NULL, sltype, data + (is_scalar ? 0 : k*sizeof_type)))
+			 goto free_and_return;
+		       note_var_write (ncid, ncvar, points + k*num_dims, count, NULL);
+		       p++;
+		    }
+		  continue;
+	       }
+	     if (-1 == read_atomic_slab (ncid, ncvar->var_id, start, count, NULL, NULL, sltype, buf))
+	       goto free_and_return;
+	  }
+
+	while (p < q)
+	  {
+	     k = order[p].index;
+	     ofs = get_point_box_offset (points + k*num_dims, start, count, num_dims);
+	     memcpy (buf + ofs*sizeof_type, data + (is_scalar ? 0 : k*sizeof_type), sizeof_type);
+	     p++;
+	  }
+
+	if (-1 == write_atomic_slab (ncid, ncvar->var_id, start, count, NULL, NULL, sltype, buf))
+	  goto free_and_return;
+	note_var_write (ncid, ncvar, start, count, NULL);
+     }
+
+free_and_return:
+   SLang_free_array (at);	       /* NULL ok */
+   SLang_free_array (at_indices);      /* NULL ok */
+   SLfree ((char *) flags);	       /* NULL ok */
+   SLfree ((char *) buf);	       /* NULL ok */
+   SLfree ((char *) points);	       /* NULL ok */
+   SLfree ((char *) order);	       /* NULL ok */
+}
+
+/*}}}*/
+
+/*{{{ Reductions */
+
+#define REDUCE_COUNT	0
+#define REDUCE_SUM	1
+#define REDUCE_MEAN	2
+#define REDUCE_MIN	3
+#define REDUCE_MAX	4
+#define REDUCE_VAR	5
+
+static const char *Reduce_Op_Names[] =
+{
+   "count", "sum", "mean", "min", "max", "var", NULL
+};
+
+/* The running state of a reduction.  Each output element has an
+ * accumulator in each of the arrays acc0 and acc1, and a count of the valid
+ * input values in num.  The meaning of the accumulators depends upon op:
+ *
+ *   REDUCE_SUM, REDUCE_MEAN:  acc0 = sum, acc1 = Neumaier compensation
+ *   REDUCE_MIN, REDUCE_MAX:   acc0 = extreme value
+ *   REDUCE_VAR:               acc0 = mean, acc1 = sum of squared deviations
+ */
+typedef struct
+{
+   int op;
+   int have_fill;
+   double fill;
+   size_t num_out;
+   double *acc0, *acc1, *num;
+}
+Reduce_Type;
+
+#define IS_MISSING(r, x) (((x) != (x)) || ((r)->have_fill && ((x) == (r)->fill)))
+
+/* Add x to the compensated sum (*s, *c) using the Neumaier variant of the
+ * Kahan algorithm.
+ */
+#define NEUMAIER_ADD(s, c, x) \
+   do { \
+      double t_ = (s) + (x); \
+      if (fabs (s) >= fabs (x)) (c) += ((s) - t_) + (x); \
+      else (c) += ((x) - t_) + (s); \
+      (s) = t_; \
+   } while (0)
+
+/* Reduce the len values of x.  If ostep is 0, the values all contribute to
+ * the output element o.  Otherwise ostep is 1 and x[j] contributes to the
+ * output element o+j.  The loops of the latter case carry no dependencies
+ * from one iteration to the next, which permits the compiler to vectorize
+ * them.
+ */
+static void reduce_row (Reduce_Type *r, double *x, size_t len, size_t o, size_t ostep)
+{
+   double *acc0 = r->acc0 + o, *acc1 = r->acc1 + o, *num = r->num + o;
+   double s, c, n, m, d;
+   size_t j;
+
+   if (ostep == 0)
+     {
+	n = 0;
+	switch (r->op)
+	  {
+	   case REDUCE_COUNT:
+	     for (j = 0; j < len; j++)
+	       n += (IS_MISSING(r, x[j]) == 0);
+	     break;
+
+	   case REDUCE_SUM:
+	   case REDUCE_MEAN:
+	     s = 0; c = 0;
+	     for (j = 0; j < len; j++)
+	       {
+		  if (IS_MISSING(r, x[j])) continue;
+		  NEUMAIER_ADD(s, c, x[j]);
+		  n++;
+	       }
+	     NEUMAIER_ADD(*acc0, *acc1, s);
+	     *acc1 += c;
+	     break;
+
+	   case REDUCE_MIN:
+	   case REDUCE_MAX:
+	     m = *acc0;
+	     for (j = 0; j < len; j++)
+	       {
+		  if (IS_MISSING(r, x[j])) continue;
+		  if ((n + *num == 0)
+		      || ((r->op == REDUCE_MIN) ? (x[j] < m) : (x[j] > m)))
+		    m = x[j];
+		  n++;
+	       }
+	     *acc0 = m;
+	     break;
+
+	   case REDUCE_VAR:
+	     /* Accumulate the row using Welford's algorithm and merge
+	      * the result using the pairwise update of Chan et al.
+	      */
+	     m = 0; s = 0;
+	     for (j = 0; j < len; j++)
+	       {
+		  if (IS_MISSING(r, x[j])) continue;
+		  n++;
+		  d = x[j] - m;
+		  m += d/n;
+		  s += d*(x[j] - m);
+	       }
+	     if (n > 0)
+	       {
+		  double na = *num, nn = na + n;
+		  d = m - *acc0;
+		  *acc0 += d*(n/nn);
+		  *acc1 += s + d*d*(na*n/nn);
+	       }
+	     break;
+	  }
+	*num += n;
+	return;
+     }
+
+   switch (r->op)
+     {
+      case REDUCE_COUNT:
+	for (j = 0; j < len; j++)
+	  num[j] += (IS_MISSING(r, x[j]) == 0);
+	break;
+
+      case REDUCE_SUM:
+      case REDUCE_MEAN:
+	for (j = 0; j < len; j++)
+	  {
+	     if (IS_MISSING(r, x[j])) continue;
+	     NEUMAIER_ADD(acc0[j], acc1[j], x[j]);
+	     num[j] += 1;
+	  }
+	break;
+
+      case REDUCE_MIN:
+	for (j = 0; j < len; j++)
+	  {
+	     if (IS_MISSING(r, x[j])) continue;
+	     if ((num[j] == 0) || (x[j] < acc0[j])) acc0[j] = x[j];
+	     num[j] += 1;
+	  }
+	break;
+
+      case REDUCE_MAX:
+	for (j = 0; j < len; j++)
+	  {
+	     if (IS_MISSING(r, x[j])) continue;
+	     if ((num[j] == 0) || (x[j] > acc0[j])) acc0[j] = x[j];
+	     num[j] += 1;
+	  }
+	break;
+
+      case REDUCE_VAR:
+	for (j = 0; j < len; j++)
+	  {
+	     if (IS_MISSING(r, x[j])) continue;
+	     num[j] += 1;
+	     d = x[j] - acc0[j];
+	     acc0[j] += d/num[j];
+	     acc1[j] += d*(x[j] - acc0[j]);
+	  }
+	break;
+     }
+}
+
+/* Convert the accumulators to the final values of the reduction and store
+ * them in out.  The sum of no values is 0, whereas the mean, minimum, and
+ * maximum of no values, and the variance of fewer than 2 values, are NaN.
+ */
+static void finish_reduction (Reduce_Type *r, double *out)
+{
+   size_t k;
+
+   for (k = 0; k < r->num_out; k++)
+     {
+	double n = r->num[k];
+
+	switch (r->op)
+	  {
+	   case REDUCE_COUNT:
+	     out[k] = n;
+	     break;
+	   case REDUCE_SUM:
+	     out[k] = r->acc0[k] + r->acc1[k];
+	     break;
+	   case REDUCE_MEAN:
+	     out[k] = (n > 0) ? (r->acc0[k] + r->acc1[k])/n : NAN;
+	     break;
+	   case REDUCE_MIN:
+	   case REDUCE_MAX:
+	     out[k] = (n > 0) ? r->acc0[k] : NAN;
+	     break;
+	   case REDUCE_VAR:
+	     out[k] = (n > 1) ? r->acc1[k]/(n - 1) : NAN;
+	     break;
+	  }
+     }
+}
+
+/* Usage: y = _nc_reduce (op, dims, max_bytes, ncid, varid)
+ * Reduce the variable over the dimensions whose indices are given by the
+ * dims array, or over all dimensions if dims is NULL.  The variable is read
+ * as double precision values one chunk-aligned block at a time, and only
+ * the accumulators of the output are kept in memory.  The result is a
+ * Double_Type array whose dimensions are the remaining dimensions of the
+ * variable, or a scalar if all dimensions are reduced.  Values equal to the
+ * fill value, as well as NaNs, are ignored.
+ */
+static void sl_nc_reduce (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   SLang_Array_Type *at_dims = NULL, *at = NULL;
+   SLindex_Type out_dims[SLARRAY_MAX_DIMS];
+   Reduce_Type r;
+   unsigned char is_reduced[MAX_SLICE_DIMS];
+   size_t block[MAX_SLICE_DIMS], start[MAX_SLICE_DIMS], count[MAX_SLICE_DIMS];
+   size_t index[MAX_SLICE_DIMS], ostride[MAX_SLICE_DIMS];
+   size_t max_bytes, num, nrows, len, row, o, ostep;
+   double *buf = NULL, result;
+   char *op = NULL;
+   unsigned int i, num_dims, num_out_dims, last;
+   int ncid, status;
+
+   memset ((char *) &r, 0, sizeof (Reduce_Type));
+
+   if ((-1 == check_ncid_type (nc))
+       || (-1 == update_var_cache (nc->ncid, ncvar))
+       || (-1 == pop_max_bytes (&max_bytes)))
+     return;
+
+   ncid = nc->ncid;
+   num_dims = ncvar->num_dims;
+   if (num_dims == 0)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_reduce: the variable is a scalar");
+	return;
+     }
+   if (ncvar->xclass != 0)
+     {
+	SLang_verror (SL_NotImplemented_Error, "_nc_reduce: only numeric variables may be reduced");
+	return;
+     }
+
+   if (SLang_peek_at_stack () == SLANG_NULL_TYPE)
+     {
+	(void) SLdo_pop ();
+	memset ((char *) is_reduced, 1, num_dims);
+     }
+   else
+     {
+	int *d;
+
+	if (-1 == SLang_pop_array_of_type (&at_dims, SLANG_INT_TYPE))
+	  return;
+	memset ((char *) is_reduced, 0, num_dims);
+	d = (int *) at_dims->data;
+	for (num = 0; num < at_dims->num_elements; num++)
+	  {
+	     if ((d[num] < 0) || ((unsigned int) d[num] >= num_dims))
+	       {
+		  SLang_verror (SL_InvalidParm_Error, "_nc_reduce: dimension index %d is out of range", d[num]);
+		  goto free_and_return;
+	       }
+	     is_reduced[d[num]] = 1;
+	  }
+     }
+
+   if (-1 == SLang_pop_slstring (&op))
+     goto free_and_return;
+   for (i = 0; Reduce_Op_Names[i] != NULL; i++)
+     {
+	if (0 == strcmp (op, Reduce_Op_Names[i]))
+	  break;
+     }
+   if (Reduce_Op_Names[i] == NULL)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_reduce: unsupported operation `%s'", op);
+	goto free_and_return;
+     }
+   r.op = (int) i;
+
+   /* Compute the shape of the output, and the strides that map an index of
+    * the variable to the output.  The strides of the reduced dimensions
+    * are 0.
+    */
+   num_out_dims = 0;
+   r.num_out = 1;
+   i = num_dims;
+   while (i > 0)
+     {
+	i--;
+	ostride[i] = 0;
+	if (is_reduced[i])
+	  continue;
+	ostride[i] = r.num_out;
+	r.num_out *= ncvar->shape[i];
+	num_out_dims++;
+     }
+   if (num_out_dims > SLARRAY_MAX_DIMS)
+     {
+	SLang_verror (SL_LimitExceeded_Error, "slang arrays are currently limited to %d dimensions.  The reduction has %d dimensions",
+		      SLARRAY_MAX_DIMS, num_out_dims);
+	goto free_and_return;
+     }
+
+   num = (r.num_out == 0) ? 1 : r.num_out;
+   if ((NULL == (r.acc0 = (double *) SLcalloc (num, sizeof (double))))
+       || (NULL == (r.acc1 = (double *) SLcalloc (num, sizeof (double))))
+       || (NULL == (r.num = (double *) SLcalloc (num, sizeof (double)))))
+     goto free_and_return;
+
+   get_var_fill_double (ncid, ncvar, &r.have_fill, &r.fill);
+
+   if (-1 == plan_blocks (ncid, ncvar, sizeof (double), max_bytes, 1, block))
+     goto free_and_return;
+   num = 1;
+   for (i = 0; i < num_dims; i++)
+     {
+	num *= block[i];
+	start[i] = 0;
+	if (ncvar->shape[i] == 0)
+	  num = 0;
+     }
+
+   if ((num != 0)
+       && (NULL == (buf = (double *) SLmalloc (num * sizeof (double)))))
+     goto free_and_return;
+
+   last = num_dims - 1;
+   ostep = ostride[last];
+   while (num != 0)
+     {
+	nrows = 1;
+	for (i = 0; i < num_dims; i++)
+	  {
+	     count[i] = ncvar->shape[i] - start[i];
+	     if (count[i] > block[i]) count[i] = block[i];
+	     if (i != last) nrows *= count[i];
+	     index[i] = 0;
+	  }
+
+	status = nc_get_vars_double (ncid, ncvar->var_id, start, count, NULL, buf);
+	if (status != NC_NOERR)
+	  {
+	     throw_nc_error ("nc_get_vars_double", status);
+	     goto free_and_return;
+	  }
+
+	/* Reduce the block one row of the fastest varying dimension at a
+	 * time, where index holds the position of the row in the block.
+	 */
+	len = count[last];
+	for (row = 0; row < nrows; row++)
+	  {
+	     o = start[last]*ostep;
+	     for (i = 0; i < last; i++)
+	       o += (start[i] + index[i])*ostride[i];
+	     reduce_row (&r, buf + row*len, len, o, ostep);
+
+	     i = last;
+	     while (i > 0)
+	       {
+		  i--;
+		  if (++index[i] < count[i])
+		    break;
+		  index[i] = 0;
+	       }
+	  }
+
+	/* Advance to the next block in row-major order */
+	i = num_dims;
+	while (i > 0)
+	  {
+	     i--;
+	     start[i] += block[i];
+	     if (start[i] < ncvar->shape[i])
+	       break;
+	     start[i] = 0;
+	     if (i == 0)
+	       num = 0;
+	  }
+     }
+
+   if (num_out_dims == 0)
+     {
+	finish_reduction (&r, &result);
+	(void) SLang_push_double (result);
+	goto free_and_return;
+     }
+
+   num_out_dims = 0;
+   for (i = 0; i < num_dims; i++)
+     {
+	if (is_reduced[i] == 0)
+	  out_dims[num_out_dims++] = ncvar->shape[i];
+     }
+   if (NULL == (at = SLang_create_array (SLANG_DOUBLE_TYPE, 0, NULL, out_dims, num_out_dims)))
+     goto free_and_return;
+   finish_reduction (&r, (double *) at->data);
+   (void) SLang_push_array (at, 0);
+   /* drop */
+free_and_return:
+   SLang_free_array (at);	       /* NULL ok */
+   SLang_free_array (at_dims);	       /* NULL ok */
+   SLang_free_slstring (op);	       /* NULL ok */
+   SLfree ((char *) buf);	       /* NULL ok */
+   SLfree ((char *) r.num);	       /* NULL ok */
+   SLfree ((char *) r.acc1);	       /* NULL ok */
+   SLfree ((char *) r.acc0);	       /* NULL ok */
+}
+
+/*}}}*/
+
+static int embed_compound (int ncid, Compound_Info_Type *cinfo, SLang_Struct_Type **sp, size_t num_elements, unsigned char *data);
+
+/* Pop the item of type field_xtypes from the stack and embed it in the data buffer */
+static int pop_compound_element (int ncid, unsigned char *data, int idx, nc_type field_xtype,
+				 const char *field_name, size_t field_num_elems)
+{
+   SLang_Array_Type *at;
+   SLtype sltype;
+   int status;
+
+   (void) idx;
+
+   if (field_xtype > NC_MAX_ATOMIC_TYPE)
+     {
+	int xclass;
+	if (-1 == get_nc_xclass (ncid, field_xtype, &xclass))
+	  return -1;
+	if (xclass != NC_COMPOUND)
+	  {
+	     SLang_verror (SL_NotImplemented_Error, "Compound of vlen or opaque types not implemented");
+	     return -1;
+	  }
+	sltype = SLANG_STRUCT_TYPE;
+     }
+   else if (-1 == map_base_xtype_to_sltype (field_xtype, &sltype))
+     return -1;
+
+   if (field_num_elems == 1)
+     at = NULL;
+   else
+     {
+	if (-1 == SLang_pop_array_of_type (&at, sltype))
+	  return -1;
+	if (field_num_elems != at->num_elements)
+	  {
+	     SLang_verror (SL_InvalidParm_Error, "Compound field %s requires %lu elements, %lu provided",
+			   field_name, (unsigned long) field_num_elems, (unsigned long) at->num_elements);
+	     SLang_free_array (at);
+	     return -1;
+	  }
+     }
+
+   status = 0;
+   switch (sltype)
+     {
+      case SLANG_STRUCT_TYPE:
+	  {
+	     Compound_Info_Type cinfo;
+
+	     if (-1 == init_compound_info (ncid, field_xtype, &cinfo, 1))
+	       {
+		  SLang_free_array (at);   /* NULL ok */
+		  return -1;
+	       }
+	     if (at == NULL)
+	       {
+		  SLang_Struct_Type *s;
+		  if (-1 == SLang_pop_struct (&s))
+		    return -1;
+		  status = embed_compound (ncid, &cinfo, &s, 1, data);
+		  SLang_free_struct (s);
+	       }
+	     else
+	       status = embed_compound (ncid, &cinfo, (SLang_Struct_Type **) at->data, at->num_elements, data);
+	     free_compound_info (&cinfo);
+	  }
+	break;
+
+      case SLANG_STRING_TYPE:
+	if (at == NULL)
+	  {
+	     char *str;
+	     if (-1 == SLang_pop_slstring (&str))
+	       return -1;
+	     *(char **) data = str;
+	  }
+	else
+	  {
+	     char **sp = (char **)data, **at_sp = (char **) at->data;
+	     size_t i;
+
+	     for (i = 0; i < field_num_elems; i++)
+	       {
+		  if (NULL == (sp[i] = SLang_create_slstring (at_sp[i])))
+		    {
+		       while (i != 0)
+			 {
+			    i--;
+			    SLang_free_slstring (sp[i]);
+			    sp[i] = NULL;
+			 }
+		       status = -1;
+		       break;
+		    }
+	       }
+	  }
+	break;
+
+      default:
+	if (at == NULL)
+	  return SLang_pop_value (sltype, data);
+	memcpy (data, at->data, field_num_elems*at->sizeof_type);
+     }
+   if (at != NULL) SLang_free_array (at);
+   return status;
+}
+
+static void free_compound (int ncid, nc_type xtype, size_t num_elements, unsigned char *data);
+
+static void free_compound_fields (unsigned char *compound_data, int ncid, Compound_Info_Type *cinfo)
+{
+   size_t i, nfields;
+
+   nfields = cinfo->nfields;
+
+   for (i = 0; i < nfields; i++)
+     {
+	size_t j, num_elements;
+	unsigned char *data;
+	nc_type field_xtype = cinfo->field_xtypes[i];
+	int xclass;
+
+	data = compound_data + cinfo->field_offsets[i];
+	num_elements = cinfo->field_num_elems[i];
+	if (field_xtype == NC_STRING)
+	  {
+	     char **sp = (char **)(data);
+
+	     for (j = 0; j < num_elements; j++)
+	       SLang_free_slstring (sp[j]);   /* NULL ok */
+
+	     continue;
+	  }
+
+	if (field_xtype <= NC_MAX_ATOMIC_TYPE)
+	  continue;
+
+	if (-1 == get_nc_xclass (ncid, field_xtype, &xclass))
+	  continue;	       /* ???? */
+	if (xclass == NC_COMPOUND)
+	  {
+	     free_compound (ncid, field_xtype, num_elements, data);
+	     continue;
+	  }
+     }
+}
+
+static void free_compound_data_items (int ncid, Compound_Info_Type *cinfo, unsigned char *data, size_t num_elements)
+{
+   size_t i;
+
+   for (i = 0; i < num_elements; i++)
+     {
+	free_compound_fields (data, ncid, cinfo);
+	data += cinfo->size;
+     }
+}
+
+/* Free the items on the compound data list */
+static void free_compound (int ncid, nc_type xtype, size_t num_elements, unsigned char *data)
+{
+   Compound_Info_Type cinfo;
+
+   if (-1 == init_compound_info (ncid, xtype, &cinfo, 1))
+     return;
+   free_compound_data_items (ncid, &cinfo, data, num_elements);
+   free_compound_info (&cinfo);
+}
+
+
+/*
+ * This function embeds the field values of an array of slang structs into the data buffer.
+ */
+static int embed_compound (int ncid, Compound_Info_Type *cinfo, SLang_Struct_Type **sp, size_t num_elements, unsigned char *data)
+{
+   size_t nfields, i, size;
+   size_t *field_offsets = NULL, *field_num_elems = NULL;
+   char **field_names;
+   nc_type *field_xtypes = NULL;
+   unsigned char *compound_data;
+
+   for (i = 0; i < num_elements; i++)
+     {
+	if (sp[i] == NULL)
+	  {
+	     SLang_verror (SL_InvalidParm_Error, "A compound array-element cannot be NULL");
+	     return -1;
+	  }
+     }
+
+   size = cinfo->size;
+   memset (data, 0, size*num_elements);
+
+   field_offsets = cinfo->field_offsets;
+   field_xtypes = cinfo->field_xtypes;
+   field_names = cinfo->field_names;
+   field_num_elems = cinfo->field_num_elems;
+   nfields = cinfo->nfields;
+
+   compound_data = data;
+   for (i = 0; i < num_elements; i++)
+     {
+	SLang_Struct_Type *s = sp[i];
+	size_t j;
+
+	for (j = 0; j < nfields; j++)
+	  {
+	     if (-1 == SLang_push_struct_field (s, field_names[j]))
+	       goto return_error;
+	     if (-1 == pop_compound_element (ncid, compound_data + field_offsets[j], j, field_xtypes[j], field_names[j], field_num_elems[j]))
+	       goto return_error;
+	  }
+	compound_data += size;
+     }
+   return 0;
+
+return_error:
+
+   free_compound_data_items (ncid, cinfo, data, num_elements);
+   return -1;
+}
+
+
+/* This gets called with at->data_type == SLANG_STRUCT_TYPE */
+static int put_compound (int ncid, int varid, nc_type xtype, size_t *start, size_t *count, ptrdiff_t *stride,
+			 SLang_Struct_Type **sp, size_t num_elements, const char *attr_name)
+{
+   Compound_Info_Type cinfo;
+   size_t size;
+   unsigned char *compound_data;
+   int status;
+
+   if (-1 == init_compound_info (ncid, xtype, &cinfo, 1))
+     return -1;
+   size = cinfo.size;
+
+   if ((NULL == (compound_data = (unsigned char *)SLmalloc(num_elements*size)))
+       || (-1 == embed_compound (ncid, &cinfo, sp, num_elements, compound_data)))
+     {
+	free_compound_info (&cinfo);
+	return -1;
+     }
+
+   if (attr_name != NULL)
+     status = nc_put_att (ncid, varid, attr_name, xtype, num_elements, compound_data);
+   else if (stride == NULL)
+     status = nc_put_vara (ncid, varid, start, count, compound_data);
+   else
+     status = nc_put_vars (ncid, varid, start, count, stride, compound_data);
+   if (status != NC_NOERR)
+     {
+	throw_nc_error ("nc_put_xxx", status);
+	status = -1;
+     }
+   else status = 0;
+
+   free_compound_data_items (ncid, &cinfo, compound_data, num_elements);
+   SLfree (compound_data);
+   free_compound_info (&cinfo);
+
+   return status;
+}
+
+
+/* If there are no unlimited dims, *unlim_dimsp will be NULL. */
+static int get_unlimited_dim_ids (int ncid, int **unlim_dimsp, int *num_unlimp)
+{
+   int *unlim_dims;
+   int num_unlim, status;
+
+   *unlim_dimsp = unlim_dims = NULL;
+   *num_unlimp = 0;
+   if (NC_NOERR != (status = nc_inq_unlimdims (ncid, &num_unlim, unlim_dims)))
+     {
+	throw_nc_error ("nc_inq_unlimdims", status);
+	return -1;
+     }
+   if (num_unlim <= 0) return 0;
+
+   if (NULL == (unlim_dims = (int *)SLmalloc(num_unlim * sizeof(int))))
+     return -1;
+
+   if (NC_NOERR != (status = nc_inq_unlimdims (ncid, NULL, unlim_dims)))
+     {
+	throw_nc_error ("nc_inq_unlimdims", status);
+	SLfree (unlim_dims);
+	return -1;
+     }
+   *unlim_dimsp = unlim_dims;
+   *num_unlimp = num_unlim;
+   return 0;
+}
+
+/* unlim_dims could be NULL indicating that there are no unlimited dimensions */
+static NCid_Dim_Type *inq_and_create_dim (int ncid, int dimid, int *unlim_dims, int num_unlim)
+{
+   size_t len;
+   int is_unlim, status;
+
+   is_unlim = 0;
+   if (unlim_dims != NULL)
+     {
+	int i;
+
+	for (i = 0; i < num_unlim; i++)
+	  {
+	     if (dimid == unlim_dims[i])
+	       {
+		  len = 0;
+		  is_unlim = 1;
+		  break;
+	       }
+	  }
+     }
+
+   if ((is_unlim == 0)
+       && (NC_NOERR != (status = nc_inq_dimlen (ncid, dimid, &len))))
+     {
+	throw_nc_error ("nc_inq_dimlen", status);
+	return NULL;
+     }
+
+   return alloc_ncid_dim_type (ncid, dimid, len);
+}
+
+static int get_root_ncid (NCid_Type *nc, int *ncidp)
+{
+   if (0 == nc->is_group)
+     {
+	*ncidp = nc->ncid;
+	return 0;
+     }
+   return get_root_of_ncid (nc->ncid, ncidp);
+}
+
+/*{{{ Record readers */
+
+/* A record reader returns consecutive batches of records of a variable
+ * along its first unlimited dimension.  If prefetching is enabled, a
+ * worker thread reads the next batches into a ring of slots while the
+ * interpreter processes the current one.  The worker never calls into
+ * slang: the arrays of the slots are created by the main thread, and
+ * errors are reported by the main thread when the batch is consumed.
+ *
+ * A batch is returned as the array that it was read into.  The reader
+ * keeps a reference to the last few of them, and an array that the
+ * interpreter has since freed is reused for a later batch.
+ */
+#define SLOT_EMPTY	0
+#define SLOT_READING	1
+#define SLOT_FULL	2
+
+#define READER_POOL_SIZE 4
+
+typedef struct
+{
+   SLang_Array_Type *at;
+   unsigned char *data;		       /* at->data, used by the worker */
+   size_t first;		       /* first record of the batch */
+   size_t num;			       /* number of records in the batch */
+   int state;
+   int status;			       /* netCDF status of the read */
+}
+Batch_Slot_Type;
+
+static int NCid_Reader_Type_Id = 0;
+typedef struct _NCid_Reader_Type
+{
+   NCid_Type *nc;
+   int ncid, root_ncid, varid;
+   SLtype sltype;
+   size_t sizeof_type;
+   unsigned int num_dims;
+   unsigned int rec_dim;	       /* the dimension that is iterated over */
+   size_t *shape;
+   size_t *start, *count;	       /* used only by the worker */
+   size_t batch;		       /* records per batch */
+   size_t num_records;
+   size_t num_batches;
+   size_t next_read;		       /* next batch to be read */
+   size_t next_return;		       /* next batch to be returned */
+
+   Batch_Slot_Type *slots;
+   unsigned int num_slots;	       /* 0 if no prefetching */
+   pthread_t thread;
+   pthread_mutex_t mutex;
+   pthread_cond_t cond;
+   int have_thread;
+   int stop;
+   int is_stopped;		       /* stopped because the file was closed */
+   SLang_Array_Type *pool[READER_POOL_SIZE];   /* arrays of returned batches */
+
+   unsigned int numrefs;
+   struct _NCid_Reader_Type *next;     /* list of active readers */
+}
+NCid_Reader_Type;
+
+static NCid_Reader_Type *Reader_List = NULL;
+
+/* Read the records [first, first+num) into the buffer.  This may be
+ * called by the worker thread and so must not call slang functions.
+ */
+static int read_reader_records (NCid_Reader_Type *r, size_t *start, size_t *count,
+				size_t first, size_t num, unsigned char *data)
+{
+   unsigned int i;
+
+   for (i = 0; i < r->num_dims; i++)
+     {
+	start[i] = 0;
+	count[i] = r->shape[i];
+     }
+   start[r->rec_dim] = first;
+   count[r->rec_dim] = num;
+   return nc_get_vara (r->ncid, r->varid, start, count, data);
+}
+
+static void *reader_thread (void *arg)
+{
+   NCid_Reader_Type *r = (NCid_Reader_Type *) arg;
+
+   (void) pthread_mutex_lock (&r->mutex);
+   while (r->stop == 0)
+     {
+	Batch_Slot_Type *slot;
+	size_t b = r->next_read;
+	int status;
+
+	if (b >= r->num_batches)
+	  break;
+
+	slot = r->slots + (b % r->num_slots);
+	if (slot->state != SLOT_EMPTY)
+	  {
+	     (void) pthread_cond_wait (&r->cond, &r->mutex);
+	     continue;
+	  }
+	slot->state = SLOT_READING;
+	slot->first = b * r->batch;
+	slot->num = r->num_records - slot->first;
+	if (slot->num > r->batch) slot->num = r->batch;
+	r->next_read++;
+	(void) pthread_mutex_unlock (&r->mutex);
+
+	status = read_reader_records (r, r->start, r->count, slot->first, slot->num, slot->data);
+
+	(void) pthread_mutex_lock (&r->mutex);
+	slot->status = status;
+	slot->state = SLOT_FULL;
+	(void) pthread_cond_broadcast (&r->cond);
+     }
+   (void) pthread_mutex_unlock (&r->mutex);
+   return NULL;
+}
+
+static void stop_reader_thread (NCid_Reader_Type *r)
+{
+   if (r->have_thread == 0)
+     return;
+
+   (void) pthread_mutex_lock (&r->mutex);
+   r->stop = 1;
+   (void) pthread_cond_broadcast (&r->cond);
+   (void) pthread_mutex_unlock (&r->mutex);
+   (void) pthread_join (r->thread, NULL);
+   r->have_thread = 0;
+}
+
+/* This is called before a file is closed.  The readers of the file are
+ * stopped since the netCDF id may be reused by a file opened later.
+ */
+static void stop_file_readers (int root_ncid)
+{
+   NCid_Reader_Type *r;
+
+   for (r = Reader_List; r != NULL; r = r->next)
+     {
+	if (r->root_ncid != root_ncid)
+	  continue;
+	stop_reader_thread (r);
+	r->is_stopped = 1;
+     }
+}
+
+static void free_ncid_reader_type (NCid_Reader_Type *r)
+{
+   NCid_Reader_Type *prev;
+   unsigned int i;
+
+   if (r == NULL) return;
+   if (r->numrefs > 1)
+     {
+	r->numrefs--;
+	return;
+     }
+
+   stop_reader_thread (r);
+
+   if (Reader_List == r)
+     Reader_List = r->next;
+   else for (prev = Reader_List; prev != NULL; prev = prev->next)
+     {
+	if (prev->next == r)
+	  {
+	     prev->next = r->next;
+	     break;
+	  }
+     }
+
+   for (i = 0; i < READER_POOL_SIZE; i++)
+     SLang_free_array (r->pool[i]);    /* NULL ok */
+   if (r->slots != NULL)
+     {
+	for (i = 0; i < r->num_slots; i++)
+	  SLang_free_array (r->slots[i].at);   /* NULL ok */
+	SLfree ((char *) r->slots);
+	(void) pthread_cond_destroy (&r->cond);
+	(void) pthread_mutex_destroy (&r->mutex);
+     }
+   SLfree ((char *) r->shape);	       /* NULL ok */
+   SLfree ((char *) r->start);	       /* NULL ok */
+   SLfree ((char *) r->count);	       /* NULL ok */
+   free_ncid_type (r->nc);	       /* NULL ok */
+   SLfree ((char *) r);
+}
+
+static int push_ncid_reader_type (NCid_Reader_Type *r)
+{
+   r->numrefs++;
+   if (0 == SLclass_push_ptr_obj (NCid_Reader_Type_Id, (VOID_STAR) r))
+     return 0;
+   r->numrefs--;
+   return -1;
+}
+
+/* Return an array for a full batch.  An array of an earlier batch is
+ * reused if only the pool refers to it.
+ */
+static SLang_Array_Type *get_batch_array (NCid_Reader_Type *r)
+{
+   SLang_Array_Type *at;
+   SLindex_Type dims[SLARRAY_MAX_DIMS];
+   unsigned int i;
+
+   for (i = 0; i < READER_POOL_SIZE; i++)
+     {
+	at = r->pool[i];
+	if ((at != NULL) && (at->num_refs == 1))
+	  {
+	     r->pool[i] = NULL;	       /* the reference passes to the caller */
+	     return at;
+	  }
+     }
+
+   for (i = 0; i < r->num_dims; i++)
+     dims[i] = r->shape[i];
+   dims[r->rec_dim] = r->batch;
+   return SLang_create_array (r->sltype, 0, NULL, dims, r->num_dims);
+}
+
+/* Remember the array of a returned batch for get_batch_array */
+static void pool_batch_array (NCid_Reader_Type *r, SLang_Array_Type *at)
+{
+   unsigned int i;
+
+   for (i = 0; i < READER_POOL_SIZE; i++)
+     {
+	if (r->pool[i] == NULL)
+	  {
+	     at->num_refs++;
+	     r->pool[i] = at;
+	     return;
+	  }
+     }
+}
+
+/* Usage: reader = _nc_records (batch, prefetch, ncid, varid)
+ * Create a reader that returns batches of the specified number of records
+ * along the first unlimited dimension of the variable.  If prefetch is
+ * non-zero, then a worker thread reads up to that many batches ahead.
+ * The number of records is fixed when the reader is created.
+ */
+static void sl_nc_records (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   NCid_Reader_Type *r;
+   SLang_Array_Type *at;
+   SLindex_Type one = 1;
+   unsigned int i, batch, prefetch, num_dims;
+   nc_type xtype;
+   SLtype sltype;
+   size_t sizeof_type;
+
+   if ((-1 == SLang_pop_uint (&prefetch))
+       || (-1 == SLang_pop_uint (&batch)))
+     return;
+   if (batch == 0)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_records: the batch size must be positive");
+	return;
+     }
+
+   if ((-1 == check_ncid_type (nc))
+       || (-1 == get_var_sltype (nc->ncid, ncvar, &xtype, &sltype)))
+     return;
+
+   num_dims = ncvar->num_dims;
+   if (ncvar->num_unlimited == 0)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_records: the variable does not have an unlimited dimension");
+	return;
+     }
+   if (num_dims > SLARRAY_MAX_DIMS)
+     {
+	SLang_verror (SL_LimitExceeded_Error, "_nc_records: slang arrays are limited to %d dimensions",
+		      SLARRAY_MAX_DIMS);
+	return;
+     }
+
+   /* The records are read without conversion, so the size of the slang
+    * type must match that of the netCDF type.
+    */
+   if (NULL == (at = SLang_create_array (sltype, 0, NULL, &one, 1)))
+     return;
+   sizeof_type = at->sizeof_type;
+   SLang_free_array (at);
+   if ((xtype > NC_MAX_ATOMIC_TYPE) || (xtype == NC_STRING) || (sizeof_type != ncvar->xsize))
+     {
+	SLang_verror (SL_NotImplemented_Error, "_nc_records: only numeric types are supported");
+	return;
+     }
+
+   if (NULL == (r = (NCid_Reader_Type *) SLcalloc (1, sizeof (NCid_Reader_Type))))
+     return;
+   r->numrefs = 1;
+   r->nc = nc;
+   nc->numrefs++;
+   r->ncid = nc->ncid;
+   r->varid = ncvar->var_id;
+   r->sltype = sltype;
+   r->sizeof_type = sizeof_type;
+   r->num_dims = num_dims;
+   r->batch = batch;
+
+   if ((-1 == get_root_ncid (nc, &r->root_ncid))
+       || (NULL == (r->shape = (size_t *) SLmalloc (num_dims * sizeof (size_t))))
+       || (NULL == (r->start = (size_t *) SLmalloc (num_dims * sizeof (size_t))))
+       || (NULL == (r->count = (size_t *) SLmalloc (num_dims * sizeof (size_t)))))
+     goto free_and_return;
+
+   r->rec_dim = num_dims;
+   for (i = 0; i < num_dims; i++)
+     {
+	r->shape[i] = ncvar->shape[i];
+	if (ncvar->is_unlimited[i] && (r->rec_dim == num_dims))
+	  r->rec_dim = i;
+     }
+   r->num_records = ncvar->shape[r->rec_dim];
+   r->num_batches = (r->num_records + batch - 1) / batch;
+
+   if ((prefetch != 0) && (r->num_batches != 0))
+     {
+	if (NULL == (r->slots = (Batch_Slot_Type *) SLcalloc (prefetch, sizeof (Batch_Slot_Type))))
+	  goto free_and_return;
+	r->num_slots = prefetch;
+	(void) pthread_mutex_init (&r->mutex, NULL);
+	(void) pthread_cond_init (&r->cond, NULL);
+	for (i = 0; i < prefetch; i++)
+	  {
+	     if (NULL == (r->slots[i].at = get_batch_array (r)))
+	       goto free_and_return;
+	     r->slots[i].data = (unsigned char *) r->slots[i].at->data;
+	     r->slots[i].state = SLOT_EMPTY;
+	  }
+	if (0 != pthread_create (&r->thread, NULL, reader_thread, (void *) r))
+	  {
+	     SLang_verror (SL_OS_Error, "_nc_records: unable to create the prefetch thread");
+	     goto free_and_return;
+	  }
+	r->have_thread = 1;
+     }
+
+   r->next = Reader_List;
+   Reader_List = r;
+   (void) push_ncid_reader_type (r);
+   /* drop */
+free_and_return:
+   free_ncid_reader_type (r);
+}
+
+/* Usage: (first, data) = _nc_reader_next (reader)
+ * Return the next batch of records and the index of its first record, or
+ * NULL for both when there are no more records.
+ */
+static void sl_nc_reader_next (NCid_Reader_Type *r)
+{
+   SLang_Array_Type *at, *bt;
+   SLindex_Type dims[SLARRAY_MAX_DIMS];
+   size_t b, first, num;
+   unsigned int i;
+   int status;
+
+   if (r->is_stopped)
+     {
+	SLang_verror (SL_InvalidParm_Error, "The file of the record reader has been closed");
+	return;
+     }
+
+   b = r->next_return;
+   if (b >= r->num_batches)
+     {
+	(void) SLang_push_null ();
+	(void) SLang_push_null ();
+	return;
+     }
+   first = b * r->batch;
+   num = r->num_records - first;
+   if (num > r->batch) num = r->batch;
+
+   if (r->have_thread)
+     {
+	Batch_Slot_Type *slot = r->slots + (b % r->num_slots);
+	SLang_Array_Type *new_at;
+
+	/* The filled array is returned and replaced by a free one */
+	if (NULL == (new_at = get_batch_array (r)))
+	  return;
+	(void) pthread_mutex_lock (&r->mutex);
+	while (slot->state != SLOT_FULL)
+	  (void) pthread_cond_wait (&r->cond, &r->mutex);
+	at = slot->at;
+	status = slot->status;
+	slot->at = new_at;
+	slot->data = (unsigned char *) new_at->data;
+	slot->state = SLOT_EMPTY;
+	(void) pthread_cond_broadcast (&r->cond);
+	(void) pthread_mutex_unlock (&r->mutex);
+     }
+   else
+     {
+	if (NULL == (at = get_batch_array (r)))
+	  return;
+	status = read_reader_records (r, r->start, r->count, first, num,
+				      (unsigned char *) at->data);
+     }
+   r->next_return++;
+
+   if (status != NC_NOERR)
+     {
+	SLang_free_array (at);
+	throw_nc_error ("nc_get_vara", status);
+	return;
+     }
+
+   if (num == r->batch)
+     pool_batch_array (r, at);
+   else
+     {
+	/* The last batch is short.  Its records, which are at the start of
+	 * the array, are copied into one of the right shape.
+	 */
+	for (i = 0; i < r->num_dims; i++)
+	  dims[i] = r->shape[i];
+	dims[r->rec_dim] = num;
+	if (NULL == (bt = SLang_create_array (r->sltype, 0, NULL, dims, r->num_dims)))
+	  {
+	     SLang_free_array (at);
+	     return;
+	  }
+	memcpy (bt->data, at->data, bt->num_elements * bt->sizeof_type);
+	SLang_free_array (at);
+	at = bt;
+     }
+   (void) SLang_push_value (_SL_SIZE_T_TYPE, (VOID_STAR) &first);
+   (void) SLang_push_array (at, 1);
+}
+
+/* Usage: _nc_reader_close (reader)
+ * Stop the prefetching.  No further batches will be returned.
+ */
+static void sl_nc_reader_close (NCid_Reader_Type *r)
+{
+   stop_reader_thread (r);
+   r->num_batches = r->next_return;
+}
+
+/*}}}*/
+
+/*{{{ Append buffers */
+
+/* Records appended to a variable along its unlimited first dimension are
+ * collected in a buffer and written by a single call when the buffer is
+ * full, or when the file is flushed or closed.  The buffer holds a whole
+ * number of chunks along the record dimension, and a flush ends at a chunk
+ * boundary, so that each chunk is written once.
+ *
+ * The buffers of the variables that are appended to by _nc_append_record
+ * form a record set.  They have a common capacity and are filled and
+ * flushed together.  The variables are written one after the other, and
+ * the flush stops at the first error.  The set is then marked inconsistent
+ * and no records are added to it until a later flush has written the
+ * remaining variables.
+ */
+#define APPEND_BUFFER_BYTES 0x100000
+
+typedef struct _Append_Buffer_Type
+{
+   int root_ncid;
+   int ncid;
+   int varid;
+   NCid_Var_Type *ncvar;
+   SLtype sltype;
+   nc_type mem_xtype;		       /* type of the buffered values */
+   size_t sizeof_type;
+   size_t rec_size;		       /* number of elements in a record */
+   size_t chunk_recs;		       /* chunk size along the record dimension */
+   size_t capacity;		       /* number of records in the buffer */
+   size_t first_record;		       /* index of the first buffered record */
+   size_t num_buffered;
+   unsigned int record_set;	       /* 0 if not part of a record set */
+   int is_inconsistent;		       /* a flush of the set failed */
+   unsigned char *data;
+   struct _Append_Buffer_Type *next;
+}
+Append_Buffer_Type;
+
+static Append_Buffer_Type *Append_List = NULL;
+static unsigned int Last_Record_Set = 0;
+
+static void free_append_buffer (Append_Buffer_Type *b)
+{
+   free_ncid_var_type (b->ncvar);
+   SLfree ((char *) b->data);	       /* NULL ok */
+   SLfree ((char *) b);
+}
+
+static Append_Buffer_Type *find_append_buffer (int ncid, int varid)
+{
+   Append_Buffer_Type *b;
+
+   for (b = Append_List; b != NULL; b = b->next)
+     {
+	if ((b->ncid == ncid) && (b->varid == varid))
+	  return b;
+     }
+   return NULL;
+}
+
+static Append_Buffer_Type *new_append_buffer (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   Append_Buffer_Type *b;
+   SLang_Array_Type *at;
+   SLindex_Type one = 1;
+   nc_type xtype, mem_xtype;
+   SLtype sltype;
+   size_t rec_size, sizeof_type, n;
+   unsigned int i;
+
+   if ((-1 == get_var_sltype (nc->ncid, ncvar, &xtype, &sltype))
+       || (-1 == update_var_chunk_cache (nc->ncid, ncvar)))
+     return NULL;
+
+   if ((ncvar->num_dims == 0) || (ncvar->is_unlimited[0] == 0))
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_append: the first dimension of the variable is not unlimited");
+	return NULL;
+     }
+
+   /* The records are buffered without conversion */
+   if (NULL == (at = SLang_create_array (sltype, 0, NULL, &one, 1)))
+     return NULL;
+   sizeof_type = at->sizeof_type;
+   SLang_free_array (at);
+   if ((xtype > NC_MAX_ATOMIC_TYPE) || (xtype == NC_STRING) || (sizeof_type != ncvar->xsize))
+     {
+	SLang_verror (SL_NotImplemented_Error, "_nc_append: only numeric types are supported");
+	return NULL;
+     }
+   if (-1 == map_base_sltype_to_xtype (sltype, &mem_xtype))
+     return NULL;
+
+   rec_size = 1;
+   for (i = 1; i < ncvar->num_dims; i++)
+     rec_size *= ncvar->shape[i];
+   if (rec_size == 0)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_append: the records of the variable are empty");
+	return NULL;
+     }
+
+   if (NULL == (b = (Append_Buffer_Type *) SLcalloc (1, sizeof (Append_Buffer_Type))))
+     return NULL;
+
+   if (-1 == get_root_ncid (nc, &b->root_ncid))
+     {
+	SLfree ((char *) b);
+	return NULL;
+     }
+   b->ncid = nc->ncid;
+   b->varid = ncvar->var_id;
+   b->sltype = sltype;
+   b->mem_xtype = mem_xtype;
+   b->sizeof_type = sizeof_type;
+   b->rec_size = rec_size;
+   b->chunk_recs = (ncvar->is_chunked && (ncvar->chunks[0] > 0)) ? ncvar->chunks[0] : 1;
+   n = APPEND_BUFFER_BYTES / (b->chunk_recs * rec_size * sizeof_type);
+   b->capacity = b->chunk_recs * ((n == 0) ? 1 : n);
+   b->first_record = ncvar->shape[0];
+
+   if (NULL == (b->data = (unsigned char *) SLmalloc (b->capacity * rec_size * sizeof_type)))
+     {
+	SLfree ((char *) b);
+	return NULL;
+     }
+   b->ncvar = ncvar;
+   ncvar->numrefs++;
+
+   b->next = Append_List;
+   Append_List = b;
+   return b;
+}
+
+/* Write the buffered records to the file.  This returns a netCDF status
+ * and leaves the reporting of an error to the caller.
+ */
+static int write_append_buffer (Append_Buffer_Type *b)
+{
+   size_t start[MAX_SLICE_DIMS], count[MAX_SLICE_DIMS];
+   unsigned int i;
+   int status;
+
+   if (b->num_buffered == 0)
+     return NC_NOERR;
+
+   start[0] = b->first_record;
+   count[0] = b->num_buffered;
+   for (i = 1; i < b->ncvar->num_dims; i++)
+     {
+	start[i] = 0;
+	count[i] = b->ncvar->shape[i];
+     }
+
+   status = put_atomic_slab (b->ncid, b->varid, start, count, NULL, NULL, b->mem_xtype, b->data);
+   if (status != NC_NOERR)
+     return status;
+   note_var_write (b->ncid, b->ncvar, start, count, NULL);
+
+   b->first_record += b->num_buffered;
+   b->num_buffered = 0;
+   return NC_NOERR;
+}
+
+static int flush_append_buffer (Append_Buffer_Type *b)
+{
+   return check_nc_error ("_nc_append", write_append_buffer (b));
+}
+
+static int flush_record_set (unsigned int record_set);
+
+/* Flush the append buffers of a file */
+static int flush_file_appends (int root_ncid)
+{
+   Append_Buffer_Type *b, *b1;
+   int status = 0;
+
+   for (b = Append_List; b != NULL; b = b->next)
+     {
+	if (b->root_ncid != root_ncid)
+	  continue;
+	if (b->record_set == 0)
+	  {
+	     if (-1 == flush_append_buffer (b))
+	       status = -1;
+	     continue;
+	  }
+	/* A record set is flushed as a whole, via its first buffer */
+	for (b1 = Append_List; b1 != b; b1 = b1->next)
+	  {
+	     if (b1->record_set == b->record_set)
+	       break;
+	  }
+	if ((b1 == b) && (-1 == flush_record_set (b->record_set)))
+	  status = -1;
+     }
+   return status;
+}
+
+/* The number of records in the append buffers of a file that have not
+ * been written, counting the record of each variable of a record set.
+ */
+static size_t count_file_appends (int root_ncid)
+{
+   Append_Buffer_Type *b;
+   size_t n = 0;
+
+   for (b = Append_List; b != NULL; b = b->next)
+     {
+	if (b->root_ncid == root_ncid)
+	  n += b->num_buffered;
+     }
+   return n;
+}
+
+/* Free the append buffers of a file when it is closed */
+static void free_file_appends (int root_ncid)
+{
+   Append_Buffer_Type *b, *prev, *next;
+
+   prev = NULL;
+   for (b = Append_List; b != NULL; b = next)
+     {
+	next = b->next;
+	if (b->root_ncid != root_ncid)
+	  {
+	     prev = b;
+	     continue;
+	  }
+	if (prev == NULL)
+	  Append_List = next;
+	else
+	  prev->next = next;
+	free_append_buffer (b);
+     }
+}
+
+/* This is called by check_ncid_type before an operation on the file */
+static int sync_file_appends (NCid_Type *nc)
+{
+   int root_ncid;
+
+   if (Append_List == NULL)
+     return 0;
+   if (-1 == get_root_ncid (nc, &root_ncid))
+     return -1;
+   return flush_file_appends (root_ncid);
+}
+
+/* Write the buffered records of the variable before another write to it
+ * that does not wait for check_ncid_type.
+ */
+static int flush_var_appends (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   Append_Buffer_Type *b;
+
+   if ((Append_List == NULL)
+       || (NULL == (b = find_append_buffer (nc->ncid, ncvar->var_id))))
+     return 0;
+   if (b->record_set != 0)
+     return flush_record_set (b->record_set);
+   return flush_append_buffer (b);
+}
+
+/* Other writes may have extended the record dimension since an empty
+ * buffer was last flushed.  The records are appended after its end.
+ */
+static int sync_first_record (Append_Buffer_Type *b)
+{
+   if (b->num_buffered != 0)
+     return 0;
+   if (-1 == update_var_cache (b->ncid, b->ncvar))
+     return -1;
+   b->first_record = b->ncvar->shape[0];
+   return 0;
+}
+
+/* Usage: _nc_append (records, ncid, varid)
+ * Append one or more records to the variable along its unlimited first
+ * dimension.  The records are buffered, and written when the buffer fills
+ * or the file is flushed or closed.
+ */
+static void sl_nc_append (NCid_Type *nc, NCid_Var_Type *ncvar)
+{
+   Append_Buffer_Type *b;
+   SLang_Array_Type *at;
+   unsigned char *data;
+   size_t num_recs, n, room, rec_bytes;
+
+   /* The records are converted once the type of the buffer is known */
+   if (-1 == SLang_pop_array (&at, 1))
+     return;
+
+   /* Unlike check_ncid_type, this does not flush the buffers */
+   if ((-1 == check_ncid_is_open (nc))
+       || (-1 == sync_file_writes (nc))
+       || (-1 == update_var_cache (nc->ncid, ncvar)))
+     goto free_and_return;
+
+   if ((NULL == (b = find_append_buffer (nc->ncid, ncvar->var_id)))
+       && (NULL == (b = new_append_buffer (nc, ncvar))))
+     goto free_and_return;
+   if (b->record_set != 0)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_append: the variable is part of a record written by _nc_append_record");
+	goto free_and_return;
+     }
+   if (-1 == sync_first_record (b))
+     goto free_and_return;
+
+   if (at->data_type != b->sltype)
+     {
+	int status = SLang_push_array (at, 1);
+	at = NULL;
+	if ((status == -1)
+	    || (-1 == SLang_pop_array_of_type (&at, b->sltype)))
+	  goto free_and_return;
+     }
+
+   if ((at->num_elements == 0) || (at->num_elements % b->rec_size))
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_append: expected a multiple of %lu values, found %lu",
+		      (unsigned long) b->rec_size, (unsigned long) at->num_elements);
+	goto free_and_return;
+     }
+
+   num_recs = at->num_elements / b->rec_size;
+   rec_bytes = b->rec_size * b->sizeof_type;
+   data = (unsigned char *) at->data;
+   while (num_recs)
+     {
+	/* A flush ends at a chunk boundary */
+	room = b->capacity - (b->first_record % b->chunk_recs) - b->num_buffered;
+	n = (num_recs < room) ? num_recs : room;
+	memcpy (b->data + b->num_buffered * rec_bytes, data, n * rec_bytes);
+	b->num_buffered += n;
+	data += n * rec_bytes;
+	num_recs -= n;
+	if ((n == room) && (-1 == flush_append_buffer (b)))
+	  break;
+     }
+   /* drop */
+free_and_return:
+   SLang_free_array (at);	       /* NULL ok */
+}
+
+/* Usage: _nc_flush (ncid)
+ * Write the buffered records of the file, after waiting for its queued
+ * asynchronous writes.
+ */
+static void sl_nc_flush (NCid_Type *nc)
+{
+   int root_ncid;
+
+   if ((-1 == check_ncid_is_open (nc))
+       || (-1 == sync_file_writes (nc))
+       || (-1 == get_root_ncid (nc, &root_ncid)))
+     return;
+
+   (void) flush_file_appends (root_ncid);
+}
+
+/* Remove the buffer from the list and free it */
+static void delete_append_buffer (Append_Buffer_Type *b)
+{
+   Append_Buffer_Type *prev;
+
+   if (Append_List == b)
+     Append_List = b->next;
+   else
+     {
+	for (prev = Append_List; prev != NULL; prev = prev->next)
+	  {
+	     if (prev->next == b)
+	       {
+		  prev->next = b->next;
+		  break;
+	       }
+	  }
+     }
+   free_append_buffer (b);
+}
+
+static void mark_record_set (unsigned int record_set, int is_inconsistent)
+{
+   Append_Buffer_Type *b;
+
+   for (b = Append_List; b != NULL; b = b->next)
+     {
+	if (b->record_set == record_set)
+	  b->is_inconsistent = is_inconsistent;
+     }
+}
+
+/* Append the name of the variable to the comma separated list in buf */
+static void add_varname_to_list (Append_Buffer_Type *b, char *buf, size_t bufsize)
+{
+   char name[NC_MAX_NAME+1];
+   size_t len = strlen (buf);
+
+   if (NC_NOERR != nc_inq_varname (b->ncid, b->varid, name))
+     (void) SLsnprintf (name, sizeof (name), "#%d", b->varid);
+   name[NC_MAX_NAME] = 0;
+   (void) SLsnprintf (buf + len, bufsize - len, "%s%s", (len ? ", " : ""), name);
+}
+
+/* The variables of the set are written in turn.  On failure, the error
+ * names the variables whose records were written by this flush.  Their
+ * buffers are now empty, and a later flush writes only the others.
+ */
+static int flush_record_set (unsigned int record_set)
+{
+   Append_Buffer_Type *b;
+   char written[1024], failed[NC_MAX_NAME+16];
+   int status;
+
+   written[0] = 0;
+   for (b = Append_List; b != NULL; b = b->next)
+     {
+	if ((b->record_set != record_set) || (b->num_buffered == 0))
+	  continue;
+
+	status = write_append_buffer (b);
+	if (status == NC_NOERR)
+	  {
+	     add_varname_to_list (b, written, sizeof (written));
+	     continue;
+	  }
+
+	mark_record_set (record_set, 1);
+	failed[0] = 0;
+	add_varname_to_list (b, failed, sizeof (failed));
+	set_nc_errno (status);
+	SLang_verror (sl_NC_Error, "_nc_append_record: writing the records of %s returned error code %d: %s; the records were written to: %s",
+		      failed, status, nc_strerror (status),
+		      (written[0] ? written : "none of the variables"));
+	return -1;
+     }
+   mark_record_set (record_set, 0);
+   return 0;
+}
+
+/* A flush ends at a chunk boundary */
+static int record_set_is_full (Append_Buffer_Type *b)
+{
+   return (b->num_buffered + (b->first_record % b->chunk_recs) >= b->capacity);
+}
+
+static Append_Buffer_Type *find_record_set (unsigned int record_set)
+{
+   Append_Buffer_Type *b;
+
+   for (b = Append_List; b != NULL; b = b->next)
+     {
+	if (b->record_set == record_set)
+	  return b;
+     }
+   return NULL;
+}
+
+static unsigned int count_record_set (unsigned int record_set)
+{
+   Append_Buffer_Type *b;
+   unsigned int n = 0;
+
+   for (b = Append_List; b != NULL; b = b->next)
+     {
+	if (b->record_set == record_set)
+	  n++;
+     }
+   return n;
+}
+
+/* Look up the buffers of a record set of the variables, creating the set
+ * if necessary.  Buffers of the variables that do not form the set are
+ * written and replaced.
+ */
+static int get_record_set (NCid_Type *nc, NCid_Var_Type **ncvars, size_t nvars,
+			   Append_Buffer_Type **bufs)
+{
+   Append_Buffer_Type *b;
+   size_t v, capacity, chunk_recs, first_record;
+   unsigned int record_set;
+   int dim_id, is_set;
+
+   is_set = 1;
+   for (v = 0; v < nvars; v++)
+     {
+	bufs[v] = find_append_buffer (nc->ncid, ncvars[v]->var_id);
+	if ((bufs[v] == NULL) || (bufs[v]->record_set == 0))
+	  is_set = 0;
+	else if (is_set && (bufs[v]->record_set != bufs[0]->record_set))
+	  is_set = 0;		       /* bufs[0] is not NULL here */
+     }
+   if (is_set && (count_record_set (bufs[0]->record_set) == nvars))
+     return 0;
+
+   /* Write and discard the existing buffers of the variables */
+   for (v = 0; v < nvars; v++)
+     {
+	if (NULL == (b = find_append_buffer (nc->ncid, ncvars[v]->var_id)))
+	  continue;
+	if (b->record_set == 0)
+	  {
+	     if (-1 == flush_append_buffer (b))
+	       return -1;
+	     delete_append_buffer (b);
+	     continue;
+	  }
+	record_set = b->record_set;
+	if (-1 == flush_record_set (record_set))
+	  return -1;
+	while (NULL != (b = find_record_set (record_set)))
+	  delete_append_buffer (b);
+     }
+
+   record_set = ++Last_Record_Set;
+   for (v = 0; v < nvars; v++)
+     {
+	NCid_Var_Type *ncvar = ncvars[v];
+
+	if (NULL == (bufs[v] = find_append_buffer (nc->ncid, ncvar->var_id)))
+	  {
+	     if (NULL == (bufs[v] = new_append_buffer (nc, ncvar)))
+	       goto return_error;
+	     bufs[v]->record_set = record_set;
 	  }
 	else
 	  {
-	     char **sp = (char **)data, **at_sp = (char **) at->data;
-	     size_t i;
+	     SLang_verror (SL_InvalidParm_Error, "_nc_append_record: a variable appears more than once");
+	     goto return_error;
+	  }
+     }
+
+   /* The variables must share the record dimension and its length */
+   dim_id = ((NCid_Dim_Type **) ncvars[0]->at_ncdims->data)[0]->dim_id;
+   first_record = bufs[0]->first_record;
+   chunk_recs = bufs[0]->chunk_recs;
+   capacity = bufs[0]->capacity;
+   for (v = 1; v < nvars; v++)
+     {
+	b = bufs[v];
+	if ((((NCid_Dim_Type **) ncvars[v]->at_ncdims->data)[0]->dim_id != dim_id)
+	    || (b->first_record != first_record))
+	  {
+	     SLang_verror (SL_InvalidParm_Error, "_nc_append_record: the variables must have the same record dimension and number of records");
+	     goto return_error;
+	  }
+	if (b->chunk_recs != chunk_recs)
+	  chunk_recs = 1;
+	if (b->capacity < capacity)
+	  capacity = b->capacity;
+     }
+   capacity -= capacity % chunk_recs;
+   for (v = 0; v < nvars; v++)
+     {
+	bufs[v]->capacity = capacity;
+	bufs[v]->chunk_recs = chunk_recs;
+     }
+   return 0;
+
+return_error:
+   while (NULL != (b = find_record_set (record_set)))
+     delete_append_buffer (b);
+   return -1;
+}
+
+/* Usage: _nc_append_record (values, varids, ncid)
+ * Append a record to each of the variables of the varids array, which must
+ * share the unlimited first dimension.  The values array contains the
+ * record of each variable.  The values are checked and converted before
+ * any of them are buffered.
+ */
+static void sl_nc_append_record (NCid_Type *nc)
+{
+   SLang_Array_Type *at_values = NULL, *at_varids = NULL;
+   SLang_Array_Type **values, **converted = NULL;
+   Append_Buffer_Type **bufs = NULL;
+   NCid_Var_Type **ncvars;
+   size_t v, nvars;
+
+   /* Unlike check_ncid_type, this does not flush the buffers */
+   if ((-1 == check_ncid_is_open (nc))
+       || (-1 == sync_file_writes (nc)))
+     return;
+
+   if ((-1 == SLang_pop_array_of_type (&at_varids, NCid_Var_Type_Id))
+       || (-1 == SLang_pop_array_of_type (&at_values, SLANG_ARRAY_TYPE)))
+     goto free_and_return;
+
+   ncvars = (NCid_Var_Type **) at_varids->data;
+   values = (SLang_Array_Type **) at_values->data;
+   nvars = at_varids->num_elements;
+   if ((nvars == 0) || (at_values->num_elements != nvars))
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_append_record: expected a value for each of the variables");
+	goto free_and_return;
+     }
 
-	     for (i = 0; i < field_num_elems; i++)
-	       {
-		  if (NULL == (sp[i] = SLang_create_slstring (at_sp[i])))
-		    {
-		       while (i != 0)
-			 {
-			    i--;
-			    SLang_free_slstring (sp[i]);
-			    sp[i] = NULL;
-			 }
-		       status = -1;
-		       break;
-		    }
-	       }
+   if ((NULL == (bufs = (Append_Buffer_Type **) SLcalloc (nvars, sizeof (Append_Buffer_Type *))))
+       || (NULL == (converted = (SLang_Array_Type **) SLcalloc (nvars, sizeof (SLang_Array_Type *)))))
+     goto free_and_return;
+
+   for (v = 0; v < nvars; v++)
+     {
+	if (-1 == update_var_cache (nc->ncid, ncvars[v]))
+	  goto free_and_return;
+     }
+   if (-1 == get_record_set (nc, ncvars, nvars, bufs))
+     goto free_and_return;
+
+   for (v = 0; v < nvars; v++)
+     {
+	if ((values[v] == NULL)
+	    || (-1 == SLang_push_array (values[v], 0))
+	    || (-1 == SLang_pop_array_of_type (&converted[v], bufs[v]->sltype)))
+	  goto free_and_return;
+	if (converted[v]->num_elements != bufs[v]->rec_size)
+	  {
+	     SLang_verror (SL_InvalidParm_Error, "_nc_append_record: expected %lu values for variable %lu, found %lu",
+			   (unsigned long) bufs[v]->rec_size, (unsigned long) v,
+			   (unsigned long) converted[v]->num_elements);
+	     goto free_and_return;
 	  }
-	break;
+     }
 
-      default:
-	if (at == NULL)
-	  return SLang_pop_value (sltype, data);
-	memcpy (data, at->data, field_num_elems*at->sizeof_type);
+   /* The buffers are full, or the set inconsistent, only if an earlier
+    * flush failed.  No record is added until it has been completed.
+    */
+   if ((bufs[0]->is_inconsistent || record_set_is_full (bufs[0]))
+       && (-1 == flush_record_set (bufs[0]->record_set)))
+     goto free_and_return;
+
+   for (v = 0; v < nvars; v++)
+     {
+	if (-1 == sync_first_record (bufs[v]))
+	  goto free_and_return;
      }
-   if (at != NULL) SLang_free_array (at);
-   return status;
+
+   for (v = 0; v < nvars; v++)
+     {
+	Append_Buffer_Type *b = bufs[v];
+	size_t rec_bytes = b->rec_size * b->sizeof_type;
+
+	memcpy (b->data + b->num_buffered * rec_bytes, converted[v]->data, rec_bytes);
+	b->num_buffered++;
+     }
+
+   /* The buffers of the set are filled in step */
+   if (record_set_is_full (bufs[0]))
+     (void) flush_record_set (bufs[0]->record_set);
+
+free_and_return:
+   if (converted != NULL)
+     {
+	for (v = 0; v < nvars; v++)
+	  SLang_free_array (converted[v]);   /* NULL ok */
+	SLfree ((char *) converted);
+     }
+   SLfree ((char *) bufs);	       /* NULL ok */
+   SLang_free_array (at_varids);       /* NULL ok */
+   SLang_free_array (at_values);       /* NULL ok */
 }
 
-static void free_compound (int ncid, nc_type xtype, size_t num_elements, unsigned char *data);
+/*}}}*/
 
-static void free_compound_fields (unsigned char *compound_data, int ncid, Compound_Info_Type *cinfo)
+/*{{{ Write-behind queues */
+
+/* If asynchronous writes are enabled for a file, _nc_put copies the data of
+ * a numeric hyperslab into a request and appends it to the queue of the
+ * file, and a worker thread writes the queued requests in order.  The queue
+ * is bounded by the number of requests and their total size, and a put
+ * blocks while the queue is full.  Every other operation on the file waits
+ * until the queue has been written, so that it sees the effect of the
+ * earlier puts.  Like the record readers, the worker never calls into
+ * slang: the first error is recorded and thrown by the main thread on the
+ * next operation on the file.
+ */
+typedef struct _Write_Request_Type
 {
-   size_t i, nfields;
+   int ncid, varid;
+   nc_type xtype;
+   unsigned int num_dims;
+   size_t *start, *count;	       /* these follow the structure */
+   ptrdiff_t *stride;		       /* NULL for unit strides */
+   size_t nbytes;
+   void *data;
+   struct _Write_Request_Type *next;
+}
+Write_Request_Type;
 
-   nfields = cinfo->nfields;
+typedef struct _Write_Queue_Type
+{
+   int root_ncid;
+   unsigned int max_requests;
+   size_t max_bytes;
+   unsigned int num_requests;	       /* queued or being written */
+   size_t num_bytes;
+   Write_Request_Type *head, *tail;
+   pthread_t thread;
+   pthread_mutex_t mutex;
+   pthread_cond_t cond;
+   int stop;
+   int status;			       /* first error of the worker */
+   struct _Write_Queue_Type *next;
+}
+Write_Queue_Type;
 
-   for (i = 0; i < nfields; i++)
+static Write_Queue_Type *Write_Queue_List = NULL;
+
+static Write_Queue_Type *find_write_queue (int root_ncid)
+{
+   Write_Queue_Type *q;
+
+   for (q = Write_Queue_List; q != NULL; q = q->next)
      {
-	size_t j, num_elements;
-	unsigned char *data;
-	nc_type field_xtype = cinfo->field_xtypes[i];
-	int xclass;
+	if (q->root_ncid == root_ncid)
+	  return q;
+     }
+   return NULL;
+}
 
-	data = compound_data + cinfo->field_offsets[i];
-	num_elements = cinfo->field_num_elems[i];
-	if (field_xtype == NC_STRING)
-	  {
-	     char **sp = (char **)(data);
+/* The requests are allocated with malloc since they are freed by the
+ * worker thread.
+ */
+static void free_write_request (Write_Request_Type *w)
+{
+   free (w->data);		       /* NULL ok */
+   free (w);
+}
 
-	     for (j = 0; j < num_elements; j++)
-	       SLang_free_slstring (sp[j]);   /* NULL ok */
+static void *writer_thread (void *arg)
+{
+   Write_Queue_Type *q = (Write_Queue_Type *) arg;
 
+   (void) pthread_mutex_lock (&q->mutex);
+   while (1)
+     {
+	Write_Request_Type *w = q->head;
+	int status, failed;
+
+	if (w == NULL)
+	  {
+	     if (q->stop)
+	       break;
+	     (void) pthread_cond_wait (&q->cond, &q->mutex);
 	     continue;
 	  }
+	failed = (q->status != NC_NOERR);
+	(void) pthread_mutex_unlock (&q->mutex);
 
-	if (field_xtype <= NC_MAX_ATOMIC_TYPE)
-	  continue;
+	/* The request stays at the head of the queue while it is written.
+	 * After an error, the queued requests are discarded until the error
+	 * has been reported.
+	 */
+	status = NC_NOERR;
+	if (failed == 0)
+	  status = put_atomic_slab (w->ncid, w->varid, w->start, w->count,
+				    w->stride, NULL, w->xtype, w->data);
+
+	(void) pthread_mutex_lock (&q->mutex);
+	if (q->status == NC_NOERR)
+	  q->status = status;
+	q->head = w->next;
+	if (q->head == NULL)
+	  q->tail = NULL;
+	q->num_requests--;
+	q->num_bytes -= w->nbytes;
+	free_write_request (w);
+	(void) pthread_cond_broadcast (&q->cond);
+     }
+   (void) pthread_mutex_unlock (&q->mutex);
+   return NULL;
+}
 
-	if (-1 == get_nc_xclass (ncid, field_xtype, &xclass))
-	  continue;	       /* ???? */
-	if (xclass == NC_COMPOUND)
+/* Wait until the queue has been written, and return the first error of the
+ * worker, which is cleared.
+ */
+static int drain_write_queue (Write_Queue_Type *q)
+{
+   int status;
+
+   (void) pthread_mutex_lock (&q->mutex);
+   while (q->num_requests != 0)
+     (void) pthread_cond_wait (&q->cond, &q->mutex);
+   status = q->status;
+   q->status = NC_NOERR;
+   (void) pthread_mutex_unlock (&q->mutex);
+   return status;
+}
+
+/* This is called by check_ncid_type before an operation on the file */
+static int sync_file_writes (NCid_Type *nc)
+{
+   Write_Queue_Type *q;
+   int root_ncid, status;
+
+   if (Write_Queue_List == NULL)
+     return 0;
+   if (-1 == get_root_ncid (nc, &root_ncid))
+     return -1;
+   if (NULL == (q = find_write_queue (root_ncid)))
+     return 0;
+
+   if (NC_NOERR != (status = drain_write_queue (q)))
+     {
+	throw_nc_error ("_nc_put (asynchronous)", status);
+	return -1;
+     }
+   return 0;
+}
+
+/* Write the queue, stop the worker, and free the queue.  This is called
+ * before a file is closed.  The first error of the worker is returned.
+ */
+static int stop_file_writes (int root_ncid)
+{
+   Write_Queue_Type *q, *prev;
+   int status;
+
+   if (NULL == (q = find_write_queue (root_ncid)))
+     return NC_NOERR;
+
+   status = drain_write_queue (q);
+   (void) pthread_mutex_lock (&q->mutex);
+   q->stop = 1;
+   (void) pthread_cond_broadcast (&q->cond);
+   (void) pthread_mutex_unlock (&q->mutex);
+   (void) pthread_join (q->thread, NULL);
+
+   if (Write_Queue_List == q)
+     Write_Queue_List = q->next;
+   else for (prev = Write_Queue_List; prev != NULL; prev = prev->next)
+     {
+	if (prev->next == q)
 	  {
-	     free_compound (ncid, field_xtype, num_elements, data);
-	     continue;
+	     prev->next = q->next;
+	     break;
 	  }
      }
+   (void) pthread_cond_destroy (&q->cond);
+   (void) pthread_mutex_destroy (&q->mutex);
+   SLfree ((char *) q);
+   return status;
 }
 
-static void free_compound_data_items (int ncid, Compound_Info_Type *cinfo, unsigned char *data, size_t num_elements)
+/* Queue a write of the array to the hyperslab.  If the file does not have
+ * a write queue, or the array is not of a numeric type, 0 is returned and
+ * the caller should write the array itself.  Otherwise 1 is returned if
+ * the write was queued, or -1 upon error.
+ */
+static int queue_async_write (NCid_Type *nc, NCid_Var_Type *ncvar,
+			      size_t *start, size_t *count, ptrdiff_t *stride,
+			      SLang_Array_Type *at)
 {
-   size_t i;
+   Write_Queue_Type *q;
+   Write_Request_Type *w;
+   nc_type xtype;
+   unsigned int i, num_dims;
+   size_t nbytes;
+   int root_ncid, status;
 
-   for (i = 0; i < num_elements; i++)
+   if (Write_Queue_List == NULL)
+     return 0;
+   if (-1 == get_root_ncid (nc, &root_ncid))
+     return -1;
+   if (NULL == (q = find_write_queue (root_ncid)))
+     return 0;
+
+   switch (at->data_type)
      {
-	free_compound_fields (data, ncid, cinfo);
-	data += cinfo->size;
+      case SLANG_STRING_TYPE:
+      case SLANG_STRUCT_TYPE:
+	return 0;
+     }
+   if (-1 == map_base_sltype_to_xtype (at->data_type, &xtype))
+     return -1;
+
+   num_dims = ncvar->num_dims;
+   nbytes = at->num_elements * at->sizeof_type;
+   if ((NULL == (w = (Write_Request_Type *) calloc (1, sizeof (Write_Request_Type)
+						     + num_dims * (2*sizeof (size_t) + sizeof (ptrdiff_t)))))
+       || (NULL == (w->data = malloc (nbytes ? nbytes : 1))))
+     {
+	free (w);		       /* NULL ok */
+	SLang_set_error (SL_Malloc_Error);
+	return -1;
+     }
+   memcpy (w->data, at->data, nbytes);
+   w->ncid = nc->ncid;
+   w->varid = ncvar->var_id;
+   w->xtype = xtype;
+   w->num_dims = num_dims;
+   w->nbytes = nbytes;
+   w->start = (size_t *) (w + 1);
+   w->count = w->start + num_dims;
+   w->stride = (stride != NULL) ? (ptrdiff_t *) (w->count + num_dims) : NULL;
+   for (i = 0; i < num_dims; i++)
+     {
+	w->start[i] = start[i];
+	w->count[i] = count[i];
+	if (stride != NULL)
+	  w->stride[i] = stride[i];
+     }
+
+   /* Apply back-pressure while the queue is full.  A request that is
+    * larger than the memory limit is queued when the queue is empty.
+    */
+   (void) pthread_mutex_lock (&q->mutex);
+   while ((q->status == NC_NOERR)
+	  && ((q->num_requests >= q->max_requests)
+	      || ((q->num_requests != 0) && (q->num_bytes + nbytes > q->max_bytes))))
+     (void) pthread_cond_wait (&q->cond, &q->mutex);
+
+   if (NC_NOERR != (status = q->status))
+     {
+	q->status = NC_NOERR;
+	(void) pthread_mutex_unlock (&q->mutex);
+	free_write_request (w);
+	throw_nc_error ("_nc_put (asynchronous)", status);
+	return -1;
      }
+   if (q->tail == NULL)
+     q->head = w;
+   else
+     q->tail->next = w;
+   q->tail = w;
+   q->num_requests++;
+   q->num_bytes += nbytes;
+   (void) pthread_cond_broadcast (&q->cond);
+   (void) pthread_mutex_unlock (&q->mutex);
+
+   /* The cached shape reflects the write as soon as it is queued */
+   note_var_write (nc->ncid, ncvar, start, count, stride);
+   return 1;
 }
 
-/* Free the items on the compound data list */
-static void free_compound (int ncid, nc_type xtype, size_t num_elements, unsigned char *data)
+/* Usage: _nc_async_writes (max_requests, max_bytes, ncid)
+ * Enable asynchronous writes for the file.  At most max_requests puts
+ * totalling max_bytes are queued.  If max_bytes is NULL, the default
+ * memory budget is used.
+ */
+static void sl_nc_async_writes (NCid_Type *nc)
 {
-   Compound_Info_Type cinfo;
+   Write_Queue_Type *q;
+   unsigned int max_requests;
+   size_t max_bytes;
+   int root_ncid;
 
-   if (-1 == init_compound_info (ncid, xtype, &cinfo, 1))
+   if ((-1 == pop_max_bytes (&max_bytes))
+       || (-1 == SLang_pop_uint (&max_requests)))
      return;
-   free_compound_data_items (ncid, &cinfo, data, num_elements);
-   free_compound_info (&cinfo);
+   if (max_requests == 0)
+     {
+	SLang_verror (SL_InvalidParm_Error, "_nc_async_writes: the number of queued writes must be positive");
+	return;
+     }
+
+   if ((-1 == check_ncid_type (nc))
+       || (-1 == get_root_ncid (nc, &root_ncid)))
+     return;
+
+   if (NULL != (q = find_write_queue (root_ncid)))
+     {
+	(void) pthread_mutex_lock (&q->mutex);
+	q->max_requests = max_requests;
+	q->max_bytes = max_bytes;
+	(void) pthread_cond_broadcast (&q->cond);
+	(void) pthread_mutex_unlock (&q->mutex);
+	return;
+     }
+
+   if (NULL == (q = (Write_Queue_Type *) SLcalloc (1, sizeof (Write_Queue_Type))))
+     return;
+   q->root_ncid = root_ncid;
+   q->max_requests = max_requests;
+   q->max_bytes = max_bytes;
+   q->status = NC_NOERR;
+   (void) pthread_mutex_init (&q->mutex, NULL);
+   (void) pthread_cond_init (&q->cond, NULL);
+   if (0 != pthread_create (&q->thread, NULL, writer_thread, (void *) q))
+     {
+	SLang_verror (SL_OS_Error, "_nc_async_writes: unable to create the writer thread");
+	(void) pthread_cond_destroy (&q->cond);
+	(void) pthread_mutex_destroy (&q->mutex);
+	SLfree ((char *) q);
+	return;
+     }
+   q->next = Write_Queue_List;
+   Write_Queue_List = q;
 }
 
+/*}}}*/
 
-/*
- * This function embeds the field values of an array of slang structs into the data buffer.
+/*{{{ Read futures */
+
+/* _nc_get_async queues the read of a hyperslab and returns a future whose
+ * values are returned by _nc_future_wait.  The reads of all files are made
+ * in order by a single I/O thread, which never calls into slang.  The
+ * thread is started by the first read, and stopped when a file is closed
+ * and no reads of other files are queued, or when the module is unloaded.
+ * The values are read into slang arrays that are kept in a small pool.
+ * An array of the pool whose only reference is held by the pool may be
+ * reused by a read of the same type and shape, so that a loop that reads
+ * the same hyperslab shape while processing the previous one does not
+ * allocate.
  */
-static int embed_compound (int ncid, Compound_Info_Type *cinfo, SLang_Struct_Type **sp, size_t num_elements, unsigned char *data)
+#define FUTURE_QUEUED	0
+#define FUTURE_READING	1
+#define FUTURE_DONE	2
+#define FUTURE_STOPPED	3
+
+#define FUTURE_POOL_SIZE 4
+
+static int NCid_Future_Type_Id = 0;
+typedef struct _NCid_Future_Type
 {
-   size_t nfields, i, size;
-   size_t *field_offsets = NULL, *field_num_elems = NULL;
-   char **field_names;
-   nc_type *field_xtypes = NULL;
-   unsigned char *compound_data;
+   int ncid, root_ncid, varid;
+   unsigned int num_dims;
+   size_t *start, *count;	       /* NULL for a scalar variable */
+   SLang_Array_Type *at;	       /* receives the values */
+   int state;
+   int status;			       /* netCDF status of the read */
+   unsigned int numrefs;
+   struct _NCid_Future_Type *next;     /* the queue of the I/O thread */
+}
+NCid_Future_Type;
+
+static NCid_Future_Type *Future_Queue = NULL, *Future_Queue_Tail = NULL;
+static pthread_t Future_Thread;
+static pthread_mutex_t Future_Mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t Future_Cond = PTHREAD_COND_INITIALIZER;
+static NCid_Future_Type *Future_Reading = NULL;
+static int Have_Future_Thread = 0;
+static int Stop_Future_Thread = 0;
+static SLang_Array_Type *Future_Pool[FUTURE_POOL_SIZE];
+
+static void *future_thread (void *arg)
+{
+   (void) arg;
 
-   for (i = 0; i < num_elements; i++)
+   (void) pthread_mutex_lock (&Future_Mutex);
+   while (1)
      {
-	if (sp[i] == NULL)
+	NCid_Future_Type *f = Future_Queue;
+	int status;
+
+	if (f == NULL)
 	  {
-	     SLang_verror (SL_InvalidParm_Error, "A compound array-element cannot be NULL");
-	     return -1;
+	     if (Stop_Future_Thread)
+	       break;
+	     (void) pthread_cond_wait (&Future_Cond, &Future_Mutex);
+	     continue;
 	  }
+	Future_Queue = f->next;
+	if (Future_Queue == NULL)
+	  Future_Queue_Tail = NULL;
+	f->next = NULL;
+	f->state = FUTURE_READING;
+	Future_Reading = f;
+	(void) pthread_mutex_unlock (&Future_Mutex);
+
+	status = nc_get_vara (f->ncid, f->varid, f->start, f->count, f->at->data);
+
+	(void) pthread_mutex_lock (&Future_Mutex);
+	f->status = status;
+	f->state = FUTURE_DONE;
+	Future_Reading = NULL;
+	(void) pthread_cond_broadcast (&Future_Cond);
+     }
+   (void) pthread_mutex_unlock (&Future_Mutex);
+   return NULL;
+}
+
+/* Remove a queued future from the queue.  The mutex must be held. */
+static void unqueue_future (NCid_Future_Type *f)
+{
+   NCid_Future_Type *prev = NULL, *g;
+
+   for (g = Future_Queue; g != NULL; g = g->next)
+     {
+	if (g == f)
+	  break;
+	prev = g;
      }
+   if (g == NULL)
+     return;
+   if (prev == NULL)
+     Future_Queue = f->next;
+   else
+     prev->next = f->next;
+   if (Future_Queue_Tail == f)
+     Future_Queue_Tail = prev;
+   f->next = NULL;
+}
 
-   size = cinfo->size;
-   memset (data, 0, size*num_elements);
+/* Wait until the future is not being read.  A queued future is removed
+ * from the queue and marked as stopped.
+ */
+static void cancel_future (NCid_Future_Type *f)
+{
+   (void) pthread_mutex_lock (&Future_Mutex);
+   if (f->state == FUTURE_QUEUED)
+     {
+	unqueue_future (f);
+	f->state = FUTURE_STOPPED;
+     }
+   while (f->state == FUTURE_READING)
+     (void) pthread_cond_wait (&Future_Cond, &Future_Mutex);
+   (void) pthread_mutex_unlock (&Future_Mutex);
+}
 
-   field_offsets = cinfo->field_offsets;
-   field_xtypes = cinfo->field_xtypes;
-   field_names = cinfo->field_names;
-   field_num_elems = cinfo->field_num_elems;
-   nfields = cinfo->nfields;
+/* Stop the queued reads of the file, or of all files if root_ncid is -1.
+ * The mutex must be held.
+ */
+static void stop_queued_futures (int root_ncid)
+{
+   NCid_Future_Type *f, *next;
 
-   compound_data = data;
-   for (i = 0; i < num_elements; i++)
+   for (f = Future_Queue; f != NULL; f = next)
      {
-	SLang_Struct_Type *s = sp[i];
-	size_t j;
+	next = f->next;
+	if ((root_ncid != -1) && (f->root_ncid != root_ncid))
+	  continue;
+	unqueue_future (f);
+	f->state = FUTURE_STOPPED;
+     }
+}
 
-	for (j = 0; j < nfields; j++)
-	  {
-	     if (-1 == SLang_push_struct_field (s, field_names[j]))
-	       goto return_error;
-	     if (-1 == pop_compound_element (ncid, compound_data + field_offsets[j], j, field_xtypes[j], field_names[j], field_num_elems[j]))
-	       goto return_error;
-	  }
-	compound_data += size;
+/* Stop the queued reads, and wait for the I/O thread to finish the read in
+ * progress and exit.
+ */
+static void stop_future_thread (void)
+{
+   if (Have_Future_Thread == 0)
+     return;
+
+   (void) pthread_mutex_lock (&Future_Mutex);
+   stop_queued_futures (-1);
+   Stop_Future_Thread = 1;
+   (void) pthread_cond_broadcast (&Future_Cond);
+   (void) pthread_mutex_unlock (&Future_Mutex);
+   (void) pthread_join (Future_Thread, NULL);
+
+   Stop_Future_Thread = 0;
+   Have_Future_Thread = 0;
+}
+
+/* This is called before a file is closed.  Its queued reads are stopped,
+ * and a read in progress is waited for.  The I/O thread is stopped if it
+ * has no reads of other files.
+ */
+static void stop_file_futures (int root_ncid)
+{
+   int is_idle;
+
+   if (Have_Future_Thread == 0)
+     return;
+
+   (void) pthread_mutex_lock (&Future_Mutex);
+   stop_queued_futures (root_ncid);
+   while ((Future_Reading != NULL) && (Future_Reading->root_ncid == root_ncid))
+     (void) pthread_cond_wait (&Future_Cond, &Future_Mutex);
+   is_idle = ((Future_Queue == NULL) && (Future_Reading == NULL));
+   (void) pthread_mutex_unlock (&Future_Mutex);
+
+   if (is_idle)
+     stop_future_thread ();
+}
+
+static void free_ncid_future_type (NCid_Future_Type *f)
+{
+   if (f == NULL) return;
+   if (f->numrefs > 1)
+     {
+	f->numrefs--;
+	return;
      }
-   return 0;
-
-return_error:
+   cancel_future (f);
+   SLang_free_array (f->at);	       /* NULL ok */
+   SLfree ((char *) f->start);	       /* NULL ok */
+   SLfree ((char *) f->count);	       /* NULL ok */
+   SLfree ((char *) f);
+}
 
-   free_compound_data_items (ncid, cinfo, data, num_elements);
+static int push_ncid_future_type (NCid_Future_Type *f)
+{
+   f->numrefs++;
+   if (0 == SLclass_push_ptr_obj (NCid_Future_Type_Id, (VOID_STAR) f))
+     return 0;
+   f->numrefs--;
    return -1;
 }
 
-
-/* This gets called with at->data_type == SLANG_STRUCT_TYPE */
-static int put_compound (int ncid, int varid, nc_type xtype, size_t *start, size_t *count, ptrdiff_t *stride,
-			 SLang_Array_Type *at, const char *attr_name)
+/* Get an array of the given type and shape from the pool, or create one.
+ * The returned array has a reference for the caller.
+ */
+static SLang_Array_Type *get_pooled_array (SLtype sltype, SLindex_Type *dims, unsigned int num_dims)
 {
-   Compound_Info_Type cinfo;
-   size_t size;
-   unsigned char *compound_data;
-   SLuindex_Type num_elements;
-   int status;
-
-   if (-1 == init_compound_info (ncid, xtype, &cinfo, 1))
-     return -1;
-   size = cinfo.size;
+   SLang_Array_Type *at;
+   unsigned int i, j, k;
 
-   num_elements = at->num_elements;
-   if ((NULL == (compound_data = (unsigned char *)SLmalloc(num_elements*size)))
-       || (-1 == embed_compound (ncid, &cinfo, (SLang_Struct_Type **)at->data, at->num_elements, compound_data)))
+   k = FUTURE_POOL_SIZE;
+   for (i = 0; i < FUTURE_POOL_SIZE; i++)
      {
-	free_compound_info (&cinfo);
-	return -1;
+	at = Future_Pool[i];
+	if (at == NULL)
+	  {
+	     if (k == FUTURE_POOL_SIZE) k = i;
+	     continue;
+	  }
+	if (at->num_refs != 1)
+	  continue;
+	if ((at->data_type == sltype) && (at->num_dims == num_dims))
+	  {
+	     for (j = 0; j < num_dims; j++)
+	       {
+		  if (at->dims[j] != dims[j])
+		    break;
+	       }
+	     if (j == num_dims)
+	       {
+		  at->num_refs++;
+		  return at;
+	       }
+	  }
+	if (k == FUTURE_POOL_SIZE) k = i;
      }
 
-   if (attr_name != NULL)
-     status = nc_put_att (ncid, varid, attr_name, xtype, num_elements, compound_data);
-   else if (stride == NULL)
-     status = nc_put_vara (ncid, varid, start, count, compound_data);
-   else
-     status = nc_put_vars (ncid, varid, start, count, stride, compound_data);
-   if (status != NC_NOERR)
+   if (NULL == (at = SLang_create_array (sltype, 0, NULL, dims, num_dims)))
+     return NULL;
+
+   /* Replace an unused entry */
+   if (k != FUTURE_POOL_SIZE)
      {
-	throw_nc_error ("nc_put_xxx", status);
-	status = -1;
+	SLang_free_array (Future_Pool[k]);   /* NULL ok */
+	Future_Pool[k] = at;
+	at->num_refs++;
      }
-   else status = 0;
-
-   free_compound_data_items (ncid, &cinfo, compound_data, num_elements);
-   SLfree (compound_data);
-   free_compound_info (&cinfo);
-
-   return status;
+   return at;
 }
 
-
-/* If there are no unlimited dims, *unlim_dimsp will be NULL. */
-static int get_unlimited_dim_ids (int ncid, int **unlim_dimsp, int *num_unlimp)
+/* Usage: future = _nc_get_async (start, count, stride, ncid, varid)
+ * Queue the read of a hyperslab of a numeric variable and return a future
+ * for it.  The stride must be NULL or 1.
+ */
+static void sl_nc_get_async (NCid_Type *nc, NCid_Var_Type *ncvar)
 {
-   int *unlim_dims;
-   int num_unlim, status;
+   NCid_Future_Type *f;
+   Slice_Type slice;
+   SLang_Array_Type *at;
+   SLindex_Type at_dims[SLARRAY_MAX_DIMS], one = 1;
+   unsigned int i, num_dims;
+   nc_type xtype;
+   SLtype sltype;
 
-   *unlim_dimsp = unlim_dims = NULL;
-   *num_unlimp = 0;
-   if (NC_NOERR != (status = nc_inq_unlimdims (ncid, &num_unlim, unlim_dims)))
+   if ((-1 == check_ncid_type (nc))
+       || (-1 == get_var_sltype (nc->ncid, ncvar, &xtype, &sltype))
+       || (-1 == pop_slice (nc, ncvar, 1, NULL, &slice)))
+     return;
+
+   /* The values are read without conversion */
+   if (NULL == (at = SLang_create_array (sltype, 0, NULL, &one, 1)))
+     return;
+   i = at->sizeof_type;
+   SLang_free_array (at);
+   if ((xtype > NC_MAX_ATOMIC_TYPE) || (xtype == NC_STRING) || (i != ncvar->xsize))
      {
-	throw_nc_error ("nc_inq_unlimdims", status);
-	return -1;
+	SLang_verror (SL_NotImplemented_Error, "_nc_get_async: only numeric types are supported");
+	return;
+     }
+   if (slice.has_stride)
+     {
+	SLang_verror (SL_NotImplemented_Error, "_nc_get_async: strides are not supported");
+	return;
      }
-   if (num_unlim <= 0) return 0;
-
-   if (NULL == (unlim_dims = (int *)SLmalloc(num_unlim * sizeof(int))))
-     return -1;
 
-   if (NC_NOERR != (status = nc_inq_unlimdims (ncid, NULL, unlim_dims)))
+   num_dims = slice.num_dims;
+   if (num_dims > SLARRAY_MAX_DIMS)
      {
-	throw_nc_error ("nc_inq_unlimdims", status);
-	SLfree (unlim_dims);
-	return -1;
+	SLang_verror (SL_LimitExceeded_Error, "_nc_get_async: slang arrays are limited to %d dimensions",
+		      SLARRAY_MAX_DIMS);
+	return;
      }
-   *unlim_dimsp = unlim_dims;
-   *num_unlimp = num_unlim;
-   return 0;
-}
+   for (i = 0; i < num_dims; i++)
+     at_dims[i] = slice.count[i];
 
-/* unlim_dims could be NULL indicating that there are no unlimited dimensions */
-static NCid_Dim_Type *inq_and_create_dim (int ncid, int dimid, int *unlim_dims, int num_unlim)
-{
-   size_t len;
-   int is_unlim, status;
+   if (NULL == (f = (NCid_Future_Type *) SLcalloc (1, sizeof (NCid_Future_Type))))
+     return;
+   f->numrefs = 1;
+   f->ncid = nc->ncid;
+   f->varid = ncvar->var_id;
+   f->num_dims = num_dims;
+   f->state = FUTURE_DONE;
+   f->status = NC_NOERR;
+
+   if (-1 == get_root_ncid (nc, &f->root_ncid))
+     goto free_and_return;
 
-   is_unlim = 0;
-   if (unlim_dims != NULL)
+   if (num_dims == 0)
+     f->at = get_pooled_array (sltype, &one, 1);
+   else
      {
-	int i;
+	if ((NULL == (f->start = (size_t *) SLmalloc (num_dims * sizeof (size_t))))
+	    || (NULL == (f->count = (size_t *) SLmalloc (num_dims * sizeof (size_t)))))
+	  goto free_and_return;
+	memcpy (f->start, slice.start, num_dims * sizeof (size_t));
+	memcpy (f->count, slice.count, num_dims * sizeof (size_t));
+	f->at = get_pooled_array (sltype, at_dims, num_dims);
+     }
+   if (f->at == NULL)
+     goto free_and_return;
 
-	for (i = 0; i < num_unlim; i++)
+   if (f->at->num_elements != 0)
+     {
+	if (Have_Future_Thread == 0)
 	  {
-	     if (dimid == unlim_dims[i])
+	     if (0 != pthread_create (&Future_Thread, NULL, future_thread, NULL))
 	       {
-		  len = 0;
-		  is_unlim = 1;
-		  break;
+		  SLang_verror (SL_OS_Error, "_nc_get_async: unable to create the I/O thread");
+		  goto free_and_return;
 	       }
+	     Have_Future_Thread = 1;
 	  }
+	(void) pthread_mutex_lock (&Future_Mutex);
+	f->state = FUTURE_QUEUED;
+	if (Future_Queue_Tail == NULL)
+	  Future_Queue = f;
+	else
+	  Future_Queue_Tail->next = f;
+	Future_Queue_Tail = f;
+	(void) pthread_cond_broadcast (&Future_Cond);
+	(void) pthread_mutex_unlock (&Future_Mutex);
      }
 
-   if ((is_unlim == 0)
-       && (NC_NOERR != (status = nc_inq_dimlen (ncid, dimid, &len))))
-     {
-	throw_nc_error ("nc_inq_dimlen", status);
-	return NULL;
-     }
-
-   return alloc_ncid_dim_type (ncid, dimid, len);
+   (void) push_ncid_future_type (f);
+   /* drop */
+free_and_return:
+   free_ncid_future_type (f);
 }
 
-#if 0
-/* You would think that nc_inq_grp_full_ncid(ncid, "/", &root_ncid)
- * would suffice.  But,....no.
+/* Usage: data = _nc_future_wait (future)
+ * Wait for the read of the future and return its values.  The values may
+ * be returned more than once.
  */
-static int get_root_ncid (NCid_Type *nc, int *ncidp)
+static void sl_nc_future_wait (NCid_Future_Type *f)
 {
-   int ncid = nc->ncid;
-   if (0 == nc->is_group)
+   int state, status;
+
+   (void) pthread_mutex_lock (&Future_Mutex);
+   while ((f->state == FUTURE_QUEUED) || (f->state == FUTURE_READING))
+     (void) pthread_cond_wait (&Future_Cond, &Future_Mutex);
+   state = f->state;
+   status = f->status;
+   (void) pthread_mutex_unlock (&Future_Mutex);
+
+   if (state == FUTURE_STOPPED)
      {
-	*ncidp = ncid;
-	return 0;
+	SLang_verror (SL_InvalidParm_Error, "The file of the asynchronous read has been closed");
+	return;
      }
-
-   while (1)
+   if (status != NC_NOERR)
      {
-	int status, root;
-	status = nc_inq_grp_parent (ncid, &root);
-	if (status == NC_ENOGRP)
-	  break;
-	if (status != NC_NOERR)
-	  {
-	     throw_nc_error ("nc_inq_grp_parent", status);
-	     return -1;
-	  }
-	if (root == ncid) break;
-	ncid = root;
+	throw_nc_error ("nc_get_vara", status);
+	return;
      }
-   *ncidp = ncid;
-   return 0;
+   if (f->num_dims == 0)
+     (void) SLang_push_value (f->at->data_type, f->at->data);
+   else
+     (void) SLang_push_array (f->at, 0);
 }
-#endif
+
+/* Usage: flag = _nc_future_ready (future)
+ * Return 1 if _nc_future_wait would not block, or 0 otherwise.
+ */
+static int sl_nc_future_ready (NCid_Future_Type *f)
+{
+   int ready;
+
+   (void) pthread_mutex_lock (&Future_Mutex);
+   ready = ((f->state != FUTURE_QUEUED) && (f->state != FUTURE_READING));
+   (void) pthread_mutex_unlock (&Future_Mutex);
+   return ready;
+}
+
+/*}}}*/
 
 /*{{{ Attribute Functions */
 
@@ -2455,7 +9322,12 @@ static void sl_nc_inq_dim (NCid_Type *nc, NCid_Dim_Type *ncdim)
 
 static void sl_nc_inq_varname (NCid_Type *nc, NCid_Var_Type *ncvar)
 {
-   char *name = get_varname (nc->ncid, ncvar->var_id);
+   char *name;
+
+   if (-1 == check_ncid_type (nc))
+     return;
+
+   name = get_varname (nc->ncid, ncvar->var_id);
    if (name == NULL) return;
    (void) SLang_push_string (name);
    SLang_free_slstring (name);
@@ -2464,38 +9336,27 @@ static void sl_nc_inq_varname (NCid_Type *nc, NCid_Var_Type *ncvar)
 static void sl_nc_inq_varshape (NCid_Type *nc, NCid_Var_Type *ncvar)
 {
    SLang_Array_Type *at_shape;
-   size_t *shape;
-   int *dimids;
-   SLindex_Type i, num_dims;
-
-   if (-1 == check_ncid_type (nc))
-     return;
+   SLindex_Type num_dims;
 
-   if (NULL == (dimids = get_var_dimids (nc->ncid, ncvar->var_id, &num_dims, NULL)))
+   if ((-1 == check_ncid_type (nc))
+       || (-1 == update_var_cache (nc->ncid, ncvar)))
      return;
 
+   num_dims = ncvar->num_dims;
    if (NULL == (at_shape = SLang_create_array (_SL_SIZE_T_TYPE, 0, NULL, &num_dims, 1)))
-     {
-	SLfree (dimids);
-	return;
-     }
+     return;
 
-   shape = (size_t *) at_shape->data;
-   for (i = 0; i < num_dims; i++)
-     {
-	int status = nc_inq_dim (nc->ncid, dimids[i], NULL, shape+i);
-	if (status != NC_NOERR)
-	  {
-	     throw_nc_error ("_nc_inq_dim", status);
-	     goto free_and_return;
-	  }
-     }
+   memcpy (at_shape->data, ncvar->shape, num_dims*sizeof(size_t));
+   (void) SLang_push_array (at_shape, 1);
+}
 
-   SLang_push_array (at_shape, 0);
-   /* drop */
-free_and_return:
-   SLang_free_array (at_shape);
-   SLfree (dimids);
+/* Usage: n = _nc_inq_var_writes (varid)
+ * The number of writes of the variable, which changes whenever values
+ * cached from it may have become stale.
+ */
+static void sl_nc_inq_var_writes (NCid_Var_Type *ncvar)
+{
+   (void) SLang_push_ulong (ncvar->num_writes);
 }
 
 /* Usage: .put_att (data, nc, varid, name, datatype);
@@ -2529,7 +9390,8 @@ static void put_att (NCid_Type *nc, int varid, const char *name, NCid_DataType_T
 	   case NC_COMPOUND:
 	     if (-1 == SLang_pop_array_of_type (&at, SLANG_STRUCT_TYPE))
 	       return;
-	     (void) put_compound (nc->ncid, varid, dtype->xtype, NULL, NULL, NULL, at, name);
+	     (void) put_compound (nc->ncid, varid, dtype->xtype, NULL, NULL, NULL,
+				 (SLang_Struct_Type **)at->data, at->num_elements, name);
 	     SLang_free_array (at);
 	     break;
 
@@ -2692,7 +9554,8 @@ static void get_att (NCid_Type *nc, int varid, const char *name)
 	     sltype = SLANG_STRUCT_TYPE;
 	     if (NULL == (at = SLang_create_array (sltype, 0, NULL, &num, 1)))
 	       return;
-	     if (-1 == get_compound (nc->ncid, varid, xtype, NULL, NULL, NULL, at, name))
+	     if (-1 == get_compound (nc->ncid, varid, xtype, NULL, NULL, NULL,
+				     (SLang_Struct_Type **)at->data, at->num_elements, name))
 	       {
 		  SLang_free_array (at);
 		  return;
@@ -2784,6 +9647,9 @@ static void sl_nc_inq_global_atts (NCid_Type *nc)
 {
    SLang_Array_Type *at;
 
+   if (-1 == check_ncid_type (nc))
+     return;
+
    at = get_var_at_atts (nc->ncid, NC_GLOBAL);
    if (at != NULL)
      SLang_push_array (at, 1);
@@ -2791,8 +9657,12 @@ static void sl_nc_inq_global_atts (NCid_Type *nc)
 
 static void sl_nc_def_grp (NCid_Type *nc, const char *name)
 {
-   int grpid;
-   int status = nc_def_grp (nc->ncid, name, &grpid);
+   int grpid, status;
+
+   if (-1 == check_ncid_type (nc))
+     return;
+
+   status = nc_def_grp (nc->ncid, name, &grpid);
    if (status != NC_NOERR)
      {
 	throw_nc_error ("nc_def_grp", status);
@@ -2803,9 +9673,12 @@ static void sl_nc_def_grp (NCid_Type *nc, const char *name)
 
 static void sl_nc_inq_grp_ncid (NCid_Type *nc, const char *name)
 {
-   int grpid;
-   int status = nc_inq_grp_ncid (nc->ncid, name, &grpid);
+   int grpid, status;
+
+   if (-1 == check_ncid_type (nc))
+     return;
 
+   status = nc_inq_grp_ncid (nc->ncid, name, &grpid);
    if (status != NC_NOERR)
      {
 	throw_nc_error ("nc_inq_grp_ncid", status);
@@ -2822,6 +9695,9 @@ static void sl_nc_inq_grps (NCid_Type *nc)
    SLindex_Type n;
    int status, i, numgrps;
 
+   if (-1 == check_ncid_type (nc))
+     return;
+
    status = nc_inq_grps (nc->ncid, &numgrps, NULL);
    if (status != NC_NOERR)
      {
@@ -2874,6 +9750,9 @@ static void sl_nc_inq_dimid (NCid_Type *nc, const char *name)
    size_t len;
    int status, dimid, i, num_unlim, is_unlim;
 
+   if (-1 == check_ncid_type (nc))
+     return;
+
    status = nc_inq_dimid (nc->ncid, name, &dimid);
    if (status != NC_NOERR)
      {
@@ -2919,6 +9798,9 @@ static void sl_nc_inq_dimids (NCid_Type *nc, int *include_parentsp)
 {
    SLang_Array_Type *at;
 
+   if (-1 == check_ncid_type (nc))
+     return;
+
    at = get_at_ncdims2 (nc, *include_parentsp);
    if (at != NULL)
      (void) SLang_push_array (at, 1);
@@ -3152,7 +10034,8 @@ static void sl_nc_def_compound (NCid_Type *nc, const char *name)
 
    if ((-1 == SLang_pop_array_of_type (&at_dims, SLANG_ARRAY_TYPE))
        || (-1 == SLang_pop_array_of_type (&at_types, NCid_DataType_Type_Id))
-       || (-1 == SLang_pop_array_of_type (&at_field_names, SLANG_STRING_TYPE)))
+       || (-1 == SLang_pop_array_of_type (&at_field_names, SLANG_STRING_TYPE))
+       || (-1 == check_ncid_type (nc)))
      goto free_and_return;
 
    num_fields = at_dims->num_elements;
@@ -3300,10 +10183,42 @@ static void sl_nc_inq_libvers (void)
    (void) SLang_push_string ((char *)nc_inq_libvers());
 }
 
+/* Usage: (calls, contended, wait_time, hold_time, max_hold_time) = _nc_lock_stats (reset)
+ * Return the counters of the lock that serializes the netCDF calls.  The
+ * times are in seconds.  If reset is non-zero, the counters are zeroed
+ * after they have been read.
+ */
+static void sl_nc_lock_stats (int *resetp)
+{
+   NC_Lock_Stats_Type stats;
+
+   (void) pthread_mutex_lock (&NC_Lock);
+   stats = NC_Lock_Stats;
+   if (*resetp)
+     memset ((char *) &NC_Lock_Stats, 0, sizeof (NC_Lock_Stats_Type));
+   (void) pthread_mutex_unlock (&NC_Lock);
+
+   (void) SLang_push_ulong (stats.num_calls);
+   (void) SLang_push_ulong (stats.num_contended);
+   (void) SLang_push_double (stats.wait_time);
+   (void) SLang_push_double (stats.hold_time);
+   (void) SLang_push_double (stats.max_hold_time);
+}
+
+/* Usage: status = _nc_get_errno ()
+ * Return the status of the last failed netCDF call of the calling thread.
+ */
+static int sl_nc_get_errno (void)
+{
+   return get_nc_errno ();
+}
+
 #define NCID_DUMMY ((SLtype)-1)
 #define NCID_VAR_DUMMY ((SLtype)-2)
 #define NCID_DIM_DUMMY ((SLtype)-3)
 #define NCID_DATATYPE_DUMMY ((SLtype)-4)
+#define NCID_READER_DUMMY ((SLtype)-5)
+#define NCID_FUTURE_DUMMY ((SLtype)-6)
 #undef V
 #undef S
 #undef U
@@ -3318,6 +10233,7 @@ static SLang_Intrin_Fun_Type Module_Intrinsics [] =
    MAKE_INTRINSIC_2("_nc_open", sl_nc_open, V, S, I),
    MAKE_INTRINSIC_1("_nc_refdef", sl_nc_redef, V, NCID_DUMMY),
    MAKE_INTRINSIC_1("_nc_enddef", sl_nc_enddef, V, NCID_DUMMY),
+   MAKE_INTRINSIC_1("_nc_refresh", sl_nc_refresh, V, NCID_DUMMY),
    MAKE_INTRINSIC_1("_nc_close", sl_nc_close, V, NCID_DUMMY),
    MAKE_INTRINSIC_3("_nc_def_dim", sl_nc_def_dim, V, NCID_DUMMY, S, IA),
    MAKE_INTRINSIC_0("_nc_def_var", sl_nc_def_var, V),
@@ -3325,6 +10241,35 @@ static SLang_Intrin_Fun_Type Module_Intrinsics [] =
    /* MAKE_INTRINSIC_2("_nc_put_var", sl_nc_put_var, V, NCID_DUMMY, NCID_VAR_DUMMY), */
    MAKE_INTRINSIC_2("_nc_put_vars", sl_nc_put_vars, V, NCID_DUMMY, NCID_VAR_DUMMY),
    MAKE_INTRINSIC_2("_nc_get_vars", sl_nc_get_vars, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_get_vars_into", sl_nc_get_vars_into, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_get", sl_nc_get, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_get_slices", sl_nc_get_slices, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_put_slices", sl_nc_put_slices, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_get_many", sl_nc_get_many, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_1("_nc_get_multi", sl_nc_get_multi, V, NCID_DUMMY),
+   MAKE_INTRINSIC_0("_nc_set_stride_emulation", sl_nc_set_stride_emulation, V),
+   MAKE_INTRINSIC_2("_nc_get_ordered", sl_nc_get_ordered, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_var_proxy", sl_nc_var_proxy, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_append", sl_nc_append, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_1("_nc_flush", sl_nc_flush, V, NCID_DUMMY),
+   MAKE_INTRINSIC_1("_nc_append_record", sl_nc_append_record, V, NCID_DUMMY),
+   MAKE_INTRINSIC_1("_nc_async_writes", sl_nc_async_writes, V, NCID_DUMMY),
+   MAKE_INTRINSIC_2("_nc_get_async", sl_nc_get_async, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_1("_nc_lock_stats", sl_nc_lock_stats, V, I),
+   MAKE_INTRINSIC_0("_nc_get_errno", sl_nc_get_errno, I),
+   MAKE_INTRINSIC_1("_nc_future_wait", sl_nc_future_wait, V, NCID_FUTURE_DUMMY),
+   MAKE_INTRINSIC_1("_nc_future_ready", sl_nc_future_ready, I, NCID_FUTURE_DUMMY),
+   MAKE_INTRINSIC_2("_nc_records", sl_nc_records, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_1("_nc_reader_next", sl_nc_reader_next, V, NCID_READER_DUMMY),
+   MAKE_INTRINSIC_1("_nc_reader_close", sl_nc_reader_close, V, NCID_READER_DUMMY),
+   MAKE_INTRINSIC_2("_nc_plan_blocks", sl_nc_plan_blocks, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_get_points", sl_nc_get_points, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_put_points", sl_nc_put_points, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_reduce", sl_nc_reduce, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_get_cf", sl_nc_get_cf, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_get_masked_slices", sl_nc_get_masked_slices, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_put_packed", sl_nc_put_packed, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_2("_nc_put", sl_nc_put, V, NCID_DUMMY, NCID_VAR_DUMMY),
 
    MAKE_INTRINSIC_2("_nc_inq_dim", sl_nc_inq_dim, V, NCID_DUMMY, NCID_DIM_DUMMY),
    MAKE_INTRINSIC_2("_nc_inq_dimid", sl_nc_inq_dimid, V, NCID_DUMMY, S),
@@ -3333,6 +10278,7 @@ static SLang_Intrin_Fun_Type Module_Intrinsics [] =
    MAKE_INTRINSIC_2("_nc_inq_var", sl_nc_inq_var, V, NCID_DUMMY, NCID_VAR_DUMMY),
    MAKE_INTRINSIC_2("_nc_inq_varname", sl_nc_inq_varname, V, NCID_DUMMY, NCID_VAR_DUMMY),
    MAKE_INTRINSIC_2("_nc_inq_varshape", sl_nc_inq_varshape, V, NCID_DUMMY, NCID_VAR_DUMMY),
+   MAKE_INTRINSIC_1("_nc_inq_var_writes", sl_nc_inq_var_writes, V, NCID_VAR_DUMMY),
    MAKE_INTRINSIC_1("_nc_inq_global_atts", sl_nc_inq_global_atts, V, NCID_DUMMY),
 
    MAKE_INTRINSIC_4("_nc_put_att", sl_nc_put_att, V, NCID_DUMMY, NCID_VAR_DUMMY, S, NCID_DATATYPE_DUMMY),
@@ -3441,6 +10387,42 @@ static int cl_ncid_type_push (SLtype type, VOID_STAR ptr)
    return push_ncid_type (*(NCid_Type **)ptr);
 }
 
+static void cl_ncid_reader_type_destroy (SLtype type, VOID_STAR ptr)
+{
+   (void) type;
+   free_ncid_reader_type (*(NCid_Reader_Type **)ptr);
+}
+
+static int cl_ncid_reader_type_push (SLtype type, VOID_STAR ptr)
+{
+   (void) type;
+   return push_ncid_reader_type (*(NCid_Reader_Type **)ptr);
+}
+
+static void cl_ncid_future_type_destroy (SLtype type, VOID_STAR ptr)
+{
+   (void) type;
+   free_ncid_future_type (*(NCid_Future_Type **)ptr);
+}
+
+static int cl_ncid_future_type_push (SLtype type, VOID_STAR ptr)
+{
+   (void) type;
+   return push_ncid_future_type (*(NCid_Future_Type **)ptr);
+}
+
+static void cl_ncid_proxy_type_destroy (SLtype type, VOID_STAR ptr)
+{
+   (void) type;
+   free_ncid_proxy_type (*(NCid_Proxy_Type **)ptr);
+}
+
+static int cl_ncid_proxy_type_push (SLtype type, VOID_STAR ptr)
+{
+   (void) type;
+   return push_ncid_proxy_type (*(NCid_Proxy_Type **)ptr);
+}
+
 static void cl_ncid_datatype_type_destroy (SLtype type, VOID_STAR ptr)
 {
    (void) type;
@@ -3610,6 +10592,45 @@ static int register_types (void)
 	  return -1;
      }
 
+   if (NCid_Reader_Type_Id == 0)
+     {
+	if (NULL == (cl = SLclass_allocate_class ("NetCDF_Reader_Type")))
+	  return -1;
+	(void) SLclass_set_destroy_function (cl, cl_ncid_reader_type_destroy);
+	(void) SLclass_set_push_function (cl, cl_ncid_reader_type_push);
+	if (-1 == SLclass_register_class (cl, SLANG_VOID_TYPE, sizeof (NCid_Reader_Type), SLANG_CLASS_TYPE_PTR))
+	  return -1;
+	NCid_Reader_Type_Id = SLclass_get_class_id (cl);
+	if (-1 == SLclass_patch_intrin_fun_table1 (Module_Intrinsics, NCID_READER_DUMMY, NCid_Reader_Type_Id))
+	  return -1;
+     }
+
+   if (NCid_Future_Type_Id == 0)
+     {
+	if (NULL == (cl = SLclass_allocate_class ("NetCDF_Future_Type")))
+	  return -1;
+	(void) SLclass_set_destroy_function (cl, cl_ncid_future_type_destroy);
+	(void) SLclass_set_push_function (cl, cl_ncid_future_type_push);
+	if (-1 == SLclass_register_class (cl, SLANG_VOID_TYPE, sizeof (NCid_Future_Type), SLANG_CLASS_TYPE_PTR))
+	  return -1;
+	NCid_Future_Type_Id = SLclass_get_class_id (cl);
+	if (-1 == SLclass_patch_intrin_fun_table1 (Module_Intrinsics, NCID_FUTURE_DUMMY, NCid_Future_Type_Id))
+	  return -1;
+     }
+
+   if (NCid_Proxy_Type_Id == 0)
+     {
+	if (NULL == (cl = SLclass_allocate_class ("NetCDF_Var_Proxy_Type")))
+	  return -1;
+	(void) SLclass_set_destroy_function (cl, cl_ncid_proxy_type_destroy);
+	(void) SLclass_set_push_function (cl, cl_ncid_proxy_type_push);
+	(void) SLclass_set_aget_function (cl, cl_ncid_proxy_aget);
+	(void) SLclass_set_aput_function (cl, cl_ncid_proxy_aput);
+	if (-1 == SLclass_register_class (cl, SLANG_VOID_TYPE, sizeof (NCid_Proxy_Type), SLANG_CLASS_TYPE_PTR))
+	  return -1;
+	NCid_Proxy_Type_Id = SLclass_get_class_id (cl);
+     }
+
    if (sl_NC_Error == 0)
      {
 	if (-1 == (sl_NC_Error = SLerr_new_exception (SL_RunTime_Error, "NetCDFError", "NetCDF Error")))
@@ -3626,6 +10647,8 @@ int init_netcdf_module_ns (char *ns_name)
    if (-1 == register_types ())
      return -1;
 
+   NC_Main_Thread = pthread_self ();
+
    ns = SLns_create_namespace (ns_name);
    if (ns == NULL)
      return -1;
@@ -3644,4 +10667,5 @@ int init_netcdf_module_ns (char *ns_name)
 /* This function is optional */
 void deinit_netcdf_module (void)
 {
+   stop_future_thread ();
 }